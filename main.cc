@@ -11,9 +11,38 @@
 //******************************************************************************
 
 #include "resources/model.h"
+#include "resources/headless/headless.h"
 #include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <GL/glx.h>
 
-int animation_time = 0;
+//the --headless benchmark draws this many frames of this size, after loading
+//the textures and a few untimed frames
+#define HEADLESS_FRAMES 600
+#define HEADLESS_WIDTH 720
+#define HEADLESS_HEIGHT 480
+#define HEADLESS_WARMUP_FRAMES 10
+
+//where 'p' saves the pass timings, for chrome://tracing, unless --trace says
+//otherwise
+#define TRACE_FILE "frame_trace.json"
+
+//the most frames a second unless --fps says otherwise, 0 for no limit. It
+//keeps the loop from spinning when vsync is off or ignored
+#define FRAME_CAP 120
+
+//while paused, how often to look for edited shaders and textures still loading
+#define IDLE_POLL_MS 250
+
+//the GPU time a frame gets in a window unless --budget says otherwise, 0 to
+//always draw the scene at the window's resolution. It holds 60 fps
+#define FRAME_BUDGET_MS (1000.0 / 60.0)
+
+//where 'r' records the frames to, unless --record says otherwise
+#define RECORD_DIRECTORY "recording"
+
+float animation_time = 0.0f;
 
 //the model
 GroundModel*       ground;
@@ -21,6 +50,21 @@ DudesAndTreesModel* datmodel;
 WaterModel*        water;
 SkirtModel*        skirts;
 
+//the scene is drawn into its target, and it styles it onto the window
+PostProcess*       post;
+
+//the scale the scene is drawn at, to keep to the GPU time budget
+ResolutionScaler scaler;
+
+//saves the frames as pngs while it's recording, dropping the ones it can't
+//keep up with unless record_block
+FrameRecorder recorder;
+std::string record_directory = RECORD_DIRECTORY;
+bool record_block = false;
+
+//where the pass timings are saved to
+std::string trace_file = TRACE_FILE;
+
 //parameters for the game
 int num_good_guys;
 int num_bad_guys;
@@ -35,9 +79,26 @@ bool big_radius = false;
 bool drawdudes = true;
 
 bool rotate = true;
-int temp_time = animation_time;
+float temp_time = animation_time;
+
+//steps the simulation at a fixed rate and spaces out the frames
+FramePacer pacer;
+bool timer_pending = false;  //a frame is already waiting on the cap
+
+//the uniforms every model shares: time, view, light, scroll and scale
+FrameContext frame;
+
+//the draws of a frame, issued together in the order that changes the least state
+DrawQueue queue;
+int frames_since_report = 0;
+
+//where the mouse is, from the bottom left, -1 until it moves
+int mouse_x = -1, mouse_y = -1;
 
-int scroll = 0; // 0 - no scrolling, 1 - slow, 2 - faster
+//while paused, the scene is only drawn again when something changed, and the
+//post process styles the last one onto the window otherwise
+bool scene_changed = true;       //by input or reloaded shaders, since the last frame
+bool idle_poll_pending = false;  //a poll is already waiting on IDLE_POLL_MS
 
 //DEBUG STUFF
 
@@ -63,6 +124,9 @@ void init() {
 	water = new WaterModel();
 	cout << "initializing skirt model" << endl;
 	skirts = new SkirtModel();
+	cout << "initializing post process" << endl;
+	post = new PostProcess();
+	cout << "shader program cache: " << Shader::CacheHits << " hits, " << Shader::CacheMisses << " misses" << endl;
 
 	GLfloat left = -1.366f;
 	GLfloat right = 1.366f;
@@ -71,16 +135,8 @@ void init() {
 	GLfloat zNear = 1.2f;
 	GLfloat zFar = -1.0f;
 
-	glm::mat4 proj = glm::ortho(left, right, top, bottom, zNear, zFar);
-
-	ground->set_proj(proj);
-	water->set_proj(proj);
-	datmodel->set_proj(proj);
-	skirts->set_proj(proj);
-
-	ground->set_scroll(scroll);
-	datmodel->set_scroll(scroll);
-	skirts->set_scroll(scroll);
+	frame.proj = glm::ortho(left, right, top, bottom, zNear, zFar);
+	frame.create();
 
 	glEnable(GL_DEPTH_TEST);
 
@@ -89,6 +145,9 @@ void init() {
 
 	glEnable(GL_LINE_SMOOTH);
 
+	//the dudes and trees set the size of their points in the vertex shader
+	glEnable(GL_PROGRAM_POINT_SIZE);
+
 	//DEBUG
 
 	glEnable              ( GL_DEBUG_OUTPUT );
@@ -99,39 +158,232 @@ void init() {
 }
 
 //----------------------------------------------------------------------------
-void display() {
+//finds the ground under window pixel x, y, counted from the bottom left, and
+//moves the cursor there. A click drops a box there too
+void handle_pick(int x, int y, bool click) {
+	glm::vec2 ndc(2.0f * (x + 0.5f) / glutGet( GLUT_WINDOW_WIDTH ) - 1.0f,
+	              2.0f * (y + 0.5f) / glutGet( GLUT_WINDOW_HEIGHT ) - 1.0f);
+
+	terrain_hit hit;
+	if(!ground->pick(hit, frame, ndc)) {
+		if(click)
+			datmodel->handle_click(glm::vec3(0,0,0));  //off the board
+		return;
+	}
+
+	// cout << "x: " << hit.position.x << " y: " << hit.position.y << endl;
+	//
+	// if(hit.water)
+	//   cout << " which is ... UNDERWATER" << endl;
+
+	datmodel->set_pos(glm::vec3(hit.position.x, hit.position.y, 0.0), glm::vec3(1,0,hit.water ? 255.0f : 0.0f));
+
+	if(click)
+		datmodel->handle_click(glm::vec3(hit.position.x, hit.position.y, hit.water ? 1.0 : 0.0));
+}
 
+//----------------------------------------------------------------------------
+//draws the scene into the post process's target, alpha of the way from the
+//simulation's last step to its next
+void draw_scene(float alpha) {
+	post->bind_scene();
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-	if(rotate) {
-		animation_time++;
-		ground->set_time(animation_time);
-		datmodel->set_time(animation_time);
-		water->set_time(animation_time);
-		skirts->set_time(animation_time);
-	}
+	frame.time = animation_time;
+	frame.resolution = post->get_resolution();
+	frame.update();
+
+	//the cursor follows the ground under the mouse as it moves
+	if(mouse_x >= 0)
+		handle_pick(mouse_x, mouse_y, false);
 
 	//DRAW THE GROUND
 	if(drawground)
-		ground->display();
+		ground->display(queue, frame.scroll);
 	else
-		ground->display(true);
+		ground->display(queue, frame.scroll, true);
 
 
 	//DRAW THE WATER
 	if(drawwater)
-		water->display();
+		water->display(queue);
 
 	//DRAW THE DUDES AND TREES
 	if(drawdudes)
-		datmodel->display();
+		datmodel->display(queue, alpha);
 
 	//DRAW THE SKIRTS
-	skirts->display();
+	skirts->display(queue, frame.scroll);
+
+	queue.execute();
+}
+
+//----------------------------------------------------------------------------
+//draws a frame to the window, or to the headless benchmark's target. Without
+//redraw, the last scene is styled onto it again
+void render_frame(float alpha, bool redraw, OffscreenTarget* target) {
+
+	Profiler::begin_frame();
+
+	if(redraw)
+		draw_scene(alpha);
+
+	if(target) {
+		target->bind();
+	} else {
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		glViewport(0, 0, post->get_width(), post->get_height());
+	}
+	post->display(queue);
+	queue.execute();
+
+	//read back as it is, for the recording
+	if(recorder.recording())
+		recorder.capture(post->get_width(), post->get_height());
+
+	if(++frames_since_report == 600) {
+		GLState::report();
+		Profiler::report();
+		cout << "scene drawn at " << post->get_scale() << " of the resolution" << endl;
+		recorder.report();
+		frames_since_report = 0;
+	}
+}
+
+//----------------------------------------------------------------------------
+//swaps in any shaders that were edited and have finished compiling. Setting
+//them up binds them without going through GLState
+void poll_shaders() {
+	if(ShaderReloader::Poll()) {
+		GLState::invalidate();
+		scene_changed = true;
+	}
+}
+
+//----------------------------------------------------------------------------
+//asks for the next frame as soon as the cap allows it
+void redraw(int) {
+	timer_pending = false;
+	glutPostRedisplay();
+}
+
+void schedule_frame() {
+	if(timer_pending)
+		return;
+	double wait = pacer.until_next_frame();
+	if(wait <= 0.0) {
+		glutPostRedisplay();
+	} else {
+		timer_pending = true;
+		glutTimerFunc((unsigned)ceil(wait * 1000.0), redraw, 0);
+	}
+}
+
+//----------------------------------------------------------------------------
+//while paused, nothing asks for frames but input and this. It uploads the
+//textures coming in, drawn or not, and only asks when a shader was reloaded
+//or a texture changed, so otherwise GLUT's loop sleeps until the next event
+void idle_poll(int);
+
+void schedule_idle_poll() {
+	if(idle_poll_pending)
+		return;
+	idle_poll_pending = true;
+	glutTimerFunc(IDLE_POLL_MS, idle_poll, 0);
+}
+
+void idle_poll(int) {
+	idle_poll_pending = false;
+	if(rotate)
+		return;
+	poll_shaders();
+	if(ProgressiveTexture::update())
+		scene_changed = true;
+	if(scene_changed)
+		glutPostRedisplay();
+	else
+		schedule_idle_poll();
+}
+
+//----------------------------------------------------------------------------
+void display() {
+	//the simulation catches up in fixed steps, unless it's paused, and the
+	//animation follows the time it's been running
+	int steps = pacer.advance(rotate);
+	for(int i = 0; i < steps; i++) {
+		datmodel->big_radius = big_radius;
+		datmodel->update_sim();
+	}
+	if(rotate)
+		animation_time = pacer.get_time() * ANIMATION_RATE;
+
+	if(datmodel->get_boxes_left() == 0 && !datmodel->get_status()) {
+		cout << endl << endl << "GAME OVER" << endl << "with score = " << datmodel->get_score() << endl << endl;
+		exit(EXIT_SUCCESS);
+	}
+
+	//running, every scene is new, at the scale that fits the budget. Paused,
+	//only one after input, a reloaded shader, a texture coming in or the
+	//window changing size is
+	poll_shaders();
+	bool uploaded = ProgressiveTexture::update();
+	if(rotate)
+		post->set_scale(scaler.update(Profiler::get_gpu_frame()));
+	frame.time = animation_time;
+	bool resized = post->resize(glutGet( GLUT_WINDOW_WIDTH ), glutGet( GLUT_WINDOW_HEIGHT ));
+	bool changed = rotate || resized || scene_changed || frame.changed() || (drawdudes && datmodel->is_dirty())
+	               || uploaded;
+	scene_changed = false;
+
+	render_frame(pacer.get_alpha(), changed, NULL);
 
 	glFlush();
 	glutSwapBuffers();
-	glutPostRedisplay();
+	if(rotate)
+		schedule_frame();
+	else
+		schedule_idle_poll();
+}
+
+//----------------------------------------------------------------------------
+//turns vsync on or off, through whichever GLX extension the driver has
+void set_swap_interval(int interval) {
+	Display* display = glXGetCurrentDisplay();
+	const char* extensions = display ? glXQueryExtensionsString(display, DefaultScreen(display)) : NULL;
+	if(!extensions)
+		return;
+
+	if(strstr(extensions, "GLX_EXT_swap_control")) {
+		typedef void (*swap_interval_ext)(Display*, GLXDrawable, int);
+		swap_interval_ext swap = (swap_interval_ext)glXGetProcAddress((const GLubyte*)"glXSwapIntervalEXT");
+		swap(display, glXGetCurrentDrawable(), interval);
+	} else if(strstr(extensions, "GLX_MESA_swap_control")) {
+		typedef int (*swap_interval_mesa)(unsigned);
+		swap_interval_mesa swap = (swap_interval_mesa)glXGetProcAddress((const GLubyte*)"glXSwapIntervalMESA");
+		swap(interval);
+	} else if(interval > 0 && strstr(extensions, "GLX_SGI_swap_control")) {
+		typedef int (*swap_interval_sgi)(int);
+		swap_interval_sgi swap = (swap_interval_sgi)glXGetProcAddress((const GLubyte*)"glXSwapIntervalSGI");
+		swap(interval);
+	} else {
+		cout << "can't set vsync " << (interval ? "on" : "off") << " with this driver" << endl;
+	}
+}
+
+//----------------------------------------------------------------------------
+//finishes the frames still being recorded, when the program exits
+void finish_recording() {
+	recorder.stop();
+}
+
+//----------------------------------------------------------------------------
+//saves the last few thousand pass timings, on 'p', and when the program exits
+//if --trace asked for them
+void save_trace() {
+	if(Profiler::export_trace(trace_file.c_str()))
+		cout << "saved the pass timings to " << trace_file << endl;
+	else
+		cout << "couldn't save the pass timings to " << trace_file << endl;
 }
 
 //----------------------------------------------------------------------------
@@ -141,23 +393,30 @@ void keyboard(unsigned char key, int x, int y) {
 			exit(EXIT_SUCCESS);
 			break;
 
+		case 'r':
+			//start or stop recording
+			if(recorder.recording())
+				recorder.stop();
+			else
+				recorder.start(record_directory, !record_block);
+			break;
+
 		case 'f':
 			glutFullScreen();
 			break;
 
 		case 'a':
-			ground->scale_up();
-			skirts->scale_up();
+			frame.scale *= 1.618f;
 			break;
 		case 's':
-			ground->scale_down();
-			skirts->scale_down();
+			frame.scale /= 1.618f;
 			break;
 
 
 		case 'd':
 			//toggle drawing of ground
 			drawwater = !drawwater;
+			scene_changed = true;
 			break;
 
 		case 'g':
@@ -166,27 +425,27 @@ void keyboard(unsigned char key, int x, int y) {
 
 		case 'h':
 			drawdudes = !drawdudes;
+			scene_changed = true;
 			break;
 
 		case 'z':
 			//toggle drawing of ground
 			drawground = !drawground;
+			scene_changed = true;
 			break;
 
 		case 'x': //cycle speeds
-			switch(scroll) {
+			switch(frame.scroll) {
 				case 0:
-				scroll = 1;
+				frame.scroll = 1;
 				break;
 				case 1:
-				scroll = 2;
+				frame.scroll = 2;
 				break;
 				case 2:
-				scroll = 0;
+				frame.scroll = 0;
 				break;
 			}
-			ground->set_scroll(scroll);
-			skirts->set_scroll(scroll);
 			break;
 
 		case 'v':
@@ -197,12 +456,20 @@ void keyboard(unsigned char key, int x, int y) {
 
 		case 'b':
 			ground->toggle_normals();
+			scene_changed = true;
 			break;
 
 		case 'n':
 			datmodel->toggle_cursor_draw();
 			break;
+
+		case 'p':
+			save_trace();
+			break;
 	}
+	//the keys that change what's drawn set scene_changed, or change the frame
+	//or the entities, which display() checks. Otherwise it only styles the
+	//last scene again
 	glutPostRedisplay();
 }
 
@@ -217,48 +484,9 @@ void mouse( int button, int state, int x, int y ) {
 		}
 
 		if(button == GLUT_LEFT_BUTTON) {
-
-			//clear the screen
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-			//render with selection colors
-			ground->display(true);
-
-			//read out the pixel
-
-			double phi = 1.618;
-			y = glutGet( GLUT_WINDOW_HEIGHT ) - y;
-
-			unsigned char pixel[4];
-			glReadPixels(x, y, 1, 1, GL_RGB, GL_UNSIGNED_BYTE, pixel);
-
-			float calcx = (-phi + ((2*phi)/(205))*((int)pixel[0]-25));
-			float calcy = (-phi + ((2*phi)/(205))*((int)pixel[1]-25));
-
-			// cout << "R: " << (int)pixel[0] << " which is x: " << calcx << endl;
-			// cout << "G: " << (int)pixel[1] << " which is y: " << calcy  << endl;
-			// cout << "B: " << (int)pixel[2];
-			//
-			// if((int) pixel[2] > 0)
-			//   cout << " which is ... UNDERWATER" << endl;
-
-			//do whatever you need to do
-
-			//the r value ranges from 25 to 230 -> map to the range (-phi to phi)
-			//the g value ranges from 25 to 230 -> map to the range (-phi to phi)
-			//the b is usaully either 0 or 255  -> >0 tells you it's in the water
-
-			datmodel->set_pos(glm::vec3(calcx/2, calcy/2, 0.0), glm::vec3(1,0,(float)pixel[2]));
-
-			if(pixel[0] == 0 && pixel[1] == 0 && pixel[2] == 0)
-				datmodel->handle_click(glm::vec3(0,0,0));
-			else
-				datmodel->handle_click(glm::vec3(calcx/2, calcy/2, pixel[2]/255.0));
-
+			handle_pick(x, glutGet( GLUT_WINDOW_HEIGHT ) - y, true);
 			cout << endl;
-
-			//clear the screen
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			scene_changed = true;
 			glutPostRedisplay();
 		}
 		cout << endl << "Your current score is " << datmodel->get_score() << endl;
@@ -267,31 +495,157 @@ void mouse( int button, int state, int x, int y ) {
 
 //----------------------------------------------------------------------------
 
-void timer(int) {
-	datmodel->big_radius = big_radius;
-	if(rotate)
-		datmodel->update_sim();
+void motion( int x, int y ) {
+	mouse_x = x;
+	mouse_y = glutGet( GLUT_WINDOW_HEIGHT ) - y;
 
-	if(datmodel->get_boxes_left() == 0 && !datmodel->get_status()) {
-		cout << endl << endl << "GAME OVER" << endl << "with score = " << datmodel->get_score() << endl << endl;
-		exit(EXIT_SUCCESS);
+	//running, the next frame picks the cursor anyway. Paused, it's picked
+	//here, and the scene is only redrawn if it moved where it's drawn
+	if(!rotate) {
+		handle_pick(mouse_x, mouse_y, false);
+		if(drawdudes && datmodel->is_dirty())
+			glutPostRedisplay();
 	}
-	glutPostRedisplay();
-	glutTimerFunc(1000.0/60.0, timer, 0);
+}
+
+//----------------------------------------------------------------------------
+
+//----------------------------------------------------------------------------
+//the benchmark's script: over the run the view sways through one period and
+//the light turns with it, each scroll mode gets a third of the frames, and
+//the zoom goes in and back out
+void script_frame(int i, int frames) {
+	float f = (float)i / frames;
+	animation_time = f * 4000.0f * 3.14159265f;  //the sway's period, sinf(0.0005f * time)
+	frame.scroll = i * SCROLL_MODES / frames;
+	frame.scale = powf(1.618f, sinf(2.0f * 3.14159265f * f));
+}
+
+//----------------------------------------------------------------------------
+//renders frames into a framebuffer object as fast as it can, and prints how
+//long they took. With record_to, the frames are recorded there as pngs too,
+//dropping the ones the encoder can't keep up with if drop. The encoding is
+//on other threads, but they take cores the renderer might have had
+int run_headless(int frames, const char* record_to, bool drop) {
+	OffscreenTarget target;
+	if(!target.create(HEADLESS_WIDTH, HEADLESS_HEIGHT)) {
+		cout << "couldn't create the offscreen framebuffer" << endl;
+		return(EXIT_FAILURE);
+	}
+	post->resize(HEADLESS_WIDTH, HEADLESS_HEIGHT);
+	cout << endl << "rendering " << frames << " frames at " << HEADLESS_WIDTH << "x" << HEADLESS_HEIGHT
+	     << " with " << glGetString(GL_RENDERER) << endl;
+
+	//until the textures are loaded, then a few more frames to warm up
+	for(int warmup = 0; warmup < HEADLESS_WARMUP_FRAMES; ) {
+		script_frame(0, frames);
+		ProgressiveTexture::update();
+		render_frame(1.0f, true, &target);
+		glFinish();
+		if(ProgressiveTexture::loading() == 0)
+			warmup++;
+		else
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+
+	if(record_to && !recorder.start(record_to, drop))
+		return(EXIT_FAILURE);
+
+	std::vector<double> frame_ms;
+	for(int i = 0; i < frames; i++) {
+		auto start = std::chrono::steady_clock::now();
+		post->set_scale(scaler.update(Profiler::get_gpu_frame()));
+		script_frame(i, frames);
+		datmodel->update_sim();
+		render_frame(1.0f, true, &target);
+		glFinish();  //so it counts drawing the frame, not just queuing it
+		frame_ms.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+	}
+	headless_report(frame_ms);
+	cout << "scene drawn at " << post->get_scale() << " of the resolution at the end" << endl;
+	recorder.stop();
+
+	headless_destroy_context();
+	return(EXIT_SUCCESS);
 }
 
 //----------------------------------------------------------------------------
 
 int main(int argc, char **argv) {
-	glutInit(&argc, argv);
-	glutInitDisplayMode(GLUT_MULTISAMPLE | GLUT_DOUBLE | GLUT_RGBA | GLUT_DEPTH);
+	//--headless benchmarks without a window, --frames sets how many frames
+	//and --dump a directory to save every one of them in. In a window, --fps
+	//caps the frame rate and --vsync 0 or 1 turns vsync off or on. --budget
+	//sets the GPU milliseconds a frame, which the resolution scales to keep
+	//to, or --scale fixes it. --record records from the start to a directory,
+	//and sets the one 'r' records to, and --record-block waits for the
+	//encoder instead of dropping frames. Headless, --record is like --dump
+	//but drops frames like the window does. --trace saves the pass timings
+	//to a file on exit, and sets the one 'p' saves them to. They're taken
+	//out of the args
+	bool headless = false;
+	int headless_frames = HEADLESS_FRAMES;
+	const char* dump_directory = NULL;
+	double frame_cap = FRAME_CAP;
+	int vsync = 1;
+	double budget = -1.0;  //FRAME_BUDGET_MS in a window, none headless
+	float scale = 1.0f;
+	bool record = false;
+	bool trace = false;
+	int kept = 1;
+	for(int i = 1; i < argc; i++) {
+		std::string arg(argv[i]);
+		if(arg == "--headless")
+			headless = true;
+		else if(arg == "--frames" && i + 1 < argc)
+			headless_frames = atoi(argv[++i]);
+		else if(arg == "--dump" && i + 1 < argc)
+			dump_directory = argv[++i];
+		else if(arg == "--fps" && i + 1 < argc)
+			frame_cap = atof(argv[++i]);
+		else if(arg == "--vsync" && i + 1 < argc)
+			vsync = atoi(argv[++i]);
+		else if(arg == "--budget" && i + 1 < argc)
+			budget = atof(argv[++i]);
+		else if(arg == "--scale" && i + 1 < argc) {
+			scale = std::min(1.0f, std::max(RES_SCALE_MIN, (float)atof(argv[++i])));
+			budget = 0.0;
+		} else if(arg == "--record" && i + 1 < argc) {
+			record_directory = argv[++i];
+			record = true;
+		} else if(arg == "--record-block")
+			record_block = true;
+		else if(arg == "--trace" && i + 1 < argc) {
+			trace_file = argv[++i];
+			trace = true;
+		} else
+			argv[kept++] = argv[i];
+	}
+	argc = kept;
 
-	glutInitContextVersion( 4, 5 );
-	glutInitContextProfile( GLUT_CORE_PROFILE );
+	if(headless && record && dump_directory) {
+		cout << "headless: --dump and --record both record the frames, give one of them" << endl;
+		return(EXIT_FAILURE);
+	}
 
-	// glutInitWindowSize(1366/2, 768/2);
-	glutInitWindowSize(720,480);
-	glutCreateWindow("GLUT");
+	if(headless) {
+		std::string error;
+		if(!headless_create_context(4, 5, error)) {
+			cout << "headless: " << error << endl;
+			return(EXIT_FAILURE);
+		}
+	} else {
+		glutInit(&argc, argv);
+		//the window only gets the post process's triangle, so it needs
+		//neither multisampling nor depth
+		glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGBA);
+
+		glutInitContextVersion( 4, 5 );
+		glutInitContextProfile( GLUT_CORE_PROFILE );
+
+		// glutInitWindowSize(1366/2, 768/2);
+		glutInitWindowSize(720,480);
+		glutCreateWindow("GLUT");
+	}
 
 	if(argc == 5) {
 		// cout << argv[0] << endl;		//first arg is application name
@@ -313,11 +667,28 @@ int main(int argc, char **argv) {
 
 	glewInit();
 	init();
+	if(trace)
+		atexit(save_trace);
+	atexit(finish_recording);
+
+	if(budget < 0.0)
+		budget = headless ? 0.0 : FRAME_BUDGET_MS;
+	scaler.set_budget(budget, scale);
+	post->set_scale(scale);
+
+	if(headless)
+		return run_headless(headless_frames, record ? record_directory.c_str() : dump_directory, record && !record_block);
+
+	set_swap_interval(vsync);
+	pacer.set_cap(frame_cap);
+	if(record)
+		recorder.start(record_directory, !record_block);
 
 	glutDisplayFunc(display);
 	glutKeyboardFunc(keyboard);
 	glutMouseFunc( mouse );
-	glutTimerFunc(1000.0/60.0, timer, 0);
+	glutMotionFunc( motion );
+	glutPassiveMotionFunc( motion );
 	glutMainLoop();
 	return(EXIT_SUCCESS);
 }
@@ -28,12 +28,50 @@ The manual and changelog are in the header file "lodepng.h"
 Rename this file to lodepng.cpp to use it for C++, or to lodepng.c to use it for C.
 */
 
+/*mmap, fstat and posix_madvise are only declared for strict C compilers when asked for POSIX*/
+#if !defined(__cplusplus) && defined(__unix__) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
 #include "lodepng.h"
 
 #include <limits.h> /* LONG_MAX */
 #include <stdio.h> /* file handling */
 #include <stdlib.h> /* allocations */
 
+#if defined(LODEPNG_COMPILE_DISK) && (defined(__unix__) || defined(__APPLE__))
+#define LODEPNG_MMAP
+#include <fcntl.h> /* open */
+#include <sys/mman.h> /* mmap, posix_madvise */
+#include <sys/stat.h> /* fstat */
+#include <unistd.h> /* read, close */
+#endif
+
+#if defined(LODEPNG_COMPILE_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define LODEPNG_SSE2
+#include <emmintrin.h> /* SSE2 intrinsics for the color conversion fast paths */
+#endif
+
+#if defined(LODEPNG_COMPILE_THREADS) && defined(__cplusplus) && (__cplusplus >= 201103L)
+#define LODEPNG_THREADS
+#include <atomic>
+#include <thread>
+#include <vector>
+#endif
+
+/*LZ77 match extension compares a machine word at a time where the first differing byte is a count-trailing-zeros away*/
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#if defined(__SIZEOF_SIZE_T__) && defined(__SIZEOF_LONG__) && (__SIZEOF_SIZE_T__ == __SIZEOF_LONG__)
+#define LODEPNG_WORD_MATCH
+#define LODEPNG_CTZ(x) ((unsigned)__builtin_ctzl(x))
+#endif
+#elif defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#define LODEPNG_WORD_MATCH
+static unsigned lodepng_ctz64(unsigned __int64 x) { unsigned long index; _BitScanForward64(&index, x); return index; }
+#define LODEPNG_CTZ(x) lodepng_ctz64(x)
+#endif
+
 #if defined(_MSC_VER) && (_MSC_VER >= 1310) /*Visual Studio: A few warning types are not desired here.*/
 #pragma warning( disable : 4244 ) /*implicit conversions: not warned by gcc -Wall -Wextra and requires too much casts*/
 #pragma warning( disable : 4996 ) /*VS does not like fopen, but fopen_s is not standard C so unusable here*/
@@ -305,6 +343,39 @@ static void lodepng_add32bitInt(ucvector* buffer, unsigned value) {
 }
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
+#if defined(LODEPNG_COMPILE_PNG) && (defined(LODEPNG_COMPILE_ZLIB) || defined(LODEPNG_COMPILE_ENCODER))
+/*
+Runs task(context, i) for every i in 0..numtasks-1, spread over at most numthreads threads (0 means
+one per hardware thread). The calling thread takes part too. The tasks must be independent of each
+other; without C++11 threads, or when thread creation fails, they simply all run on the calling thread.
+*/
+static void runParallel(void (*task)(void*, size_t), void* context, size_t numtasks, unsigned numthreads) {
+  size_t i;
+#ifdef LODEPNG_THREADS
+  if(numthreads == 0) numthreads = std::thread::hardware_concurrency();
+  if(numthreads > numtasks) numthreads = (unsigned)numtasks;
+  if(numthreads > 1) {
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    auto worker = [&]() {
+      for(size_t index = next++; index < numtasks; index = next++) task(context, index);
+    };
+    try {
+      for(i = 1; i < numthreads; ++i) threads.push_back(std::thread(worker));
+    } catch(...) {
+      /*fewer threads than asked for, the ones that did start and this one still finish all the work*/
+    }
+    worker();
+    for(i = 0; i != threads.size(); ++i) threads[i].join();
+    return;
+  }
+#else /*LODEPNG_THREADS*/
+  (void)numthreads;
+#endif /*LODEPNG_THREADS*/
+  for(i = 0; i != numtasks; ++i) task(context, i);
+}
+#endif /*defined(LODEPNG_COMPILE_PNG) && (defined(LODEPNG_COMPILE_ZLIB) || defined(LODEPNG_COMPILE_ENCODER))*/
+
 /* ////////////////////////////////////////////////////////////////////////// */
 /* / File IO                                                                / */
 /* ////////////////////////////////////////////////////////////////////////// */
@@ -356,6 +427,80 @@ unsigned lodepng_load_file(unsigned char** out, size_t* outsize, const char* fil
   return lodepng_buffer_file(*out, (size_t)size, filename);
 }
 
+#ifdef LODEPNG_MMAP
+/*reads all of a pipe, socket or other stream whose size isn't known upfront, in pieces until end of file*/
+static unsigned lodepng_read_stream(unsigned char** out, size_t* outsize, int fd) {
+  ucvector buffer;
+  unsigned error = 0;
+  buffer.data = 0;
+  buffer.size = buffer.allocsize = 0;
+  for(;;) {
+    ssize_t readsize;
+    if(!ucvector_reserve(&buffer, buffer.size + 65536)) ERROR_BREAK(83); /*alloc fail*/
+    readsize = read(fd, buffer.data + buffer.size, buffer.allocsize - buffer.size);
+    if(readsize < 0) ERROR_BREAK(78);
+    if(readsize == 0) break;
+    buffer.size += (size_t)readsize;
+  }
+  if(error) {
+    lodepng_free(buffer.data);
+    return error;
+  }
+  *out = buffer.data;
+  *outsize = buffer.size;
+  return 0;
+}
+#endif /*LODEPNG_MMAP*/
+
+unsigned lodepng_map_file(const unsigned char** out, size_t* outsize, unsigned* mapped, const char* filename) {
+  unsigned char* buffer = 0;
+  unsigned error;
+#ifdef LODEPNG_MMAP
+  struct stat st;
+  int fd = open(filename, O_RDONLY);
+  if(fd < 0) return 78;
+  if(fstat(fd, &st) != 0) {
+    close(fd);
+    return 78;
+  }
+  if(S_ISREG(st.st_mode) && st.st_size > 0 && (off_t)(size_t)st.st_size == st.st_size) {
+    void* data = mmap(0, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(data != MAP_FAILED) {
+      close(fd);
+      /*chunks are parsed front to back once, so read ahead aggressively and start reading ahead now*/
+      posix_madvise(data, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+      posix_madvise(data, (size_t)st.st_size, POSIX_MADV_WILLNEED);
+      *out = (const unsigned char*)data;
+      *outsize = (size_t)st.st_size;
+      *mapped = 1;
+      return 0;
+    }
+  }
+  /*not a regular file, empty, or the mapping failed: read it through a buffer instead*/
+  *mapped = 0;
+  error = lodepng_read_stream(&buffer, outsize, fd);
+  close(fd);
+#else /*LODEPNG_MMAP*/
+  *mapped = 0;
+  error = lodepng_load_file(&buffer, outsize, filename);
+#endif /*LODEPNG_MMAP*/
+  *out = buffer;
+  return error;
+}
+
+void lodepng_unmap_file(const unsigned char* buffer, size_t buffersize, unsigned mapped) {
+#ifdef LODEPNG_MMAP
+  if(mapped) {
+    munmap((void*)buffer, buffersize);
+    return;
+  }
+#else /*LODEPNG_MMAP*/
+  (void)mapped;
+#endif /*LODEPNG_MMAP*/
+  (void)buffersize;
+  lodepng_free((void*)buffer);
+}
+
 /*write given buffer to the file, overwriting the file, it doesn't append to it.*/
 unsigned lodepng_save_file(const unsigned char* buffer, size_t buffersize, const char* filename) {
   FILE* file;
@@ -1119,21 +1264,38 @@ static unsigned inflateNoCompression(ucvector* out, const unsigned char* in, siz
   return error;
 }
 
-static unsigned lodepng_inflatev(ucvector* out,
-                                 const unsigned char* in, size_t insize,
-                                 const LodePNGDecompressSettings* settings) {
+/*lets the caller look at the inflated data while inflating continues, e.g. to show parts of an image early*/
+typedef struct InflateProgress {
+  size_t threshold; /*report is called after the first block that makes the output at least this big, 0 for never*/
+  /*returns error code, and sets the next threshold. It may drop data it's done with from the start of out, as
+  long as the last 32768 bytes before *pos stay, since later blocks can still copy from them. Then it must
+  lower *pos and out->size by that much.*/
+  unsigned (*report)(struct InflateProgress* progress, ucvector* out, size_t* pos);
+} InflateProgress;
+
+/*
+Inflates deflate blocks until the one with BFINAL set. If segmentend is not 0, in instead starts at a restart
+segment in the middle of a stream (see restart_segments in LodePNGEncoderSettings): its blocks must run out
+exactly at byte segmentend, the last one being the empty stored block that byte-aligns the next segment.
+progress may be NULL.
+*/
+static unsigned inflateBlocks(ucvector* out, const unsigned char* in, size_t insize, size_t segmentend,
+                              InflateProgress* progress) {
   /*bit pointer in the "in" data, current byte is bp >> 3, current bit is bp & 0x7 (from lsb to msb of the byte)*/
   size_t bp = 0;
   unsigned BFINAL = 0;
   size_t pos = 0; /*byte position in the out buffer*/
   unsigned error = 0;
 
-  (void)settings;
-
   while(!BFINAL) {
     unsigned BTYPE;
+    if(segmentend && bp >= segmentend * 8) {
+      if(bp != segmentend * 8) return 52; /*error, the segment's blocks don't end where the next one starts*/
+      break; /*the stream continues in the next segment*/
+    }
     if(bp + 2 >= insize * 8) return 52; /*error, bit pointer will jump past memory*/
     BFINAL = readBitFromStream(&bp, in);
+    if(segmentend && BFINAL) return 52; /*error, the stream can't end before its last segment*/
     BTYPE = 1u * readBitFromStream(&bp, in);
     BTYPE += 2u * readBitFromStream(&bp, in);
 
@@ -1141,12 +1303,22 @@ static unsigned lodepng_inflatev(ucvector* out,
     else if(BTYPE == 0) error = inflateNoCompression(out, in, &bp, &pos, insize); /*no compression*/
     else error = inflateHuffmanBlock(out, in, &bp, &pos, insize, BTYPE); /*compression, BTYPE 01 or 10*/
 
+    if(!error && progress && progress->threshold && pos >= progress->threshold) {
+      error = progress->report(progress, out, &pos);
+    }
     if(error) return error;
   }
 
   return error;
 }
 
+static unsigned lodepng_inflatev(ucvector* out,
+                                 const unsigned char* in, size_t insize,
+                                 const LodePNGDecompressSettings* settings) {
+  (void)settings;
+  return inflateBlocks(out, in, insize, 0, 0);
+}
+
 unsigned lodepng_inflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGDecompressSettings* settings) {
@@ -1292,6 +1464,42 @@ static unsigned getHash(const unsigned char* data, size_t size, size_t pos) {
   return result & HASH_BIT_MASK;
 }
 
+/*
+Hash of the 4 bytes at pos, used by the compression levels. Filtered scanlines of RGBA and 16-bit pixels
+repeat in 4-byte units, so hashing a whole pixel gives much shorter hash chains than getHash. All zeros
+still hash to 0, which the zeros speedup in encodeLZ77 relies on.
+*/
+static unsigned getHash4(const unsigned char* data, size_t size, size_t pos) {
+  if(pos + 3 < size) {
+    unsigned value = (unsigned)data[pos + 0] | ((unsigned)data[pos + 1] << 8u)
+                   | ((unsigned)data[pos + 2] << 16u) | ((unsigned)data[pos + 3] << 24u);
+    /*multiplicative (Fibonacci) hashing, the top 16 bits are the best mixed ones*/
+    return ((value * 2654435761u) & 0xffffffffu) >> 16u;
+  }
+  return getHash(data, size, pos);
+}
+
+/*the end of the common part of foreptr and backptr, which ends at lastptr at most*/
+static const unsigned char* matchEnd(const unsigned char* foreptr, const unsigned char* backptr,
+                                     const unsigned char* lastptr) {
+#ifdef LODEPNG_WORD_MATCH
+  /*compare a machine word at a time, the lowest set bit of the xor is the first byte that differs*/
+  while((size_t)(lastptr - foreptr) >= sizeof(size_t)) {
+    size_t a, b;
+    memcpy(&a, foreptr, sizeof(size_t));
+    memcpy(&b, backptr, sizeof(size_t));
+    if(a != b) return foreptr + (LODEPNG_CTZ(a ^ b) >> 3);
+    foreptr += sizeof(size_t);
+    backptr += sizeof(size_t);
+  }
+#endif /*LODEPNG_WORD_MATCH*/
+  while(foreptr != lastptr && *backptr == *foreptr) {
+    ++backptr;
+    ++foreptr;
+  }
+  return foreptr;
+}
+
 static unsigned countZeros(const unsigned char* data, size_t size, size_t pos) {
   const unsigned char* start = data + pos;
   const unsigned char* end = start + MAX_SUPPORTED_DEFLATE_LENGTH;
@@ -1313,6 +1521,20 @@ static void updateHashChain(Hash* hash, size_t wpos, unsigned hashval, unsigned
   hash->headz[numzeros] = (int)wpos;
 }
 
+/*LZ77 search effort per compression level (see level in LodePNGCompressSettings), similar to zlib's levels*/
+typedef struct LZ77Level {
+  unsigned maxchainlength; /*at most this many earlier positions with the same hash are tried*/
+  unsigned nicematch; /*stop searching once a match of this length is found*/
+  unsigned maxlazymatch; /*only look for a longer match at the next byte after matches up to this length, 0: never*/
+} LZ77Level;
+
+static const LZ77Level LZ77_LEVELS[10] = {
+  {0, 0, 0}, /*level 0: the windowsize, nicematch and lazymatching settings decide*/
+  {4, 8, 0}, {8, 16, 0}, {32, 32, 0},
+  {16, 16, 4}, {32, 32, 16}, {128, 128, 16},
+  {256, 128, 32}, {1024, 258, 128}, {4096, 258, 258}
+};
+
 /*
 LZ77-encode the data. Return value is error code. The input are raw bytes, the output
 is in the form of unsigned integers with codes representing for example literal bytes, or
@@ -1323,13 +1545,18 @@ the "dictionary". A brute force search through all possible distances would be s
 this hash technique is one out of several ways to speed this up.
 */
 static unsigned encodeLZ77(uivector* out, Hash* hash,
-                           const unsigned char* in, size_t inpos, size_t insize, unsigned windowsize,
-                           unsigned minmatch, unsigned nicematch, unsigned lazymatching) {
+                           const unsigned char* in, size_t inpos, size_t insize,
+                           const LodePNGCompressSettings* settings) {
   size_t pos;
   unsigned i, error = 0;
+  unsigned windowsize = settings->windowsize;
+  unsigned minmatch = settings->minmatch;
+  unsigned nicematch = settings->nicematch;
+  unsigned lazymatching = settings->lazymatching;
   /*for large window lengths, assume the user wants no compression loss. Otherwise, max hash chain length speedup.*/
   unsigned maxchainlength = windowsize >= 8192 ? windowsize : windowsize / 8;
   unsigned maxlazymatch = windowsize >= 8192 ? MAX_SUPPORTED_DEFLATE_LENGTH : 64;
+  unsigned hash4 = settings->level != 0; /*use getHash4 instead of getHash*/
 
   unsigned usezeros = 1; /*not sure if setting it to false for windowsize < 8192 is better or worse*/
   unsigned numzeros = 0;
@@ -1347,13 +1574,21 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
   if(windowsize == 0 || windowsize > 32768) return 60; /*error: windowsize smaller/larger than allowed*/
   if((windowsize & (windowsize - 1)) != 0) return 90; /*error: must be power of two*/
 
+  if(settings->level != 0) {
+    const LZ77Level* level = &LZ77_LEVELS[settings->level > 9 ? 9 : settings->level];
+    maxchainlength = level->maxchainlength;
+    nicematch = level->nicematch;
+    maxlazymatch = level->maxlazymatch;
+    lazymatching = level->maxlazymatch != 0;
+  }
+
   if(nicematch > MAX_SUPPORTED_DEFLATE_LENGTH) nicematch = MAX_SUPPORTED_DEFLATE_LENGTH;
 
   for(pos = inpos; pos < insize; ++pos) {
     size_t wpos = pos & (windowsize - 1); /*position for in 'circular' hash buffers*/
     unsigned chainlength = 0;
 
-    hashval = getHash(in, insize, pos);
+    hashval = hash4 ? getHash4(in, insize, pos) : getHash(in, insize, pos);
 
     if(usezeros && hashval == 0) {
       if(numzeros == 0) numzeros = countZeros(in, insize, pos);
@@ -1393,10 +1628,7 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
           foreptr += skip;
         }
 
-        while(foreptr != lastptr && *backptr == *foreptr) /*maximum supported length by deflate is max length*/ {
-          ++backptr;
-          ++foreptr;
-        }
+        foreptr = matchEnd(foreptr, backptr, lastptr); /*maximum supported length by deflate is max length*/
         current_length = (unsigned)(foreptr - &in[pos]);
 
         if(current_length > length) {
@@ -1456,7 +1688,7 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
       for(i = 1; i < length; ++i) {
         ++pos;
         wpos = pos & (windowsize - 1);
-        hashval = getHash(in, insize, pos);
+        hashval = hash4 ? getHash4(in, insize, pos) : getHash(in, insize, pos);
         if(usezeros && hashval == 0) {
           if(numzeros == 0) numzeros = countZeros(in, insize, pos);
           else if(pos + numzeros > insize || in[pos + numzeros - 1] != 0) --numzeros;
@@ -1471,9 +1703,59 @@ static unsigned encodeLZ77(uivector* out, Hash* hash,
   return error;
 }
 
+/*
+Run-length alternative to encodeLZ77 (see rle in LodePNGCompressSettings). Only distances 1 to 4 are tried,
+which finds runs of equal bytes as well as runs of equal pixels up to 4 bytes wide. Needs no hash.
+*/
+static unsigned encodeRLE(uivector* out, const unsigned char* in, size_t inpos, size_t insize, unsigned minmatch) {
+  size_t pos = inpos;
+  if(minmatch < 3) minmatch = 3;
+
+  while(pos < insize) {
+    const unsigned char* lastptr = &in[insize < pos + MAX_SUPPORTED_DEFLATE_LENGTH ?
+                                       insize : pos + MAX_SUPPORTED_DEFLATE_LENGTH];
+    unsigned length = 0, offset = 0, distance;
+
+    for(distance = 1; distance <= 4 && distance <= pos; ++distance) {
+      const unsigned char* foreptr = matchEnd(&in[pos], &in[pos - distance], lastptr);
+      if((unsigned)(foreptr - &in[pos]) > length) {
+        length = (unsigned)(foreptr - &in[pos]);
+        offset = distance;
+      }
+    }
+
+    if(length >= minmatch) {
+      addLengthDistance(out, length, offset);
+      pos += length;
+    } else {
+      if(!uivector_push_back(out, in[pos])) return 83; /*alloc fail*/
+      ++pos;
+    }
+  }
+
+  return 0;
+}
+
+/*puts the positions of the preset dictionary in[0..dictsize) in the hash chains, as encodeLZ77 would have*/
+static void hashDictionary(Hash* hash, const unsigned char* in, size_t dictsize, size_t insize,
+                           const LodePNGCompressSettings* settings) {
+  size_t pos;
+  unsigned numzeros = 0;
+  for(pos = 0; pos != dictsize; ++pos) {
+    unsigned hashval = settings->level != 0 ? getHash4(in, insize, pos) : getHash(in, insize, pos);
+    if(hashval == 0) {
+      if(numzeros == 0) numzeros = countZeros(in, insize, pos);
+      else if(pos + numzeros > insize || in[pos + numzeros - 1] != 0) --numzeros;
+    } else {
+      numzeros = 0;
+    }
+    updateHashChain(hash, pos & (settings->windowsize - 1), hashval, (unsigned short)numzeros);
+  }
+}
+
 /* /////////////////////////////////////////////////////////////////////////// */
 
-static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize) {
+static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, size_t datasize, unsigned final) {
   /*non compressed deflate block data: 1 bit BFINAL,2 bits BTYPE,(5 bits): it jumps to start of next byte,
   2 bytes LEN, 2 bytes NLEN, LEN bytes literal DATA*/
 
@@ -1483,7 +1765,7 @@ static unsigned deflateNoCompression(ucvector* out, const unsigned char* data, s
     unsigned BFINAL, BTYPE, LEN, NLEN;
     unsigned char firstbyte;
 
-    BFINAL = (i == numdeflateblocks - 1);
+    BFINAL = final && (i == numdeflateblocks - 1);
     BTYPE = 0;
 
     firstbyte = (unsigned char)(BFINAL + ((BTYPE & 1) << 1) + ((BTYPE & 2) << 1));
@@ -1596,8 +1878,8 @@ static unsigned deflateDynamic(ucvector* out, size_t* bp, Hash* hash,
   allow breaking out of it to the cleanup phase on error conditions.*/
   while(!error) {
     if(settings->use_lz77) {
-      error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                         settings->minmatch, settings->nicematch, settings->lazymatching);
+      if(settings->rle) error = encodeRLE(&lz77_encoded, data, datapos, dataend, settings->minmatch);
+      else error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings);
       if(error) break;
     } else {
       if(!uivector_resize(&lz77_encoded, datasize)) ERROR_BREAK(83 /*alloc fail*/);
@@ -1785,8 +2067,8 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
   if(settings->use_lz77) /*LZ77 encoded*/ {
     uivector lz77_encoded;
     uivector_init(&lz77_encoded);
-    error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings->windowsize,
-                       settings->minmatch, settings->nicematch, settings->lazymatching);
+    if(settings->rle) error = encodeRLE(&lz77_encoded, data, datapos, dataend, settings->minmatch);
+    else error = encodeLZ77(&lz77_encoded, hash, data, datapos, dataend, settings);
     if(!error) writeLZ77data(bp, out, &lz77_encoded, &tree_ll, &tree_d);
     uivector_cleanup(&lz77_encoded);
   } else /*no LZ77, but still will be Huffman compressed*/ {
@@ -1804,37 +2086,74 @@ static unsigned deflateFixed(ucvector* out, size_t* bp, Hash* hash,
   return error;
 }
 
-static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
-                                 const LodePNGCompressSettings* settings) {
+/*
+Deflates in[dictsize..insize) as a part of a stream. Back references may point into the preset dictionary
+in[0..dictsize), the end of the previous part, or dictsize is 0 for a part that must inflate on its own.
+If final is 0, the last block doesn't get BFINAL and an empty stored block is added after it, so that the
+part ends byte-aligned and another one can directly follow.
+*/
+static unsigned deflatePart(ucvector* out, const unsigned char* in, size_t dictsize, size_t insize,
+                            const LodePNGCompressSettings* settings, unsigned final) {
   unsigned error = 0;
   size_t i, blocksize, numdeflateblocks;
   size_t bp = 0; /*the bit pointer*/
+  size_t datasize = insize - dictsize;
   Hash hash;
 
   if(settings->btype > 2) return 61;
-  else if(settings->btype == 0) return deflateNoCompression(out, in, insize);
-  else if(settings->btype == 1) blocksize = insize;
+  else if(settings->btype == 0) {
+    error = deflateNoCompression(out, in + dictsize, datasize, final);
+    if(!final) {
+      /*empty stored block, already byte-aligned: 3 header bits and padding, LEN 0, NLEN 65535*/
+      ucvector_push_back(out, 0);
+      ucvector_push_back(out, 0); ucvector_push_back(out, 0);
+      ucvector_push_back(out, 255); ucvector_push_back(out, 255);
+    }
+    return error;
+  }
+  else if(settings->btype == 1) blocksize = datasize;
   else /*if(settings->btype == 2)*/ {
     /*on PNGs, deflate blocks of 65-262k seem to give most dense encoding*/
-    blocksize = insize / 8 + 8;
+    blocksize = datasize / 8 + 8;
     if(blocksize < 65536) blocksize = 65536;
     if(blocksize > 262144) blocksize = 262144;
   }
 
-  numdeflateblocks = (insize + blocksize - 1) / blocksize;
+  numdeflateblocks = (datasize + blocksize - 1) / blocksize;
   if(numdeflateblocks == 0) numdeflateblocks = 1;
 
+  if(settings->use_lz77 && !settings->rle && dictsize) {
+    if(settings->windowsize == 0 || settings->windowsize > 32768) return 60; /*error: invalid windowsize*/
+    if((settings->windowsize & (settings->windowsize - 1)) != 0) return 90; /*error: must be power of two*/
+    /*only the last windowsize bytes of the dictionary can be referred to*/
+    if(dictsize > settings->windowsize) {
+      in += dictsize - settings->windowsize;
+      insize -= dictsize - settings->windowsize;
+      dictsize = settings->windowsize;
+    }
+  }
+
   error = hash_init(&hash, settings->windowsize);
   if(error) return error;
+  if(settings->use_lz77 && !settings->rle) hashDictionary(&hash, in, dictsize, insize, settings);
 
   for(i = 0; i != numdeflateblocks && !error; ++i) {
-    unsigned final = (i == numdeflateblocks - 1);
-    size_t start = i * blocksize;
+    unsigned lastblock = final && (i == numdeflateblocks - 1);
+    size_t start = dictsize + i * blocksize;
     size_t end = start + blocksize;
     if(end > insize) end = insize;
 
-    if(settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, start, end, settings, final);
-    else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, final);
+    if(settings->btype == 1) error = deflateFixed(out, &bp, &hash, in, start, end, settings, lastblock);
+    else if(settings->btype == 2) error = deflateDynamic(out, &bp, &hash, in, start, end, settings, lastblock);
+  }
+
+  if(!error && !final) {
+    /*empty stored block: BFINAL 0 and BTYPE 00, the rest of the byte is padding, then LEN 0, NLEN 65535*/
+    addBitToStream(&bp, out, 0);
+    addBitToStream(&bp, out, 0);
+    addBitToStream(&bp, out, 0);
+    ucvector_push_back(out, 0); ucvector_push_back(out, 0);
+    ucvector_push_back(out, 255); ucvector_push_back(out, 255);
   }
 
   hash_cleanup(&hash);
@@ -1842,6 +2161,11 @@ static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t
   return error;
 }
 
+static unsigned lodepng_deflatev(ucvector* out, const unsigned char* in, size_t insize,
+                                 const LodePNGCompressSettings* settings) {
+  return deflatePart(out, in, 0, insize, settings, 1);
+}
+
 unsigned lodepng_deflate(unsigned char** out, size_t* outsize,
                          const unsigned char* in, size_t insize,
                          const LodePNGCompressSettings* settings) {
@@ -1878,6 +2202,36 @@ static unsigned update_adler32(unsigned adler, const unsigned char* data, unsign
     /*at least 5552 sums can be done before the sums overflow, saving a lot of module divisions*/
     unsigned amount = len > 5552 ? 5552 : len;
     len -= amount;
+#ifdef LODEPNG_SSE2
+    if(amount >= 16) {
+      /*16 bytes per step: s1 grows by their sum, s2 by 16 times the s1 before the step plus the
+      bytes weighted 16..1. The per-step s1 values are summed in vs1_steps, so only one
+      horizontal sum per 5552 bytes is needed.*/
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i weights_lo = _mm_set_epi16(9, 10, 11, 12, 13, 14, 15, 16);
+      const __m128i weights_hi = _mm_set_epi16(1, 2, 3, 4, 5, 6, 7, 8);
+      __m128i vs1 = zero, vs1_steps = zero, vs2 = zero;
+      unsigned blocks = amount / 16;
+      s2 += s1 * (blocks * 16);
+      amount -= blocks * 16;
+      while(blocks > 0) {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)data);
+        vs1_steps = _mm_add_epi32(vs1_steps, vs1);
+        vs1 = _mm_add_epi32(vs1, _mm_sad_epu8(bytes, zero));
+        vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(_mm_unpacklo_epi8(bytes, zero), weights_lo));
+        vs2 = _mm_add_epi32(vs2, _mm_madd_epi16(_mm_unpackhi_epi8(bytes, zero), weights_hi));
+        data += 16;
+        --blocks;
+      }
+      /*horizontal sums, the _mm_sad_epu8 sums are in the low 32 bits of each 64-bit lane*/
+      vs2 = _mm_add_epi32(vs2, _mm_slli_epi32(vs1_steps, 4));
+      vs2 = _mm_add_epi32(vs2, _mm_shuffle_epi32(vs2, _MM_SHUFFLE(1, 0, 3, 2)));
+      vs2 = _mm_add_epi32(vs2, _mm_shuffle_epi32(vs2, _MM_SHUFFLE(2, 3, 0, 1)));
+      vs1 = _mm_add_epi32(vs1, _mm_shuffle_epi32(vs1, _MM_SHUFFLE(1, 0, 3, 2)));
+      s1 += (unsigned)_mm_cvtsi128_si32(vs1);
+      s2 += (unsigned)_mm_cvtsi128_si32(vs2);
+    }
+#endif /*LODEPNG_SSE2*/
     while(amount > 0) {
       s1 += (*data++);
       s2 += s1;
@@ -1895,15 +2249,30 @@ static unsigned adler32(const unsigned char* data, unsigned len) {
   return update_adler32(1L, data, len);
 }
 
+#ifdef LODEPNG_COMPILE_PNG
+/*Return the adler32 of two concatenated buffers, given the adler32 of each and the length of the second*/
+static unsigned adler32_combine(unsigned adler1, unsigned adler2, size_t len2) {
+  unsigned rem = (unsigned)(len2 % 65521);
+  unsigned s1 = adler1 & 0xffff;
+  unsigned s2 = (unsigned)(((unsigned long)rem * s1) % 65521);
+  s1 += (adler2 & 0xffff) + 65521 - 1;
+  s2 += ((adler1 >> 16) & 0xffff) + ((adler2 >> 16) & 0xffff) + 65521 - rem;
+  if(s1 >= 65521) s1 -= 65521;
+  if(s1 >= 65521) s1 -= 65521;
+  if(s2 >= 65521 * 2) s2 -= 65521 * 2;
+  if(s2 >= 65521) s2 -= 65521;
+  return (s2 << 16) | s1;
+}
+#endif /*LODEPNG_COMPILE_PNG*/
+
 /* ////////////////////////////////////////////////////////////////////////// */
 /* / Zlib                                                                   / */
 /* ////////////////////////////////////////////////////////////////////////// */
 
 #ifdef LODEPNG_COMPILE_DECODER
 
-unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
-                                 size_t insize, const LodePNGDecompressSettings* settings) {
-  unsigned error = 0;
+/*checks the 2-byte zlib header, returns error code*/
+static unsigned zlib_check_header(const unsigned char* in, size_t insize) {
   unsigned CM, CINFO, FDICT;
 
   if(insize < 2) return 53; /*error, size of zlib data too small*/
@@ -1929,18 +2298,44 @@ unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const uns
     return 26;
   }
 
-  error = inflate(out, outsize, in + 2, insize - 2, settings);
-  if(error) return error;
+  return 0;
+}
 
+static unsigned zlib_check_adler32(const unsigned char* out, size_t outsize, const unsigned char* in,
+                                   size_t insize, const LodePNGDecompressSettings* settings) {
   if(!settings->ignore_adler32) {
     unsigned ADLER32 = lodepng_read32bitInt(&in[insize - 4]);
-    unsigned checksum = adler32(*out, (unsigned)(*outsize));
+    unsigned checksum = adler32(out, (unsigned)outsize);
     if(checksum != ADLER32) return 58; /*error, adler checksum not correct, data must be corrupted*/
   }
+  return 0;
+}
 
-  return 0; /*no error*/
+unsigned lodepng_zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
+                                 size_t insize, const LodePNGDecompressSettings* settings) {
+  unsigned error = zlib_check_header(in, insize);
+  if(error) return error;
+
+  error = inflate(out, outsize, in + 2, insize - 2, settings);
+  if(error) return error;
+
+  return zlib_check_adler32(*out, *outsize, in, insize, settings);
 }
 
+#ifdef LODEPNG_COMPILE_PNG
+/*lodepng_zlib_decompress with the built-in inflate, reporting progress while it goes*/
+static unsigned zlib_decompress_progress(ucvector* out, const unsigned char* in, size_t insize,
+                                         const LodePNGDecompressSettings* settings, InflateProgress* progress) {
+  unsigned error = zlib_check_header(in, insize);
+  if(error) return error;
+
+  error = inflateBlocks(out, in + 2, insize - 2, 0, progress);
+  if(error) return error;
+
+  return zlib_check_adler32(out->data, out->size, in, insize, settings);
+}
+#endif /*LODEPNG_COMPILE_PNG*/
+
 static unsigned zlib_decompress(unsigned char** out, size_t* outsize, const unsigned char* in,
                                 size_t insize, const LodePNGDecompressSettings* settings) {
   if(settings->custom_zlib) {
@@ -1954,6 +2349,19 @@ static unsigned zlib_decompress(unsigned char** out, size_t* outsize, const unsi
 
 #ifdef LODEPNG_COMPILE_ENCODER
 
+static void addZlibHeader(ucvector* out) {
+  /*zlib data: 1 byte CMF (CM+CINFO), 1 byte FLG, deflate data, 4 byte ADLER32 checksum of the Decompressed data*/
+  unsigned CMF = 120; /*0b01111000: CM 8, CINFO 7. With CINFO 7, any window size up to 32768 can be used.*/
+  unsigned FLEVEL = 0;
+  unsigned FDICT = 0;
+  unsigned CMFFLG = 256 * CMF + FDICT * 32 + FLEVEL * 64;
+  unsigned FCHECK = 31 - CMFFLG % 31;
+  CMFFLG += FCHECK;
+
+  ucvector_push_back(out, (unsigned char)(CMFFLG >> 8));
+  ucvector_push_back(out, (unsigned char)(CMFFLG & 255));
+}
+
 unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsigned char* in,
                                size_t insize, const LodePNGCompressSettings* settings) {
   /*initially, *out must be NULL and outsize 0, if you just give some random *out
@@ -1964,19 +2372,10 @@ unsigned lodepng_zlib_compress(unsigned char** out, size_t* outsize, const unsig
   unsigned char* deflatedata = 0;
   size_t deflatesize = 0;
 
-  /*zlib data: 1 byte CMF (CM+CINFO), 1 byte FLG, deflate data, 4 byte ADLER32 checksum of the Decompressed data*/
-  unsigned CMF = 120; /*0b01111000: CM 8, CINFO 7. With CINFO 7, any window size up to 32768 can be used.*/
-  unsigned FLEVEL = 0;
-  unsigned FDICT = 0;
-  unsigned CMFFLG = 256 * CMF + FDICT * 32 + FLEVEL * 64;
-  unsigned FCHECK = 31 - CMFFLG % 31;
-  CMFFLG += FCHECK;
-
   /*ucvector-controlled version of the output buffer, for dynamic array*/
   ucvector_init_buffer(&outv, *out, *outsize);
 
-  ucvector_push_back(&outv, (unsigned char)(CMFFLG >> 8));
-  ucvector_push_back(&outv, (unsigned char)(CMFFLG & 255));
+  addZlibHeader(&outv);
 
   error = deflate(&deflatedata, &deflatesize, in, insize, settings);
 
@@ -2039,13 +2438,15 @@ void lodepng_compress_settings_init(LodePNGCompressSettings* settings) {
   settings->minmatch = 3;
   settings->nicematch = 128;
   settings->lazymatching = 1;
+  settings->level = 0;
+  settings->rle = 0;
 
   settings->custom_zlib = 0;
   settings->custom_deflate = 0;
   settings->custom_context = 0;
 }
 
-const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0};
+const LodePNGCompressSettings lodepng_default_compress_settings = {2, 1, DEFAULT_WINDOWSIZE, 3, 128, 1, 0, 0, 0, 0, 0};
 
 
 #endif /*LODEPNG_COMPILE_ENCODER*/
@@ -2079,47 +2480,303 @@ const LodePNGDecompressSettings lodepng_default_decompress_settings = {0, 0, 0,
 
 #ifndef LODEPNG_NO_COMPILE_CRC
 /* CRC polynomial: 0xedb88320 */
-static unsigned lodepng_crc32_table[256] = {
-           0u, 1996959894u, 3993919788u, 2567524794u,  124634137u, 1886057615u, 3915621685u, 2657392035u,
-   249268274u, 2044508324u, 3772115230u, 2547177864u,  162941995u, 2125561021u, 3887607047u, 2428444049u,
-   498536548u, 1789927666u, 4089016648u, 2227061214u,  450548861u, 1843258603u, 4107580753u, 2211677639u,
-   325883990u, 1684777152u, 4251122042u, 2321926636u,  335633487u, 1661365465u, 4195302755u, 2366115317u,
-   997073096u, 1281953886u, 3579855332u, 2724688242u, 1006888145u, 1258607687u, 3524101629u, 2768942443u,
-   901097722u, 1119000684u, 3686517206u, 2898065728u,  853044451u, 1172266101u, 3705015759u, 2882616665u,
-   651767980u, 1373503546u, 3369554304u, 3218104598u,  565507253u, 1454621731u, 3485111705u, 3099436303u,
-   671266974u, 1594198024u, 3322730930u, 2970347812u,  795835527u, 1483230225u, 3244367275u, 3060149565u,
-  1994146192u,   31158534u, 2563907772u, 4023717930u, 1907459465u,  112637215u, 2680153253u, 3904427059u,
-  2013776290u,  251722036u, 2517215374u, 3775830040u, 2137656763u,  141376813u, 2439277719u, 3865271297u,
-  1802195444u,  476864866u, 2238001368u, 4066508878u, 1812370925u,  453092731u, 2181625025u, 4111451223u,
-  1706088902u,  314042704u, 2344532202u, 4240017532u, 1658658271u,  366619977u, 2362670323u, 4224994405u,
-  1303535960u,  984961486u, 2747007092u, 3569037538u, 1256170817u, 1037604311u, 2765210733u, 3554079995u,
-  1131014506u,  879679996u, 2909243462u, 3663771856u, 1141124467u,  855842277u, 2852801631u, 3708648649u,
-  1342533948u,  654459306u, 3188396048u, 3373015174u, 1466479909u,  544179635u, 3110523913u, 3462522015u,
-  1591671054u,  702138776u, 2966460450u, 3352799412u, 1504918807u,  783551873u, 3082640443u, 3233442989u,
-  3988292384u, 2596254646u,   62317068u, 1957810842u, 3939845945u, 2647816111u,   81470997u, 1943803523u,
-  3814918930u, 2489596804u,  225274430u, 2053790376u, 3826175755u, 2466906013u,  167816743u, 2097651377u,
-  4027552580u, 2265490386u,  503444072u, 1762050814u, 4150417245u, 2154129355u,  426522225u, 1852507879u,
-  4275313526u, 2312317920u,  282753626u, 1742555852u, 4189708143u, 2394877945u,  397917763u, 1622183637u,
-  3604390888u, 2714866558u,  953729732u, 1340076626u, 3518719985u, 2797360999u, 1068828381u, 1219638859u,
-  3624741850u, 2936675148u,  906185462u, 1090812512u, 3747672003u, 2825379669u,  829329135u, 1181335161u,
-  3412177804u, 3160834842u,  628085408u, 1382605366u, 3423369109u, 3138078467u,  570562233u, 1426400815u,
-  3317316542u, 2998733608u,  733239954u, 1555261956u, 3268935591u, 3050360625u,  752459403u, 1541320221u,
-  2607071920u, 3965973030u, 1969922972u,   40735498u, 2617837225u, 3943577151u, 1913087877u,   83908371u,
-  2512341634u, 3803740692u, 2075208622u,  213261112u, 2463272603u, 3855990285u, 2094854071u,  198958881u,
-  2262029012u, 4057260610u, 1759359992u,  534414190u, 2176718541u, 4139329115u, 1873836001u,  414664567u,
-  2282248934u, 4279200368u, 1711684554u,  285281116u, 2405801727u, 4167216745u, 1634467795u,  376229701u,
-  2685067896u, 3608007406u, 1308918612u,  956543938u, 2808555105u, 3495958263u, 1231636301u, 1047427035u,
-  2932959818u, 3654703836u, 1088359270u,  936918000u, 2847714899u, 3736837829u, 1202900863u,  817233897u,
-  3183342108u, 3401237130u, 1404277552u,  615818150u, 3134207493u, 3453421203u, 1423857449u,  601450431u,
-  3009837614u, 3294710456u, 1567103746u,  711928724u, 3020668471u, 3272380065u, 1510334235u,  755167117u
+/* lodepng_crc32_table[0] is the classic byte-wise table, table k gives the CRC contribution of a byte
+that is followed by k more bytes, used to process 8 bytes per step (slice-by-8). */
+static const unsigned lodepng_crc32_table[8][256] = {
+  {
+            0u, 1996959894u, 3993919788u, 2567524794u,  124634137u, 1886057615u, 3915621685u, 2657392035u,
+    249268274u, 2044508324u, 3772115230u, 2547177864u,  162941995u, 2125561021u, 3887607047u, 2428444049u,
+    498536548u, 1789927666u, 4089016648u, 2227061214u,  450548861u, 1843258603u, 4107580753u, 2211677639u,
+    325883990u, 1684777152u, 4251122042u, 2321926636u,  335633487u, 1661365465u, 4195302755u, 2366115317u,
+    997073096u, 1281953886u, 3579855332u, 2724688242u, 1006888145u, 1258607687u, 3524101629u, 2768942443u,
+    901097722u, 1119000684u, 3686517206u, 2898065728u,  853044451u, 1172266101u, 3705015759u, 2882616665u,
+    651767980u, 1373503546u, 3369554304u, 3218104598u,  565507253u, 1454621731u, 3485111705u, 3099436303u,
+    671266974u, 1594198024u, 3322730930u, 2970347812u,  795835527u, 1483230225u, 3244367275u, 3060149565u,
+   1994146192u,   31158534u, 2563907772u, 4023717930u, 1907459465u,  112637215u, 2680153253u, 3904427059u,
+   2013776290u,  251722036u, 2517215374u, 3775830040u, 2137656763u,  141376813u, 2439277719u, 3865271297u,
+   1802195444u,  476864866u, 2238001368u, 4066508878u, 1812370925u,  453092731u, 2181625025u, 4111451223u,
+   1706088902u,  314042704u, 2344532202u, 4240017532u, 1658658271u,  366619977u, 2362670323u, 4224994405u,
+   1303535960u,  984961486u, 2747007092u, 3569037538u, 1256170817u, 1037604311u, 2765210733u, 3554079995u,
+   1131014506u,  879679996u, 2909243462u, 3663771856u, 1141124467u,  855842277u, 2852801631u, 3708648649u,
+   1342533948u,  654459306u, 3188396048u, 3373015174u, 1466479909u,  544179635u, 3110523913u, 3462522015u,
+   1591671054u,  702138776u, 2966460450u, 3352799412u, 1504918807u,  783551873u, 3082640443u, 3233442989u,
+   3988292384u, 2596254646u,   62317068u, 1957810842u, 3939845945u, 2647816111u,   81470997u, 1943803523u,
+   3814918930u, 2489596804u,  225274430u, 2053790376u, 3826175755u, 2466906013u,  167816743u, 2097651377u,
+   4027552580u, 2265490386u,  503444072u, 1762050814u, 4150417245u, 2154129355u,  426522225u, 1852507879u,
+   4275313526u, 2312317920u,  282753626u, 1742555852u, 4189708143u, 2394877945u,  397917763u, 1622183637u,
+   3604390888u, 2714866558u,  953729732u, 1340076626u, 3518719985u, 2797360999u, 1068828381u, 1219638859u,
+   3624741850u, 2936675148u,  906185462u, 1090812512u, 3747672003u, 2825379669u,  829329135u, 1181335161u,
+   3412177804u, 3160834842u,  628085408u, 1382605366u, 3423369109u, 3138078467u,  570562233u, 1426400815u,
+   3317316542u, 2998733608u,  733239954u, 1555261956u, 3268935591u, 3050360625u,  752459403u, 1541320221u,
+   2607071920u, 3965973030u, 1969922972u,   40735498u, 2617837225u, 3943577151u, 1913087877u,   83908371u,
+   2512341634u, 3803740692u, 2075208622u,  213261112u, 2463272603u, 3855990285u, 2094854071u,  198958881u,
+   2262029012u, 4057260610u, 1759359992u,  534414190u, 2176718541u, 4139329115u, 1873836001u,  414664567u,
+   2282248934u, 4279200368u, 1711684554u,  285281116u, 2405801727u, 4167216745u, 1634467795u,  376229701u,
+   2685067896u, 3608007406u, 1308918612u,  956543938u, 2808555105u, 3495958263u, 1231636301u, 1047427035u,
+   2932959818u, 3654703836u, 1088359270u,  936918000u, 2847714899u, 3736837829u, 1202900863u,  817233897u,
+   3183342108u, 3401237130u, 1404277552u,  615818150u, 3134207493u, 3453421203u, 1423857449u,  601450431u,
+   3009837614u, 3294710456u, 1567103746u,  711928724u, 3020668471u, 3272380065u, 1510334235u,  755167117u
+  },
+  {
+            0u,  421212481u,  842424962u,  724390851u, 1684849924u, 2105013317u, 1448781702u, 1329698503u,
+   3369699848u, 3519200073u, 4210026634u, 3824474571u, 2897563404u, 3048111693u, 2659397006u, 2274893007u,
+   1254232657u, 1406739216u, 2029285587u, 1643069842u,  783210325u,  934667796u,  479770071u,   92505238u,
+   2182846553u, 2600511768u, 2955803355u, 2838940570u, 3866582365u, 4285295644u, 3561045983u, 3445231262u,
+   2508465314u, 2359236067u, 2813478432u, 3198777185u, 4058571174u, 3908292839u, 3286139684u, 3670389349u,
+   1566420650u, 1145479147u, 1869335592u, 1987116393u,  959540142u,  539646703u,  185010476u,  303839341u,
+   3745920755u, 3327985586u, 3983561841u, 4100678960u, 3140154359u, 2721170102u, 2300350837u, 2416418868u,
+    396344571u,  243568058u,  631889529u, 1018359608u, 1945336319u, 1793607870u, 1103436669u, 1490954812u,
+   4034481925u, 3915546180u, 3259968903u, 3679722694u, 2484439553u, 2366552896u, 2787371139u, 3208174018u,
+    950060301u,  565965900u,  177645455u,  328046286u, 1556873225u, 1171730760u, 1861902987u, 2011255754u,
+   3132841300u, 2745199637u, 2290958294u, 2442530455u, 3738671184u, 3352078609u, 3974232786u, 4126854035u,
+   1919080284u, 1803150877u, 1079293406u, 1498383519u,  370020952u,  253043481u,  607678682u, 1025720731u,
+   1711106983u, 2095471334u, 1472923941u, 1322268772u,   26324643u,  411738082u,  866634785u,  717028704u,
+   2904875439u, 3024081134u, 2668790573u, 2248782444u, 3376948395u, 3495106026u, 4219356713u, 3798300520u,
+    792689142u,  908347575u,  487136116u,   68299317u, 1263779058u, 1380486579u, 2036719216u, 1618931505u,
+   3890672638u, 4278043327u, 3587215740u, 3435896893u, 2206873338u, 2593195963u, 2981909624u, 2829542713u,
+    998479947u,  580430090u,  162921161u,  279890824u, 1609522511u, 1190423566u, 1842954189u, 1958874764u,
+   4082766403u, 3930137346u, 3245109441u, 3631694208u, 2536953671u, 2385372678u, 2768287173u, 3155920004u,
+   1900120602u, 1750776667u, 1131931800u, 1517083097u,  355290910u,  204897887u,  656092572u, 1040194781u,
+   3113746450u, 2692952403u, 2343461520u, 2461357009u, 3723805974u, 3304059991u, 4022511508u, 4141455061u,
+   2919742697u, 3072101800u, 2620513899u, 2234183466u, 3396041197u, 3547351212u, 4166851439u, 3779471918u,
+   1725839073u, 2143618976u, 1424512099u, 1307796770u,   45282277u,  464110244u,  813994343u,  698327078u,
+   3838160568u, 4259225593u, 3606301754u, 3488152955u, 2158586812u, 2578602749u, 2996767038u, 2877569151u,
+    740041904u,  889656817u,  506086962u,  120682355u, 1215357364u, 1366020341u, 2051441462u, 1667084919u,
+   3422213966u, 3538019855u, 4190942668u, 3772220557u, 2945847882u, 3062702859u, 2644537544u, 2226864521u,
+     52649286u,  439905287u,  823476164u,  672009861u, 1733269570u, 2119477507u, 1434057408u, 1281543041u,
+   2167981343u, 2552493150u, 3004082077u, 2853541596u, 3847487515u, 4233048410u, 3613549209u, 3464057816u,
+   1239502615u, 1358593622u, 2077699477u, 1657543892u,  764250643u,  882293586u,  532408465u,  111204816u,
+   1585378284u, 1197851309u, 1816695150u, 1968414767u,  974272232u,  587794345u,  136598634u,  289367339u,
+   2527558116u, 2411481253u, 2760973158u, 3179948583u, 4073438432u, 3956313505u, 3237863010u, 3655790371u,
+    347922877u,  229101820u,  646611775u, 1066513022u, 1892689081u, 1774917112u, 1122387515u, 1543337850u,
+   3697634229u, 3313392372u, 3998419255u, 4148705398u, 3087642289u, 2702352368u, 2319436851u, 2468674930u
+  },
+  {
+            0u,   29518391u,   59036782u,   38190681u,  118073564u,  114017003u,   76381362u,   89069189u,
+    236147128u,  265370511u,  228034006u,  206958561u,  152762724u,  148411219u,  178138378u,  190596925u,
+    472294256u,  501532999u,  530741022u,  509615401u,  456068012u,  451764635u,  413917122u,  426358261u,
+    305525448u,  334993663u,  296822438u,  275991697u,  356276756u,  352202787u,  381193850u,  393929805u,
+    944588512u,  965684439u, 1003065998u,  973863097u, 1061482044u, 1049003019u, 1019230802u, 1023561829u,
+    912136024u,  933002607u,  903529270u,  874031361u,  827834244u,  815125939u,  852716522u,  856752605u,
+    611050896u,  631869351u,  669987326u,  640506825u,  593644876u,  580921211u,  551983394u,  556069653u,
+    712553512u,  733666847u,  704405574u,  675154545u,  762387700u,  749958851u,  787859610u,  792175277u,
+   1889177024u, 1901651959u, 1931368878u, 1927033753u, 2006131996u, 1985040171u, 1947726194u, 1976933189u,
+   2122964088u, 2135668303u, 2098006038u, 2093965857u, 2038461604u, 2017599123u, 2047123658u, 2076625661u,
+   1824272048u, 1836991623u, 1866005214u, 1861914857u, 1807058540u, 1786244187u, 1748062722u, 1777547317u,
+   1655668488u, 1668093247u, 1630251878u, 1625932113u, 1705433044u, 1684323811u, 1713505210u, 1742760333u,
+   1222101792u, 1226154263u, 1263738702u, 1251046777u, 1339974652u, 1310460363u, 1281013650u, 1301863845u,
+   1187289752u, 1191637167u, 1161842422u, 1149379777u, 1103966788u, 1074747507u, 1112139306u, 1133218845u,
+   1425107024u, 1429406311u, 1467333694u, 1454888457u, 1408811148u, 1379576507u, 1350309090u, 1371438805u,
+   1524775400u, 1528845279u, 1499917702u, 1487177649u, 1575719220u, 1546255107u, 1584350554u, 1605185389u,
+   3778354048u, 3774312887u, 3803303918u, 3816007129u, 3862737756u, 3892238699u, 3854067506u, 3833203973u,
+   4012263992u, 4007927823u, 3970080342u, 3982554209u, 3895452388u, 3924658387u, 3953866378u, 3932773565u,
+   4245928176u, 4241609415u, 4271336606u, 4283762345u, 4196012076u, 4225268251u, 4187931714u, 4166823541u,
+   4076923208u, 4072833919u, 4035198246u, 4047918865u, 4094247316u, 4123732899u, 4153251322u, 4132437965u,
+   3648544096u, 3636082519u, 3673983246u, 3678331705u, 3732010428u, 3753090955u, 3723829714u, 3694611429u,
+   3614117080u, 3601426159u, 3572488374u, 3576541825u, 3496125444u, 3516976691u, 3555094634u, 3525581405u,
+   3311336976u, 3298595879u, 3336186494u, 3340255305u, 3260503756u, 3281337595u, 3251864226u, 3222399125u,
+   3410866088u, 3398419871u, 3368647622u, 3372945905u, 3427010420u, 3448139075u, 3485520666u, 3456284973u,
+   2444203584u, 2423127159u, 2452308526u, 2481530905u, 2527477404u, 2539934891u, 2502093554u, 2497740997u,
+   2679949304u, 2659102159u, 2620920726u, 2650438049u, 2562027300u, 2574714131u, 2603727690u, 2599670141u,
+   2374579504u, 2353749767u, 2383274334u, 2412743529u, 2323684844u, 2336421851u, 2298759554u, 2294686645u,
+   2207933576u, 2186809023u, 2149495014u, 2178734801u, 2224278612u, 2236720739u, 2266437690u, 2262135309u,
+   2850214048u, 2820717207u, 2858812622u, 2879680249u, 2934667388u, 2938704459u, 2909776914u, 2897069605u,
+   2817622296u, 2788420399u, 2759153014u, 2780249921u, 2700618180u, 2704950259u, 2742877610u, 2730399645u,
+   3049550800u, 3020298727u, 3057690558u, 3078802825u, 2999835404u, 3004150075u, 2974355298u, 2961925461u,
+   3151438440u, 3121956959u, 3092510214u, 3113327665u, 3168701108u, 3172786307u, 3210370778u, 3197646061u
+  },
+  {
+            0u, 3099354981u, 2852767883u,  313896942u, 2405603159u,  937357362u,  627793884u, 2648127673u,
+   3316918511u, 2097696650u, 1874714724u, 3607201537u, 1255587768u, 4067088605u, 3772741427u, 1482887254u,
+   1343838111u, 3903140090u, 4195393300u, 1118632049u, 3749429448u, 1741137837u, 1970407491u, 3452858150u,
+   2511175536u,  756094997u, 1067759611u, 2266550430u,  449832999u, 2725482306u, 2965774508u,  142231497u,
+   2687676222u,  412010587u,  171665333u, 2995192016u,  793786473u, 2548850444u, 2237264098u, 1038456711u,
+   1703315409u, 3711623348u, 3482275674u, 1999841343u, 3940814982u, 1381529571u, 1089329165u, 4166106984u,
+   4029413537u, 1217896388u, 1512189994u, 3802027855u, 2135519222u, 3354724499u, 3577784189u, 1845280792u,
+    899665998u, 2367928107u, 2677414085u,  657096608u, 3137160985u,   37822588u,  284462994u, 2823350519u,
+   2601801789u,  598228824u,  824021174u, 2309093331u,  343330666u, 2898962447u, 3195996129u,  113467524u,
+   1587572946u, 3860600759u, 4104763481u, 1276501820u, 3519211397u, 1769898208u, 2076913422u, 3279374443u,
+   3406630818u, 1941006535u, 1627703081u, 3652755532u, 1148164341u, 4241751952u, 3999682686u, 1457141531u,
+    247015245u, 3053797416u, 2763059142u,  470583459u, 2178658330u,  963106687u,  735213713u, 2473467892u,
+    992409347u, 2207944806u, 2435792776u,  697522413u, 3024379988u,  217581361u,  508405983u, 2800865210u,
+   4271038444u, 1177467017u, 1419450215u, 3962007554u, 1911572667u, 3377213406u, 3690561584u, 1665525589u,
+   1799331996u, 3548628985u, 3241568279u, 2039091058u, 3831314379u, 1558270126u, 1314193216u, 4142438437u,
+   2928380019u,  372764438u,   75645176u, 3158189981u,  568925988u, 2572515393u, 2346768303u,  861712586u,
+   3982079547u, 1441124702u, 1196457648u, 4293663189u, 1648042348u, 3666298377u, 3358779879u, 1888390786u,
+    686661332u, 2421291441u, 2196002399u,  978858298u, 2811169155u,  523464422u,  226935048u, 3040519789u,
+   3175145892u,  100435649u,  390670639u, 2952089162u,  841119475u, 2325614998u, 2553003640u,  546822429u,
+   2029308235u, 3225988654u, 3539796416u, 1782671013u, 4153826844u, 1328167289u, 1570739863u, 3844338162u,
+   1298864389u, 4124540512u, 3882013070u, 1608431339u, 3255406162u, 2058742071u, 1744848601u, 3501990332u,
+   2296328682u,  811816591u,  584513889u, 2590678532u,  129869501u, 3204563416u, 2914283062u,  352848211u,
+    494030490u, 2781751807u, 3078325777u,  264757620u, 2450577869u,  715964072u,  941166918u, 2158327331u,
+   3636881013u, 1618608400u, 1926213374u, 3396585883u, 1470427426u, 4011365959u, 4255988137u, 1158766284u,
+   1984818694u, 3471935843u, 3695453837u, 1693991400u, 4180638033u, 1100160564u, 1395044826u, 3952793279u,
+   3019491049u,  189112716u,  435162722u, 2706139399u, 1016811966u, 2217162459u, 2526189877u,  774831696u,
+    643086745u, 2666061564u, 2354934034u,  887166583u, 2838900430u,  294275499u,   54519365u, 3145957664u,
+   3823145334u, 1532818963u, 1240029693u, 4048895640u, 1820460577u, 3560857924u, 3331051178u, 2117577167u,
+   3598663992u, 1858283101u, 2088143283u, 3301633750u, 1495127663u, 3785470218u, 4078182116u, 1269332353u,
+    332098007u, 2876706482u, 3116540252u,   25085497u, 2628386432u,  605395429u,  916469259u, 2384220526u,
+   2254837415u, 1054503362u,  745528876u, 2496903497u,  151290352u, 2981684885u, 2735556987u,  464596510u,
+   1137851976u, 4218313005u, 3923506883u, 1365741990u, 3434129695u, 1946996346u, 1723425172u, 3724871409u
+  },
+  {
+            0u, 1029712304u, 2059424608u, 1201699536u, 4118849216u, 3370159984u, 2403399072u, 2988497936u,
+    812665793u,  219177585u, 1253054625u, 2010132753u, 3320900865u, 4170237105u, 3207642721u, 2186319825u,
+   1625331586u, 1568718386u,  438355170u,  658566482u, 2506109250u, 2818578674u, 4020265506u, 3535817618u,
+   1351670851u, 1844508147u,  709922595u,  389064339u, 2769320579u, 2557498163u, 3754961379u, 3803185235u,
+   3250663172u, 4238411444u, 3137436772u, 2254525908u,  876710340u,  153198708u, 1317132964u, 1944187668u,
+   4054934725u, 3436268917u, 2339452837u, 3054575125u,   70369797u,  961670069u, 2129760613u, 1133623509u,
+   2703341702u, 2621542710u, 3689016294u, 3867263574u, 1419845190u, 1774270454u,  778128678u,  318858390u,
+   2438067015u, 2888948471u, 3952189479u, 3606153623u, 1691440519u, 1504803895u,  504432359u,  594620247u,
+   1492342857u, 1704161785u,  573770537u,  525542041u, 2910060169u, 2417219385u, 3618876905u, 3939730521u,
+   1753420680u, 1440954936u,  306397416u,  790849880u, 2634265928u, 2690882808u, 3888375336u, 3668168600u,
+    940822475u,   91481723u, 1121164459u, 2142483739u, 3448989963u, 4042473659u, 3075684971u, 2318603227u,
+    140739594u,  889433530u, 1923340138u, 1338244826u, 4259521226u, 3229813626u, 2267247018u, 3124975642u,
+   2570221389u, 2756861693u, 3824297005u, 3734113693u, 1823658381u, 1372780605u,  376603373u,  722643805u,
+   2839690380u, 2485261628u, 3548540908u, 4007806556u, 1556257356u, 1638052860u,  637716780u,  459464860u,
+   4191346895u, 3300051327u, 2199040943u, 3195181599u,  206718479u,  825388991u, 1989285231u, 1274166495u,
+   3382881038u, 4106388158u, 3009607790u, 2382549470u, 1008864718u,   21111934u, 1189240494u, 2072147742u,
+   2984685714u, 2357631266u, 3408323570u, 4131834434u, 1147541074u, 2030452706u, 1051084082u,   63335554u,
+   2174155603u, 3170292451u, 4216760371u, 3325460867u, 1947622803u, 1232499747u,  248909555u,  867575619u,
+   3506841360u, 3966111392u, 2881909872u, 2527485376u,  612794832u,  434546784u, 1581699760u, 1663499008u,
+   3782634705u, 3692447073u, 2612412337u, 2799048193u,  351717905u,  697754529u, 1849071985u, 1398190273u,
+   1881644950u, 1296545318u,  182963446u,  931652934u, 2242328918u, 3100053734u, 4284967478u, 3255255942u,
+   1079497815u, 2100821479u,  983009079u,  133672583u, 3050795671u, 2293717799u, 3474399735u, 4067887175u,
+    281479188u,  765927844u, 1778867060u, 1466397380u, 3846680276u, 3626469220u, 2676489652u, 2733102084u,
+    548881365u,  500656741u, 1517752501u, 1729575173u, 3577210133u, 3898068133u, 2952246901u, 2459410373u,
+   3910527195u, 3564487019u, 2480257979u, 2931134987u,  479546907u,  569730987u, 1716854139u, 1530213579u,
+   3647316762u, 3825568426u, 2745561210u, 2663766474u,  753206746u,  293940330u, 1445287610u, 1799716618u,
+   2314567513u, 3029685993u, 4080348217u, 3461678473u, 2088098201u, 1091956777u,  112560889u, 1003856713u,
+   3112514712u, 2229607720u, 3276105720u, 4263857736u, 1275433560u, 1902492648u,  918929720u,  195422344u,
+    685033439u,  364179055u, 1377080511u, 1869921551u, 3713294623u, 3761522863u, 2811507327u, 2599689167u,
+    413436958u,  633644462u, 1650777982u, 1594160846u, 3978570462u, 3494118254u, 2548332990u, 2860797966u,
+   1211387997u, 1968470509u,  854852413u,  261368461u, 3182753437u, 2161434413u, 3346310653u, 4195650637u,
+   2017729436u, 1160000044u,   42223868u, 1071931724u, 2378480988u, 2963576044u, 4144295484u, 3395602316u
+  },
+  {
+            0u, 3411858341u, 1304994059u, 2257875630u, 2609988118u, 1355649459u, 3596215069u,  486879416u,
+   3964895853u,  655315400u, 2711298918u, 1791488195u, 2009251963u, 3164476382u,  973758832u, 4048990933u,
+     64357019u, 3364540734u, 1310630800u, 2235723829u, 2554806413u, 1394316072u, 3582976390u,  517157411u,
+   4018503926u,  618222419u, 2722963965u, 1762783832u, 1947517664u, 3209171269u,  970744811u, 4068520014u,
+    128714038u, 3438335635u, 1248109629u, 2167961496u, 2621261600u, 1466012805u, 3522553387u,  447296910u,
+   3959392091u,  547575038u, 2788632144u, 1835791861u, 1886307661u, 3140622056u, 1034314822u, 4143626211u,
+     75106221u, 3475428360u, 1236444838u, 2196665603u, 2682996155u, 1421317662u, 3525567664u,  427767573u,
+   3895035328u,  594892389u, 2782995659u, 1857943406u, 1941489622u, 3101955187u, 1047553757u, 4113347960u,
+    257428076u, 3288652233u, 1116777319u, 2311878850u, 2496219258u, 1603640287u, 3640781169u,  308099796u,
+   3809183745u,  676813732u, 2932025610u, 1704983215u, 2023410199u, 3016104370u,  894593820u, 4262377657u,
+    210634999u, 3352484690u, 1095150076u, 2316991065u, 2535410401u, 1547934020u, 3671583722u,  294336591u,
+   3772615322u,  729897279u, 2903845777u, 1716123700u, 2068629644u, 2953845545u,  914647431u, 4258839074u,
+    150212442u, 3282623743u, 1161604689u, 2388688372u, 2472889676u, 1480171241u, 3735940167u,  368132066u,
+   3836185911u,  805002898u, 2842635324u, 1647574937u, 2134298401u, 3026852996u,  855535146u, 4188192143u,
+    186781121u, 3229539940u, 1189784778u, 2377547631u, 2427670487u, 1542429810u, 3715886812u,  371670393u,
+   3882979244u,  741170185u, 2864262823u, 1642462466u, 2095107514u, 3082559007u,  824732849u, 4201955092u,
+    514856152u, 3589064573u, 1400419795u, 2552522358u, 2233554638u, 1316849003u, 3370776517u,   62202976u,
+   4075001525u,  968836368u, 3207280574u, 1954014235u, 1769133219u, 2720925446u,  616199592u, 4024870413u,
+    493229635u, 3594175974u, 1353627464u, 2616354029u, 2264355925u, 1303087088u, 3409966430u,    6498043u,
+   4046820398u,  979978123u, 3170710821u, 2007099008u, 1789187640u, 2717386141u,  661419827u, 3962610838u,
+    421269998u, 3527459403u, 1423225061u, 2676515648u, 2190300152u, 1238466653u, 3477467891u,   68755798u,
+   4115633027u, 1041448998u, 3095868040u, 1943789869u, 1860096405u, 2776760880u,  588673182u, 3897205563u,
+    449450869u, 3516317904u, 1459794558u, 2623431131u, 2170245475u, 1242006214u, 3432247400u,  131015629u,
+   4137259288u, 1036337853u, 3142660115u, 1879958454u, 1829294862u, 2790523051u,  549483013u, 3952910752u,
+    300424884u, 3669282065u, 1545650111u, 2541513754u, 2323209378u, 1092980487u, 3350330793u,  216870412u,
+   4256931033u,  921128828u, 2960342482u, 2066738807u, 1714085583u, 2910195050u,  736264132u, 3770592353u,
+    306060335u, 3647131530u, 1610005796u, 2494197377u, 2309971513u, 1123257756u, 3295149874u,  255536279u,
+   4268596802u,  892423655u, 3013951305u, 2029645036u, 1711070292u, 2929725425u,  674528607u, 3815288570u,
+    373562242u, 3709388839u, 1535949449u, 2429577516u, 2379569556u, 1183418929u, 3223189663u,  188820282u,
+   4195850735u,  827017802u, 3084859620u, 2089020225u, 1636228089u, 2866415708u,  743340786u, 3876759895u,
+    361896217u, 3738094268u, 1482340370u, 2466671543u, 2382584591u, 1163888810u, 3284924932u,  144124321u,
+   4190215028u,  849168593u, 3020503679u, 2136336858u, 1649465698u, 2836138695u,  798521449u, 3838094284u
+  },
+  {
+            0u, 2792819636u, 2543784233u,  837294749u, 4098827283u, 1379413927u, 1674589498u, 3316072078u,
+    871321191u, 2509784531u, 2758827854u,   34034938u, 3349178996u, 1641505216u, 1346337629u, 4131942633u,
+   1742642382u, 3249117050u, 4030828007u, 1446413907u, 2475800797u,  904311657u,   68069876u, 2725880384u,
+   1412551337u, 4064729373u, 3283010432u, 1708771380u, 2692675258u,  101317902u,  937551763u, 2442587175u,
+   3485284764u, 1774858792u, 1478633653u, 4266992385u, 1005723023u, 2642744891u, 2892827814u,  169477906u,
+   4233263099u, 1512406095u, 1808623314u, 3451546982u,  136139752u, 2926205020u, 2676114113u,  972376437u,
+   2825102674u,  236236518u, 1073525883u, 2576072655u, 1546420545u, 4200303349u, 3417542760u, 1841601500u,
+   2609703733u, 1039917185u,  202635804u, 2858742184u, 1875103526u, 3384067218u, 4166835727u, 1579931067u,
+   1141601657u, 3799809741u, 3549717584u, 1977839588u, 2957267306u,  372464350u,  668680259u, 2175552503u,
+   2011446046u, 3516084394u, 3766168119u, 1175200131u, 2209029901u,  635180217u,  338955812u, 2990736784u,
+    601221559u, 2242044419u, 3024812190u,  306049834u, 3617246628u, 1911408144u, 1074125965u, 3866285881u,
+    272279504u, 3058543716u, 2275784441u,  567459149u, 3832906691u, 1107462263u, 1944752874u, 3583875422u,
+   2343980261u,  767641425u,  472473036u, 3126744696u, 2147051766u, 3649987394u, 3899029983u, 1309766251u,
+   3092841090u,  506333494u,  801510315u, 2310084639u, 1276520081u, 3932237093u, 3683203000u, 2113813516u,
+   3966292011u, 1243601823u, 2079834370u, 3716205238u,  405271608u, 3192979340u, 2411259153u,  701492901u,
+   3750207052u, 2045810168u, 1209569125u, 4000285905u,  734575199u, 2378150379u, 3159862134u,  438345922u,
+   2283203314u,  778166598u,  529136603u, 3120492655u, 2086260449u, 3660498261u, 3955679176u, 1303499900u,
+   3153699989u,  495890209u,  744928700u, 2316418568u, 1337360518u, 3921775410u, 3626602927u, 2120129051u,
+   4022892092u, 1237286280u, 2018993941u, 3726666913u,  461853231u, 3186645403u, 2350400262u,  711936178u,
+   3693557851u, 2052076527u, 1270360434u, 3989775046u,  677911624u, 2384402428u, 3220639073u,  427820757u,
+   1202443118u, 3789347034u, 3493118535u, 1984154099u, 3018127229u,  362020041u,  612099668u, 2181885408u,
+   1950653705u, 3526596285u, 3822816288u, 1168934804u, 2148251930u,  645706414u,  395618355u, 2984485767u,
+    544559008u, 2248295444u, 3085590153u,  295523645u, 3560598451u, 1917673479u, 1134918298u, 3855773998u,
+    328860103u, 3052210803u, 2214924526u,  577903450u, 3889505748u, 1101147744u, 1883911421u, 3594338121u,
+   3424493451u, 1785369663u, 1535282850u, 4260726038u,  944946072u, 2653270060u, 2949491377u,  163225861u,
+   4294103532u, 1501944408u, 1752023237u, 3457862513u,  196998655u, 2915761739u, 2619532502u,  978710370u,
+   2881684293u,  229902577u, 1012666988u, 2586515928u, 1603020630u, 4193987810u, 3356702335u, 1852063179u,
+   2553040162u, 1046169238u,  263412747u, 2848217023u, 1818454321u, 3390333573u, 4227627032u, 1569420204u,
+     60859927u, 2782375331u, 2487203646u,  843627658u, 4159668740u, 1368951216u, 1617990445u, 3322386585u,
+    810543216u, 2520310724u, 2815490393u,   27783917u, 3288386659u, 1652017111u, 1402985802u, 4125677310u,
+   1685994201u, 3255382381u, 4091620336u, 1435902020u, 2419138250u,  910562686u,  128847843u, 2715354199u,
+   1469150398u, 4058414858u, 3222168983u, 1719234083u, 2749255853u,   94984985u,  876691844u, 2453031472u
+  },
+  {
+            0u, 3433693342u, 1109723005u, 2391738339u, 2219446010u, 1222643300u, 3329165703u,  180685081u,
+   3555007413u,  525277995u, 2445286600u, 1567235158u, 1471092047u, 2600801745u,  361370162u, 3642757804u,
+   2092642603u, 2953916853u, 1050555990u, 4063508168u, 4176560081u,  878395215u, 3134470316u, 1987983410u,
+   2942184094u, 1676945920u, 3984272867u,  567356797u,  722740324u, 3887998202u, 1764827929u, 2778407815u,
+   4185285206u,  903635656u, 3142804779u, 2012833205u, 2101111980u, 2979425330u, 1058630609u, 4088621903u,
+    714308067u, 3862526333u, 1756790430u, 2753330688u, 2933487385u, 1651734407u, 3975966820u,  542535930u,
+   2244825981u, 1231508451u, 3353891840u,  188896414u,   25648519u, 3442302233u, 1134713594u, 2399689316u,
+   1445480648u, 2592229462u,  336416693u, 3634843435u, 3529655858u,  516441772u, 2420588879u, 1559052753u,
+    698204909u, 3845636723u, 1807271312u, 2803025166u, 2916600855u, 1635634313u, 4025666410u,  593021940u,
+   4202223960u,  919787974u, 3093159461u, 1962401467u, 2117261218u, 2996361020u, 1008193759u, 4038971457u,
+   1428616134u, 2576151384u,  386135227u, 3685348389u, 3513580860u,  499580322u, 2471098945u, 1608776415u,
+   2260985971u, 1248454893u, 3303468814u,  139259792u,   42591881u, 3458459159u, 1085071860u, 2349261162u,
+   3505103035u,  474062885u, 2463016902u, 1583654744u, 1419882049u, 2550902495u,  377792828u, 3660491170u,
+     51297038u, 3483679632u, 1093385331u, 2374089965u, 2269427188u, 1273935210u, 3311514249u,  164344343u,
+   2890961296u, 1627033870u, 4000683757u,  585078387u,  672833386u, 3836780532u, 1782552599u, 2794821769u,
+   2142603813u, 3005188795u, 1032883544u, 4047146438u, 4227826911u,  928351297u, 3118105506u, 1970307900u,
+   1396409818u, 2677114180u,  287212199u, 3719594553u, 3614542624u,  467372990u, 2505346141u, 1509854403u,
+   2162073199u, 1282711281u, 3271268626u,  240228748u,   76845205u, 3359543307u, 1186043880u, 2317064054u,
+    796964081u, 3811226735u, 1839575948u, 2702160658u, 2882189835u, 1734392469u, 3924802934u,  625327592u,
+   4234522436u,  818917338u, 3191908409u, 1927981223u, 2016387518u, 3028656416u,  973776579u, 4137723485u,
+   2857232268u, 1726474002u, 3899187441u,  616751215u,  772270454u, 3803048424u, 1814228491u, 2693328533u,
+   2041117753u, 3036871847u,  999160644u, 4146592730u, 4259508931u,  826864221u, 3217552830u, 1936586016u,
+   3606501031u,  442291769u, 2496909786u, 1484378436u, 1388107869u, 2652297411u,  278519584u, 3694387134u,
+     85183762u, 3384397196u, 1194773103u, 2342308593u, 2170143720u, 1307820918u, 3279733909u,  265733131u,
+   2057717559u, 3054258089u,  948125770u, 4096344276u, 4276898253u,  843467091u, 3167309488u, 1885556270u,
+   2839764098u, 1709792284u, 3949353983u,  667704161u,  755585656u, 3785577190u, 1865176325u, 2743489947u,
+    102594076u, 3401021058u, 1144549729u, 2291298815u, 2186770662u, 1325234296u, 3228729243u,  215514885u,
+   3589828009u,  424832311u, 2547870420u, 1534552650u, 1370645331u, 2635621325u,  328688686u, 3745342640u,
+   2211456353u, 1333405183u, 3254067740u,  224338562u,  127544219u, 3408931589u, 1170156774u, 2299866232u,
+   1345666772u, 2627681866u,  303053225u, 3736746295u, 3565105198u,  416624816u, 2522494803u, 1525692365u,
+   4285207626u,  868291796u, 3176010551u, 1910772649u, 2065767088u, 3079346734u,  956571085u, 4121828691u,
+    747507711u, 3760459617u, 1856702594u, 2717976604u, 2831417605u, 1684930971u, 3940615800u,  642451174u
+  }
 };
 
 /*Return the CRC of the bytes buf[0..len-1].*/
 unsigned lodepng_crc32(const unsigned char* data, size_t length) {
   unsigned r = 0xffffffffu;
-  size_t i;
-  for(i = 0; i < length; ++i) {
-    r = lodepng_crc32_table[(r ^ data[i]) & 0xff] ^ (r >> 8);
+  /*8 bytes at a time: the 4 bytes overlapping with r and 4 more, each through its own table*/
+  while(length >= 8) {
+    r = lodepng_crc32_table[7][(r ^ data[0]) & 0xff] ^
+        lodepng_crc32_table[6][((r >> 8) ^ data[1]) & 0xff] ^
+        lodepng_crc32_table[5][((r >> 16) ^ data[2]) & 0xff] ^
+        lodepng_crc32_table[4][((r >> 24) ^ data[3]) & 0xff] ^
+        lodepng_crc32_table[3][data[4]] ^
+        lodepng_crc32_table[2][data[5]] ^
+        lodepng_crc32_table[1][data[6]] ^
+        lodepng_crc32_table[0][data[7]];
+    data += 8;
+    length -= 8;
+  }
+  while(length > 0) {
+    r = lodepng_crc32_table[0][(r ^ *data) & 0xff] ^ (r >> 8);
+    ++data;
+    --length;
   }
   return r ^ 0xffffffffu;
 }
@@ -2996,6 +3653,113 @@ static void getPixelColorRGBA8(unsigned char* r, unsigned char* g,
   }
 }
 
+#ifdef LODEPNG_COMPILE_FAST_CONVERT
+/*Takes the high byte of every 16-bit big endian value, numvalues is the amount of
+8-bit output values (channels times pixels).*/
+static void narrow16To8(unsigned char* out, const unsigned char* in, size_t numvalues) {
+  size_t i = 0;
+#ifdef LODEPNG_SSE2
+  const __m128i lowbytes = _mm_set1_epi16(0x00ff);
+  for(; i + 16 <= numvalues; i += 16) {
+    __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i * 2)), lowbytes);
+    __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i * 2 + 16)), lowbytes);
+    _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(a, b));
+  }
+#endif /*LODEPNG_SSE2*/
+  for(; i != numvalues; ++i) out[i] = in[i * 2];
+}
+
+/*Extracts the first channel (gray or red, high byte if 16-bit) of every pixel into an 8-bit
+single channel buffer, which is what rgba8ToPixel outputs for 8-bit LCT_GREY. mode must
+not be palette and must have a bitdepth of at least 8.*/
+static void getPixelChannels8(unsigned char* out, size_t numpixels,
+                              const unsigned char* in, const LodePNGColorMode* mode) {
+  size_t stride = lodepng_get_bpp(mode) / 8;
+  size_t i = 0;
+#ifdef LODEPNG_SSE2
+  if(stride == 4) {
+    const __m128i lowbytes = _mm_set1_epi32(0x000000ff);
+    for(; i + 16 <= numpixels; i += 16) {
+      __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i * 4 +  0)), lowbytes);
+      __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i * 4 + 16)), lowbytes);
+      __m128i c = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i * 4 + 32)), lowbytes);
+      __m128i d = _mm_and_si128(_mm_loadu_si128((const __m128i*)(in + i * 4 + 48)), lowbytes);
+      _mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+    }
+  } else if(stride == 2) {
+    narrow16To8(out, in, numpixels);
+    return;
+  }
+#endif /*LODEPNG_SSE2*/
+  for(; i != numpixels; ++i) out[i] = in[i * stride];
+}
+
+/*Fast paths of getPixelColorsRGBA8 for RGBA output: 8-bit gray, gray+alpha, RGB and palette
+and 16-bit RGBA input, the types that loaded textures and heightmaps come in. Returns how
+many of the first pixels were converted, the caller does the remaining ones.*/
+static size_t getPixelColorsRGBA8Fast(unsigned char* buffer, size_t numpixels,
+                                      const unsigned char* in, const LodePNGColorMode* mode) {
+  size_t i = 0;
+  if(mode->colortype == LCT_PALETTE && mode->bitdepth == 8) {
+    /*palette with the out of range indices already made black, so the loop has no branches*/
+    unsigned char lut[256 * 4];
+    size_t j;
+    for(j = 0; j != 256; ++j) {
+      if(j < mode->palettesize) {
+        lut[j * 4 + 0] = mode->palette[j * 4 + 0];
+        lut[j * 4 + 1] = mode->palette[j * 4 + 1];
+        lut[j * 4 + 2] = mode->palette[j * 4 + 2];
+        lut[j * 4 + 3] = mode->palette[j * 4 + 3];
+      } else {
+        lut[j * 4 + 0] = lut[j * 4 + 1] = lut[j * 4 + 2] = 0;
+        lut[j * 4 + 3] = 255;
+      }
+    }
+    for(; i != numpixels; ++i) memcpy(buffer + i * 4, lut + in[i] * 4, 4);
+    return i;
+  }
+  if(mode->colortype == LCT_RGBA && mode->bitdepth == 16) {
+    narrow16To8(buffer, in, numpixels * 4);
+    return numpixels;
+  }
+#ifdef LODEPNG_SSE2
+  if(mode->colortype == LCT_GREY && mode->bitdepth == 8 && !mode->key_defined) {
+    const __m128i opaque = _mm_set1_epi8((char)255);
+    for(; i + 16 <= numpixels; i += 16) {
+      __m128i g = _mm_loadu_si128((const __m128i*)(in + i));
+      __m128i gg_lo = _mm_unpacklo_epi8(g, g), gg_hi = _mm_unpackhi_epi8(g, g);
+      __m128i ga_lo = _mm_unpacklo_epi8(g, opaque), ga_hi = _mm_unpackhi_epi8(g, opaque);
+      _mm_storeu_si128((__m128i*)(buffer + i * 4 +  0), _mm_unpacklo_epi16(gg_lo, ga_lo));
+      _mm_storeu_si128((__m128i*)(buffer + i * 4 + 16), _mm_unpackhi_epi16(gg_lo, ga_lo));
+      _mm_storeu_si128((__m128i*)(buffer + i * 4 + 32), _mm_unpacklo_epi16(gg_hi, ga_hi));
+      _mm_storeu_si128((__m128i*)(buffer + i * 4 + 48), _mm_unpackhi_epi16(gg_hi, ga_hi));
+    }
+  } else if(mode->colortype == LCT_GREY_ALPHA && mode->bitdepth == 8) {
+    const __m128i lowbytes = _mm_set1_epi16(0x00ff);
+    for(; i + 8 <= numpixels; i += 8) {
+      __m128i ga = _mm_loadu_si128((const __m128i*)(in + i * 2));
+      __m128i gg = _mm_or_si128(_mm_and_si128(ga, lowbytes), _mm_slli_epi16(ga, 8));
+      _mm_storeu_si128((__m128i*)(buffer + i * 4 +  0), _mm_unpacklo_epi16(gg, ga));
+      _mm_storeu_si128((__m128i*)(buffer + i * 4 + 16), _mm_unpackhi_epi16(gg, ga));
+    }
+  } else if(mode->colortype == LCT_RGB && mode->bitdepth == 8 && !mode->key_defined) {
+    /*4 pixels per step: shift each one to the start of a lane, the 4th byte gets the alpha.
+    The 16-byte load reads 4 bytes past the 4 pixels, hence the i + 6 bound.*/
+    const __m128i opaque = _mm_set1_epi32((int)0xff000000u);
+    const __m128i rgbmask = _mm_set1_epi32(0x00ffffff);
+    for(; i + 6 <= numpixels; i += 4) {
+      __m128i v = _mm_loadu_si128((const __m128i*)(in + i * 3));
+      __m128i p01 = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+      __m128i p23 = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+      __m128i rgba = _mm_or_si128(_mm_and_si128(_mm_unpacklo_epi64(p01, p23), rgbmask), opaque);
+      _mm_storeu_si128((__m128i*)(buffer + i * 4), rgba);
+    }
+  }
+#endif /*LODEPNG_SSE2*/
+  return i;
+}
+#endif /*LODEPNG_COMPILE_FAST_CONVERT*/
+
 /*Similar to getPixelColorRGBA8, but with all the for loops inside of the color
 mode test cases, optimized to convert the colors much faster, when converting
 to RGBA or RGB with 8 bit per cannel. buffer must be RGBA or RGB output with
@@ -3005,22 +3769,28 @@ static void getPixelColorsRGBA8(unsigned char* buffer, size_t numpixels,
                                 unsigned has_alpha, const unsigned char* in,
                                 const LodePNGColorMode* mode) {
   unsigned num_channels = has_alpha ? 4 : 3;
-  size_t i;
+  size_t i = 0;
+#ifdef LODEPNG_COMPILE_FAST_CONVERT
+  if(has_alpha) {
+    i = getPixelColorsRGBA8Fast(buffer, numpixels, in, mode);
+    buffer += i * num_channels;
+  }
+#endif /*LODEPNG_COMPILE_FAST_CONVERT*/
   if(mode->colortype == LCT_GREY) {
     if(mode->bitdepth == 8) {
-      for(i = 0; i != numpixels; ++i, buffer += num_channels) {
+      for(; i != numpixels; ++i, buffer += num_channels) {
         buffer[0] = buffer[1] = buffer[2] = in[i];
         if(has_alpha) buffer[3] = mode->key_defined && in[i] == mode->key_r ? 0 : 255;
       }
     } else if(mode->bitdepth == 16) {
-      for(i = 0; i != numpixels; ++i, buffer += num_channels) {
+      for(; i != numpixels; ++i, buffer += num_channels) {
         buffer[0] = buffer[1] = buffer[2] = in[i * 2];
         if(has_alpha) buffer[3] = mode->key_defined && 256U * in[i * 2 + 0] + in[i * 2 + 1] == mode->key_r ? 0 : 255;
       }
     } else {
       unsigned highest = ((1U << mode->bitdepth) - 1U); /*highest possible value for this bit depth*/
       size_t j = 0;
-      for(i = 0; i != numpixels; ++i, buffer += num_channels) {
+      for(; i != numpixels; ++i, buffer += num_channels) {
         unsigned value = readBitsFromReversedStream(&j, in, mode->bitdepth);
         buffer[0] = buffer[1] = buffer[2] = (value * 255) / highest;
         if(has_alpha) buffer[3] = mode->key_defined && value == mode->key_r ? 0 : 255;
@@ -3028,7 +3798,7 @@ static void getPixelColorsRGBA8(unsigned char* buffer, size_t numpixels,
     }
   } else if(mode->colortype == LCT_RGB) {
     if(mode->bitdepth == 8) {
-      for(i = 0; i != numpixels; ++i, buffer += num_channels) {
+      for(; i != numpixels; ++i, buffer += num_channels) {
         buffer[0] = in[i * 3 + 0];
         buffer[1] = in[i * 3 + 1];
         buffer[2] = in[i * 3 + 2];
@@ -3036,7 +3806,7 @@ static void getPixelColorsRGBA8(unsigned char* buffer, size_t numpixels,
            && buffer[1]== mode->key_g && buffer[2] == mode->key_b ? 0 : 255;
       }
     } else {
-      for(i = 0; i != numpixels; ++i, buffer += num_channels) {
+      for(; i != numpixels; ++i, buffer += num_channels) {
         buffer[0] = in[i * 6 + 0];
         buffer[1] = in[i * 6 + 2];
         buffer[2] = in[i * 6 + 4];
@@ -3049,7 +3819,7 @@ static void getPixelColorsRGBA8(unsigned char* buffer, size_t numpixels,
   } else if(mode->colortype == LCT_PALETTE) {
     unsigned index;
     size_t j = 0;
-    for(i = 0; i != numpixels; ++i, buffer += num_channels) {
+    for(; i != numpixels; ++i, buffer += num_channels) {
       if(mode->bitdepth == 8) index = in[i];
       else index = readBitsFromReversedStream(&j, in, mode->bitdepth);
 
@@ -3067,26 +3837,26 @@ static void getPixelColorsRGBA8(unsigned char* buffer, size_t numpixels,
     }
   } else if(mode->colortype == LCT_GREY_ALPHA) {
     if(mode->bitdepth == 8) {
-      for(i = 0; i != numpixels; ++i, buffer += num_channels) {
+      for(; i != numpixels; ++i, buffer += num_channels) {
         buffer[0] = buffer[1] = buffer[2] = in[i * 2 + 0];
         if(has_alpha) buffer[3] = in[i * 2 + 1];
       }
     } else {
-      for(i = 0; i != numpixels; ++i, buffer += num_channels) {
+      for(; i != numpixels; ++i, buffer += num_channels) {
         buffer[0] = buffer[1] = buffer[2] = in[i * 4 + 0];
         if(has_alpha) buffer[3] = in[i * 4 + 2];
       }
     }
   } else if(mode->colortype == LCT_RGBA) {
     if(mode->bitdepth == 8) {
-      for(i = 0; i != numpixels; ++i, buffer += num_channels) {
+      for(; i != numpixels; ++i, buffer += num_channels) {
         buffer[0] = in[i * 4 + 0];
         buffer[1] = in[i * 4 + 1];
         buffer[2] = in[i * 4 + 2];
         if(has_alpha) buffer[3] = in[i * 4 + 3];
       }
     } else {
-      for(i = 0; i != numpixels; ++i, buffer += num_channels) {
+      for(; i != numpixels; ++i, buffer += num_channels) {
         buffer[0] = in[i * 8 + 0];
         buffer[1] = in[i * 8 + 2];
         buffer[2] = in[i * 8 + 4];
@@ -3171,6 +3941,14 @@ unsigned lodepng_convert(unsigned char* out, const unsigned char* in,
       getPixelColorRGBA16(&r, &g, &b, &a, in, i, mode_in);
       rgba16ToPixel(out, i, mode_out, r, g, b, a);
     }
+#ifdef LODEPNG_COMPILE_FAST_CONVERT
+  } else if(mode_in->bitdepth == 16 && mode_out->bitdepth == 8 && mode_in->colortype == mode_out->colortype) {
+    /*same channels, only the low bytes are dropped (a color key has no effect without alpha output)*/
+    narrow16To8(out, in, numpixels * getNumColorChannels(mode_in->colortype));
+  } else if(mode_out->bitdepth == 8 && mode_out->colortype == LCT_GREY
+            && mode_in->colortype != LCT_PALETTE && mode_in->bitdepth >= 8) {
+    getPixelChannels8(out, numpixels, in, mode_in);
+#endif /*LODEPNG_COMPILE_FAST_CONVERT*/
   } else if(mode_out->bitdepth == 8 && mode_out->colortype == LCT_RGBA) {
     getPixelColorsRGBA8(out, numpixels, 1, in, mode_in);
   } else if(mode_out->bitdepth == 8 && mode_out->colortype == LCT_RGB) {
@@ -3748,17 +4526,18 @@ static unsigned unfilterScanline(unsigned char* recon, const unsigned char* scan
   return 0;
 }
 
-static unsigned unfilter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h, unsigned bpp) {
+static unsigned unfilterRows(unsigned char* out, const unsigned char* in, const unsigned char* prevline,
+                             unsigned w, unsigned h, unsigned bpp) {
   /*
   For PNG filter method 0
   this function unfilters a single image (e.g. without interlacing this is called once, with Adam7 seven times)
   out must have enough bytes allocated already, in must have the scanlines + 1 filtertype byte per scanline
   w and h are image dimensions or dimensions of reduced image, bpp is bits per pixel
   in and out are allowed to be the same memory address (but aren't the same size since in has the extra filter bytes)
+  prevline is the unfiltered scanline above the first one, or NULL at the top of the image
   */
 
   unsigned y;
-  unsigned char* prevline = 0;
 
   /*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise*/
   size_t bytewidth = (bpp + 7) / 8;
@@ -3777,6 +4556,10 @@ static unsigned unfilter(unsigned char* out, const unsigned char* in, unsigned w
   return 0;
 }
 
+static unsigned unfilter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h, unsigned bpp) {
+  return unfilterRows(out, in, 0, w, h, bpp);
+}
+
 /*
 in: Adam7 interlaced image, with no padding bits between scanlines, but between
  reduced images so that each reduced image starts at a byte.
@@ -3898,6 +4681,175 @@ static unsigned postProcessScanlines(unsigned char* out, unsigned char* in,
   return 0;
 }
 
+#ifdef LODEPNG_COMPILE_ZLIB
+/*
+Restart segments: bands of scanlines whose deflate data starts at a byte boundary and doesn't refer back to
+earlier bands, written by the encoder when restart_segments is set. The private prSG chunk lists them:
+a 4-byte segment count, then per segment its first scanline and the offset of its deflate data in the zlib
+stream (which includes the 2-byte zlib header). Every band is inflated and unfiltered as its own task.
+*/
+typedef struct RestartSegment {
+  unsigned row, numrows; /*scanlines covered by this segment*/
+  const unsigned char* data; /*its deflate data, followed by the rest of the zlib stream*/
+  size_t size, end; /*bytes until the end of the zlib stream and the end of this segment (0 for the last one)*/
+  unsigned adler; /*adler32 of its filtered scanlines*/
+  ucvector filtered; /*its filtered scanlines, kept if they can't be unfiltered by the task*/
+  unsigned deferred; /*the first scanline refers to the previous band, unfilter after all tasks are done*/
+  unsigned error;
+} RestartSegment;
+
+typedef struct RestartSegments {
+  RestartSegment* segments;
+  size_t numsegments;
+  unsigned char* out; /*the image, or the scanlines with filter bytes if padded*/
+  unsigned w, bpp;
+  unsigned padded; /*scanlines have padding bits, only inflate and unfilter in postProcessScanlines*/
+} RestartSegments;
+
+static void decodeRestartSegment(void* context, size_t index) {
+  RestartSegments* c = (RestartSegments*)context;
+  RestartSegment* segment = &c->segments[index];
+  size_t linebytes = (c->w * c->bpp + 7) / 8;
+  size_t i;
+
+  segment->error = inflateBlocks(&segment->filtered, segment->data, segment->size, segment->end, 0);
+  if(segment->error) return;
+  if(segment->filtered.size != (linebytes + 1) * segment->numrows) {
+    segment->error = 91; /*decompressed size doesn't match prediction*/
+    return;
+  }
+  segment->adler = adler32(segment->filtered.data, (unsigned)segment->filtered.size);
+
+  if(c->padded) {
+    unsigned char* target = &c->out[(linebytes + 1) * segment->row];
+    for(i = 0; i != segment->filtered.size; ++i) target[i] = segment->filtered.data[i];
+  } else if(segment->row != 0 && segment->filtered.data[0] > 1) {
+    /*Up, Average or Paeth on the first scanline need the last one of the previous band*/
+    segment->deferred = 1;
+    return;
+  } else {
+    /*None and Sub don't use the previous scanline, so the band unfilters on its own*/
+    segment->error = unfilterRows(&c->out[linebytes * segment->row], segment->filtered.data, 0,
+                                  c->w, segment->numrows, c->bpp);
+  }
+  ucvector_cleanup(&segment->filtered);
+}
+
+/*
+Decodes the non-interlaced image data in parallel using the restart segments in restart (row and offset
+pairs, see readChunk_prSG). Returns error code, the caller should then decode the regular way instead.
+*/
+static unsigned decodeRestartSegments(unsigned char** out, unsigned w, unsigned h, const LodePNGState* state,
+                                      const unsigned char* in, size_t insize, const uivector* restart) {
+  RestartSegments c;
+  size_t i, linebytes, outsize;
+  unsigned error = 0;
+  unsigned adler = 1;
+
+  error = zlib_check_header(in, insize);
+  if(error) return error;
+  c.numsegments = restart->size / 2;
+  if(insize < 6 || restart->data[restart->size - 1] > insize - 4) return 53; /*segment past the zlib data*/
+
+  c.w = w;
+  c.bpp = lodepng_get_bpp(&state->info_png.color);
+  linebytes = (w * c.bpp + 7) / 8;
+  c.padded = c.bpp < 8 && w * c.bpp != linebytes * 8;
+  outsize = c.padded ? (linebytes + 1) * h : lodepng_get_raw_size(w, h, &state->info_png.color);
+
+  c.segments = (RestartSegment*)lodepng_malloc(c.numsegments * sizeof(RestartSegment));
+  c.out = (unsigned char*)lodepng_malloc(outsize);
+  if(!c.segments || !c.out) {
+    lodepng_free(c.segments);
+    lodepng_free(c.out);
+    return 83; /*alloc fail*/
+  }
+
+  for(i = 0; i != c.numsegments; ++i) {
+    RestartSegment* segment = &c.segments[i];
+    unsigned last = (i + 1 == c.numsegments);
+    size_t start = restart->data[i * 2 + 1];
+    size_t end = last ? insize - 4 : restart->data[i * 2 + 3];
+    segment->row = restart->data[i * 2];
+    segment->numrows = (last ? h : restart->data[i * 2 + 2]) - segment->row;
+    segment->data = &in[start];
+    segment->size = insize - start;
+    segment->end = last ? 0 : end - start;
+    segment->adler = 1;
+    ucvector_init(&segment->filtered);
+    segment->deferred = 0;
+    segment->error = 0;
+  }
+
+  runParallel(decodeRestartSegment, &c, c.numsegments, state->decoder.num_threads);
+
+  for(i = 0; i != c.numsegments && !error; ++i) {
+    error = c.segments[i].error;
+    adler = adler32_combine(adler, c.segments[i].adler, (linebytes + 1) * c.segments[i].numrows);
+  }
+  if(!error && !state->decoder.zlibsettings.ignore_adler32 && adler != lodepng_read32bitInt(&in[insize - 4])) {
+    error = 58; /*error, adler checksum not correct, data must be corrupted*/
+  }
+  /*bands whose first scanline depends on the one above, in order since that one may be deferred too*/
+  for(i = 0; i != c.numsegments && !error; ++i) {
+    RestartSegment* segment = &c.segments[i];
+    if(!segment->deferred) continue;
+    error = unfilterRows(&c.out[linebytes * segment->row], segment->filtered.data,
+                         &c.out[linebytes * (segment->row - 1)], w, segment->numrows, c.bpp);
+  }
+
+  for(i = 0; i != c.numsegments; ++i) ucvector_cleanup(&c.segments[i].filtered);
+  lodepng_free(c.segments);
+
+  if(!error && c.padded) {
+    /*remove the padding bits from the inflated scanlines the regular way*/
+    outsize = lodepng_get_raw_size(w, h, &state->info_png.color);
+    *out = (unsigned char*)lodepng_malloc(outsize);
+    if(!*out) error = 83; /*alloc fail*/
+    if(!error) {
+      for(i = 0; i < outsize; i++) (*out)[i] = 0;
+      error = postProcessScanlines(*out, c.out, w, h, &state->info_png);
+    }
+    lodepng_free(c.out);
+  }
+  else if(!error) *out = c.out;
+  else lodepng_free(c.out);
+
+  if(error) {
+    lodepng_free(*out);
+    *out = 0;
+  }
+  return error;
+}
+
+/*
+Reads the restart segments into restart as row and offset pairs. Since this is only a hint for faster
+decoding, an inconsistent chunk is ignored rather than treated as an error.
+*/
+static void readChunk_prSG(uivector* restart, unsigned h, const unsigned char* data, size_t chunkLength) {
+  unsigned numsegments, i;
+
+  restart->size = 0;
+  if(chunkLength < 4) return;
+  numsegments = lodepng_read32bitInt(data);
+  if(numsegments == 0 || numsegments > h || chunkLength != 4 + 8 * (size_t)numsegments) return;
+  if(!uivector_resize(restart, numsegments * 2)) return;
+
+  for(i = 0; i != numsegments; ++i) {
+    unsigned row = lodepng_read32bitInt(&data[4 + i * 8]);
+    unsigned offset = lodepng_read32bitInt(&data[8 + i * 8]);
+    /*bands must start at the top, at the first deflate byte after the zlib header, and be in order*/
+    if(row >= h || (i == 0 && (row != 0 || offset != 2))
+       || (i != 0 && (row <= restart->data[i * 2 - 2] || offset <= restart->data[i * 2 - 1]))) {
+      restart->size = 0;
+      return;
+    }
+    restart->data[i * 2] = row;
+    restart->data[i * 2 + 1] = offset;
+  }
+}
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
 static unsigned readChunk_PLTE(LodePNGColorMode* color, const unsigned char* data, size_t chunkLength) {
   unsigned pos = 0, i;
   if(color->palette) lodepng_free(color->palette);
@@ -4313,8 +5265,310 @@ unsigned lodepng_inspect_chunk(LodePNGState* state, size_t pos,
   return error;
 }
 
-/*read a PNG, the result will be in the same color type as the PNG (hence "generic")*/
-static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
+/*box filters rows of an image, in a color type without palette and with 8 or 16 bits per channel, to 1/factor
+of their width and height*/
+typedef struct Reducer {
+  unsigned char* out; /*the reduced image*/
+  unsigned w, h, factor, ow; /*size of the full image, the factor, width of the reduced one*/
+  unsigned channels, bytes; /*color channels per pixel and bytes per channel*/
+  unsigned* sums; /*per channel of a reduced row, the sum of the full pixels in it so far*/
+  unsigned rows; /*full rows in sums*/
+  unsigned y; /*reduced rows done*/
+} Reducer;
+
+/*error code if decoding can't be reduced into the output color type*/
+static unsigned checkReducible(const LodePNGState* state) {
+  const LodePNGColorMode* mode = state->decoder.color_convert ? &state->info_raw : &state->info_png.color;
+  /*above 256, sums of 16-bit channels can overflow*/
+  if(state->decoder.reduce > 256 || mode->colortype == LCT_PALETTE || mode->bitdepth < 8) return 105;
+  /*same as the conversions lodepng_decode supports*/
+  if(state->decoder.color_convert && !lodepng_color_mode_equal(mode, &state->info_png.color)
+     && !(mode->colortype == LCT_RGB || mode->colortype == LCT_RGBA) && mode->bitdepth != 8) {
+    return 56; /*unsupported color mode conversion*/
+  }
+  return 0;
+}
+
+static unsigned reducer_init(Reducer* reducer, unsigned w, unsigned h, unsigned factor, const LodePNGColorMode* mode) {
+  size_t i, numsums;
+  reducer->w = w;
+  reducer->h = h;
+  reducer->factor = factor;
+  reducer->ow = (w + factor - 1) / factor;
+  reducer->channels = getNumColorChannels(mode->colortype);
+  reducer->bytes = mode->bitdepth / 8;
+  reducer->rows = reducer->y = 0;
+  numsums = (size_t)reducer->ow * reducer->channels;
+  reducer->out = (unsigned char*)lodepng_malloc(numsums * reducer->bytes * ((h + factor - 1) / factor));
+  reducer->sums = (unsigned*)lodepng_malloc(numsums * sizeof(unsigned));
+  if(!reducer->out || !reducer->sums) return 83; /*alloc fail*/
+  for(i = 0; i != numsums; ++i) reducer->sums[i] = 0;
+  return 0;
+}
+
+static void reducer_cleanup(Reducer* reducer) {
+  lodepng_free(reducer->out);
+  lodepng_free(reducer->sums);
+}
+
+/*writes the average of the rows summed so far as the next reduced row*/
+static void reducer_flush(Reducer* reducer) {
+  unsigned x, c;
+  unsigned channels = reducer->channels;
+  unsigned char* out = &reducer->out[(size_t)reducer->y * reducer->ow * channels * reducer->bytes];
+  for(x = 0; x != reducer->ow; ++x) {
+    unsigned columns = reducer->w - x * reducer->factor;
+    unsigned count;
+    if(columns > reducer->factor) columns = reducer->factor;
+    count = columns * reducer->rows;
+    for(c = 0; c != channels; ++c) {
+      size_t i = (size_t)x * channels + c;
+      unsigned value = (reducer->sums[i] + count / 2) / count;
+      if(reducer->bytes == 1) {
+        out[i] = (unsigned char)value;
+      } else {
+        out[2 * i + 0] = (unsigned char)(value >> 8);
+        out[2 * i + 1] = (unsigned char)(value & 255);
+      }
+      reducer->sums[i] = 0;
+    }
+  }
+  reducer->rows = 0;
+  ++reducer->y;
+}
+
+/*adds the next full row, whose size is w pixels*/
+static void reducer_add_row(Reducer* reducer, const unsigned char* row) {
+  unsigned x, c;
+  unsigned channels = reducer->channels;
+  for(x = 0; x != reducer->w; ++x) {
+    unsigned* sums = &reducer->sums[(size_t)(x / reducer->factor) * channels];
+    if(reducer->bytes == 1) {
+      for(c = 0; c != channels; ++c) sums[c] += row[(size_t)x * channels + c];
+    } else {
+      for(c = 0; c != channels; ++c) {
+        size_t i = 2 * ((size_t)x * channels + c);
+        sums[c] += 256u * row[i] + row[i + 1];
+      }
+    }
+  }
+  if(++reducer->rows == reducer->factor) reducer_flush(reducer);
+}
+
+/*replaces the full image in out with its reduced version, which decoding couldn't do while inflating*/
+static unsigned reduceImage(unsigned char** out, unsigned* w, unsigned* h,
+                            const LodePNGColorMode* mode, unsigned factor) {
+  Reducer reducer;
+  size_t linebytes = lodepng_get_raw_size(*w, 1, mode);
+  unsigned y;
+  unsigned error = reducer_init(&reducer, *w, *h, factor, mode);
+  if(!error) {
+    for(y = 0; y != *h; ++y) reducer_add_row(&reducer, &(*out)[y * linebytes]);
+    if(reducer.rows) reducer_flush(&reducer);
+    lodepng_free(*out);
+    *out = reducer.out;
+    reducer.out = 0;
+    *w = reducer.ow;
+    *h = reducer.y;
+  }
+  reducer_cleanup(&reducer);
+  return error;
+}
+
+#ifdef LODEPNG_COMPILE_ZLIB
+typedef struct ReducedDecode {
+  InflateProgress progress; /*first member: report gets a pointer to it*/
+  const LodePNGColorMode* color; /*of the PNG*/
+  const LodePNGColorMode* mode; /*of the output*/
+  Reducer reducer;
+  size_t linebytes, bytewidth; /*of a full scanline without its filter type byte*/
+  unsigned y; /*the next full row*/
+  size_t rowstart; /*where its filter type byte is in the inflated data that's left*/
+  unsigned char* line; /*unfiltered row y*/
+  unsigned char* prevline; /*unfiltered row y - 1*/
+  unsigned char* converted; /*line in the output color type*/
+  unsigned adler; /*Adler-32 of the inflated data dropped so far*/
+  size_t dropped; /*amount of inflated data dropped so far*/
+} ReducedDecode;
+
+/*unfilters and reduces every row that's completely inflated, then drops those rows from the inflated data*/
+static unsigned reportReducedRows(InflateProgress* progress, ucvector* out, size_t* pos) {
+  ReducedDecode* decode = (ReducedDecode*)progress;
+  size_t drop;
+  unsigned error;
+
+  while(decode->y < decode->reducer.h && decode->rowstart + 1 + decode->linebytes <= *pos) {
+    unsigned char* swap;
+    error = unfilterScanline(decode->line, &out->data[decode->rowstart + 1], decode->y ? decode->prevline : 0,
+                             decode->bytewidth, out->data[decode->rowstart], decode->linebytes);
+    if(error) return error;
+    if(decode->converted) {
+      error = lodepng_convert(decode->converted, decode->line, decode->mode, decode->color, decode->reducer.w, 1);
+      if(error) return error;
+    }
+    reducer_add_row(&decode->reducer, decode->converted ? decode->converted : decode->line);
+    swap = decode->prevline;
+    decode->prevline = decode->line;
+    decode->line = swap;
+    decode->rowstart += 1 + decode->linebytes;
+    ++decode->y;
+  }
+
+  drop = *pos > 32768 ? *pos - 32768 : 0;
+  if(drop > decode->rowstart) drop = decode->rowstart;
+  if(drop) {
+    decode->adler = update_adler32(decode->adler, out->data, (unsigned)drop);
+    memmove(out->data, out->data + drop, *pos - drop);
+    *pos -= drop;
+    out->size = *pos;
+    decode->rowstart -= drop;
+    decode->dropped += drop;
+  }
+  progress->threshold = decode->rowstart + 1 + decode->linebytes;
+  return 0;
+}
+
+/*
+Decodes the image data of a non-interlaced PNG straight to the reduced size, for the reduce setting. Rows are
+reduced as soon as they're inflated, so only about a deflate block of inflated data is kept at a time.
+*/
+static unsigned decodeReduced(unsigned char** out, unsigned* w, unsigned* h, const LodePNGState* state,
+                              const unsigned char* in, size_t insize) {
+  ReducedDecode decode;
+  ucvector inflated;
+  unsigned error, convert;
+  unsigned bpp = lodepng_get_bpp(&state->info_png.color);
+
+  decode.progress.threshold = 1;
+  decode.progress.report = reportReducedRows;
+  decode.color = &state->info_png.color;
+  decode.mode = state->decoder.color_convert ? &state->info_raw : &state->info_png.color;
+  decode.linebytes = ((size_t)*w * bpp + 7) / 8;
+  decode.bytewidth = (bpp + 7) / 8;
+  decode.y = 0;
+  decode.rowstart = 0;
+  decode.adler = 1;
+  decode.dropped = 0;
+  decode.line = (unsigned char*)lodepng_malloc(decode.linebytes);
+  decode.prevline = (unsigned char*)lodepng_malloc(decode.linebytes);
+  convert = !lodepng_color_mode_equal(decode.mode, decode.color);
+  decode.converted = convert ? (unsigned char*)lodepng_malloc(lodepng_get_raw_size(*w, 1, decode.mode)) : 0;
+  ucvector_init(&inflated);
+
+  error = reducer_init(&decode.reducer, *w, *h, state->decoder.reduce, decode.mode);
+  if(!error && (!decode.line || !decode.prevline || (convert && !decode.converted))) error = 83; /*alloc fail*/
+  if(!error) error = zlib_check_header(in, insize);
+  if(!error) error = inflateBlocks(&inflated, in + 2, insize - 2, 0, &decode.progress);
+  if(!error && decode.y != *h) error = 91; /*decompressed size doesn't match prediction*/
+  if(!error && decode.dropped + inflated.size != (size_t)*h * (1 + decode.linebytes)) error = 91;
+  if(!error && !state->decoder.zlibsettings.ignore_adler32) {
+    unsigned ADLER32 = lodepng_read32bitInt(&in[insize - 4]);
+    if(update_adler32(decode.adler, inflated.data, (unsigned)inflated.size) != ADLER32) error = 58;
+  }
+
+  if(!error) {
+    if(decode.reducer.rows) reducer_flush(&decode.reducer);
+    *out = decode.reducer.out;
+    decode.reducer.out = 0;
+    *w = decode.reducer.ow;
+    *h = decode.reducer.y;
+  }
+  reducer_cleanup(&decode.reducer);
+  ucvector_cleanup(&inflated);
+  lodepng_free(decode.line);
+  lodepng_free(decode.prevline);
+  lodepng_free(decode.converted);
+  return error;
+}
+
+typedef struct Adam7Preview {
+  InflateProgress progress; /*first member: report gets a pointer to it*/
+  const LodePNGState* state;
+  unsigned w, h;
+  unsigned passes; /*the amount of passes the last preview was made of*/
+} Adam7Preview;
+
+/*
+Makes a preview from the Adam7 passes that are completely inflated so far and gives it to the adam7_preview
+callback. Passes 1, 3 and 5 complete a grid of every 8th, 4th and 2nd pixel in both directions, so the
+preview is the image at 1/8, 1/4 or 1/2 size. Only errors from the callback itself stop decoding, a preview
+that can't be made is skipped.
+*/
+static unsigned reportAdam7Preview(InflateProgress* progress, ucvector* out, size_t* pos) {
+  Adam7Preview* preview = (Adam7Preview*)progress;
+  const unsigned char* scanlines = out->data;
+  size_t size = *pos;
+  const LodePNGState* state = preview->state;
+  const LodePNGColorMode* color = &state->info_png.color;
+  unsigned passw[7], passh[7];
+  size_t filter_passstart[8], padded_passstart[8], passstart[8];
+  unsigned bpp = lodepng_get_bpp(color);
+  unsigned passes = preview->passes, next, shift, pw, ph, i;
+  unsigned char* unfiltered = 0;
+  unsigned char* image = 0;
+  unsigned char* converted = 0;
+  unsigned error = 0;
+
+  Adam7_getpassvalues(passw, passh, filter_passstart, padded_passstart, passstart, preview->w, preview->h, bpp);
+  for(next = passes ? passes + 2 : 1; next <= 5 && filter_passstart[next] <= size; next += 2) passes = next;
+  progress->threshold = next <= 5 ? filter_passstart[next] : 0;
+  if(passes == preview->passes) return 0;
+  preview->passes = passes;
+
+  shift = 3 - passes / 2;
+  pw = (preview->w + (1u << shift) - 1) >> shift;
+  ph = (preview->h + (1u << shift) - 1) >> shift;
+  unfiltered = (unsigned char*)lodepng_malloc(padded_passstart[passes]);
+  image = (unsigned char*)lodepng_malloc(((size_t)pw * ph * bpp + 7) / 8);
+  if(unfiltered && image) {
+    for(i = 0; i != passes && !error; ++i) {
+      if(passw[i] && passh[i]) {
+        error = unfilter(&unfiltered[padded_passstart[i]], &scanlines[filter_passstart[i]], passw[i], passh[i], bpp);
+      }
+    }
+  } else error = 83; /*alloc fail*/
+
+  if(!error) {
+    /*like Adam7_deinterlace, except into the reduced grid and from the scanlines that still have padding bits*/
+    memset(image, 0, ((size_t)pw * ph * bpp + 7) / 8);
+    for(i = 0; i != passes; ++i) {
+      unsigned x, y, b;
+      size_t ilinebits = ((size_t)passw[i] * bpp + 7) / 8 * 8;
+      for(y = 0; y < passh[i]; ++y)
+      for(x = 0; x < passw[i]; ++x) {
+        size_t ibp = 8 * padded_passstart[i] + y * ilinebits + (size_t)x * bpp;
+        size_t obp = (((ADAM7_IY[i] + y * ADAM7_DY[i]) >> shift) * (size_t)pw
+                   + ((ADAM7_IX[i] + x * ADAM7_DX[i]) >> shift)) * bpp;
+        if(bpp >= 8) {
+          for(b = 0; b < bpp / 8; ++b) image[obp / 8 + b] = unfiltered[ibp / 8 + b];
+        } else {
+          for(b = 0; b < bpp; ++b) setBitOfReversedStream0(&obp, image, readBitFromReversedStream(&ibp, unfiltered));
+        }
+      }
+    }
+
+    if(state->decoder.color_convert && !lodepng_color_mode_equal(&state->info_raw, color)) {
+      converted = (unsigned char*)lodepng_malloc(lodepng_get_raw_size(pw, ph, &state->info_raw));
+      if(!converted) error = 83; /*alloc fail*/
+      else error = lodepng_convert(converted, image, &state->info_raw, color, pw, ph);
+    }
+  }
+
+  /*a preview that couldn't be made isn't an error in the image*/
+  if(!error) error = state->decoder.adam7_preview(converted ? converted : image, pw, ph,
+                                                  state->decoder.adam7_preview_context);
+  else error = 0;
+
+  lodepng_free(unfiltered);
+  lodepng_free(image);
+  lodepng_free(converted);
+  return error;
+}
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+/*read a PNG, the result will be in the same color type as the PNG (hence "generic"). reduced is set
+if the image came out reduced to the output color type already, see the reduce setting*/
+static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h, unsigned* reduced,
                           LodePNGState* state,
                           const unsigned char* in, size_t insize) {
   unsigned char IEND = 0;
@@ -4324,6 +5578,9 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   ucvector scanlines;
   size_t predict;
   size_t outsize = 0;
+#ifdef LODEPNG_COMPILE_ZLIB
+  uivector restart; /*restart segments from the prSG chunk, if any*/
+#endif /*LODEPNG_COMPILE_ZLIB*/
 
   /*for unknown chunk order*/
   unsigned unknown = 0;
@@ -4335,6 +5592,7 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   /* safe output values in case error happens */
   *out = 0;
   *w = *h = 0;
+  *reduced = 0;
 
   state->error = lodepng_inspect(w, h, state, in, insize); /*reads header and resets other parameters in state->info_png*/
   if(state->error) return;
@@ -4342,8 +5600,15 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   if(lodepng_pixel_overflow(*w, *h, &state->info_png.color, &state->info_raw)) {
     CERROR_RETURN(state->error, 92); /*overflow possible due to amount of pixels*/
   }
+  if(state->decoder.reduce > 1) {
+    state->error = checkReducible(state);
+    if(state->error) return;
+  }
 
   ucvector_init(&idat);
+#ifdef LODEPNG_COMPILE_ZLIB
+  uivector_init(&restart);
+#endif /*LODEPNG_COMPILE_ZLIB*/
   chunk = &in[33]; /*first byte of the first chunk after the header*/
 
   /*loop through the chunks, ignoring unknown chunks and stopping at IEND chunk.
@@ -4400,6 +5665,11 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
       affects the alpha channel of pixels. */
       state->error = readChunk_tRNS(&state->info_png.color, data, chunkLength);
       if(state->error) break;
+#ifdef LODEPNG_COMPILE_ZLIB
+    } else if(lodepng_chunk_type_equals(chunk, "prSG")) {
+      /*restart segments for parallel decoding, only valid before the image data*/
+      if(idat.size == 0) readChunk_prSG(&restart, *h, data, chunkLength);
+#endif /*LODEPNG_COMPILE_ZLIB*/
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
       /*background color chunk (bKGD)*/
     } else if(lodepng_chunk_type_equals(chunk, "bKGD")) {
@@ -4465,6 +5735,27 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
     if(!IEND) chunk = lodepng_chunk_next_const(chunk);
   }
 
+#ifdef LODEPNG_COMPILE_ZLIB
+  if(!state->error && state->decoder.reduce > 1 && state->info_png.interlace_method == 0
+     && !state->decoder.zlibsettings.custom_zlib && !state->decoder.zlibsettings.custom_inflate) {
+    state->error = decodeReduced(out, w, h, state, idat.data, idat.size);
+    *reduced = 1;
+    uivector_cleanup(&restart);
+    ucvector_cleanup(&idat);
+    return;
+  }
+  if(!state->error && restart.size != 0 && state->info_png.interlace_method == 0
+     && !state->decoder.zlibsettings.custom_zlib && !state->decoder.zlibsettings.custom_inflate) {
+    /*if this fails, the regular decoding below gives the actual error or handles what it didn't*/
+    if(decodeRestartSegments(out, *w, *h, state, idat.data, idat.size, &restart) == 0) {
+      uivector_cleanup(&restart);
+      ucvector_cleanup(&idat);
+      return;
+    }
+  }
+  uivector_cleanup(&restart);
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
   ucvector_init(&scanlines);
   /*predict output size, to allocate exact size for output buffer to avoid more dynamic allocation.
   If the decompressed size does not match the prediction, the image must be corrupt.*/
@@ -4484,8 +5775,24 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
   }
   if(!state->error && !ucvector_reserve(&scanlines, predict)) state->error = 83; /*alloc fail*/
   if(!state->error) {
-    state->error = zlib_decompress(&scanlines.data, &scanlines.size, idat.data,
-                                   idat.size, &state->decoder.zlibsettings);
+#ifdef LODEPNG_COMPILE_ZLIB
+    if(state->decoder.adam7_preview && state->info_png.interlace_method == 1
+       && !state->decoder.zlibsettings.custom_zlib && !state->decoder.zlibsettings.custom_inflate) {
+      Adam7Preview preview;
+      preview.progress.threshold = 1; /*the first report works out where the passes end*/
+      preview.progress.report = reportAdam7Preview;
+      preview.state = state;
+      preview.w = *w;
+      preview.h = *h;
+      preview.passes = 0;
+      state->error = zlib_decompress_progress(&scanlines, idat.data, idat.size,
+                                              &state->decoder.zlibsettings, &preview.progress);
+    } else
+#endif /*LODEPNG_COMPILE_ZLIB*/
+    {
+      state->error = zlib_decompress(&scanlines.data, &scanlines.size, idat.data,
+                                     idat.size, &state->decoder.zlibsettings);
+    }
     if(!state->error && scanlines.size != predict) state->error = 91; /*decompressed size doesn't match prediction*/
   }
   ucvector_cleanup(&idat);
@@ -4505,10 +5812,11 @@ static void decodeGeneric(unsigned char** out, unsigned* w, unsigned* h,
 unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
                         LodePNGState* state,
                         const unsigned char* in, size_t insize) {
+  unsigned reduced;
   *out = 0;
-  decodeGeneric(out, w, h, state, in, insize);
+  decodeGeneric(out, w, h, &reduced, state, in, insize);
   if(state->error) return state->error;
-  if(!state->decoder.color_convert || lodepng_color_mode_equal(&state->info_raw, &state->info_png.color)) {
+  if(!state->decoder.color_convert || reduced || lodepng_color_mode_equal(&state->info_raw, &state->info_png.color)) {
     /*same color type, no copying or converting of data needed*/
     /*store the info_png color settings on the info_raw so that the info_raw still reflects what colortype
     the raw image has to the end user*/
@@ -4537,6 +5845,10 @@ unsigned lodepng_decode(unsigned char** out, unsigned* w, unsigned* h,
                                         &state->info_png.color, *w, *h);
     lodepng_free(data);
   }
+  if(!state->error && state->decoder.reduce > 1 && !reduced) {
+    /*interlaced, or inflated by a custom function: reduce the full image instead*/
+    state->error = reduceImage(out, w, h, &state->info_raw, state->decoder.reduce);
+  }
   return state->error;
 }
 
@@ -4563,15 +5875,17 @@ unsigned lodepng_decode24(unsigned char** out, unsigned* w, unsigned* h, const u
 #ifdef LODEPNG_COMPILE_DISK
 unsigned lodepng_decode_file(unsigned char** out, unsigned* w, unsigned* h, const char* filename,
                              LodePNGColorType colortype, unsigned bitdepth) {
-  unsigned char* buffer = 0;
+  const unsigned char* buffer = 0;
   size_t buffersize;
+  unsigned mapped;
   unsigned error;
   /* safe output values in case error happens */
   *out = 0;
   *w = *h = 0;
-  error = lodepng_load_file(&buffer, &buffersize, filename);
-  if(!error) error = lodepng_decode_memory(out, w, h, buffer, buffersize, colortype, bitdepth);
-  lodepng_free(buffer);
+  error = lodepng_map_file(&buffer, &buffersize, &mapped, filename);
+  if(error) return error;
+  error = lodepng_decode_memory(out, w, h, buffer, buffersize, colortype, bitdepth);
+  lodepng_unmap_file(buffer, buffersize, mapped);
   return error;
 }
 
@@ -4593,6 +5907,10 @@ void lodepng_decoder_settings_init(LodePNGDecoderSettings* settings) {
   settings->ignore_crc = 0;
   settings->ignore_critical = 0;
   settings->ignore_end = 0;
+  settings->num_threads = 0;
+  settings->reduce = 1;
+  settings->adam7_preview = 0;
+  settings->adam7_preview_context = 0;
   lodepng_decompress_settings_init(&settings->zlibsettings);
 }
 
@@ -4738,6 +6056,142 @@ static unsigned addChunk_IDAT(ucvector* out, const unsigned char* data, size_t d
   return error;
 }
 
+/*scanlines per restart segment, or 0 if the image data is written the regular way*/
+static unsigned getRestartRows(unsigned h, const LodePNGInfo* info_png, const LodePNGEncoderSettings* settings) {
+#ifdef LODEPNG_COMPILE_ZLIB
+  unsigned numsegments = settings->restart_segments;
+  /*interlaced images and custom compressors don't get segments*/
+  if(info_png->interlace_method != 0) return 0;
+  if(settings->zlibsettings.custom_zlib || settings->zlibsettings.custom_deflate) return 0;
+  if(numsegments > h) numsegments = h;
+  if(numsegments < 2) return 0;
+  return (h + numsegments - 1) / numsegments;
+#else /*LODEPNG_COMPILE_ZLIB*/
+  (void)h; (void)info_png; (void)settings;
+  return 0;
+#endif /*LODEPNG_COMPILE_ZLIB*/
+}
+
+#ifdef LODEPNG_COMPILE_ZLIB
+/*filtered bytes per band when compressing on multiple threads, about the largest deflate block size*/
+static const size_t ENCODE_BAND_SIZE = 262144;
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
+/*
+Scanlines per band if the image data is filtered and compressed in bands (for restart segments or multiple
+threads), or 0 if it's done as a whole.
+*/
+static unsigned getBandRows(unsigned w, unsigned h, const LodePNGInfo* info_png,
+                            const LodePNGEncoderSettings* settings) {
+#ifdef LODEPNG_COMPILE_ZLIB
+  unsigned restartrows = getRestartRows(h, info_png, settings);
+  size_t linestride = 1 + ((size_t)w * lodepng_get_bpp(&info_png->color) + 7) / 8;
+  size_t rows = (ENCODE_BAND_SIZE + linestride - 1) / linestride;
+  if(restartrows) return restartrows;
+  if(settings->num_threads == 1 || info_png->interlace_method != 0) return 0;
+  if(settings->zlibsettings.custom_zlib || settings->zlibsettings.custom_deflate) return 0;
+  return rows < h ? (unsigned)rows : 0;
+#else /*LODEPNG_COMPILE_ZLIB*/
+  (void)w; (void)h; (void)info_png; (void)settings;
+  return 0;
+#endif /*LODEPNG_COMPILE_ZLIB*/
+}
+
+#ifdef LODEPNG_COMPILE_ZLIB
+/*
+Image data compressed in bands of scanlines. Every band is deflated as its own part of the zlib stream
+by a task that can run on any thread. Restart segments don't refer back to the previous band, otherwise
+the end of the previous band is the band's preset dictionary.
+*/
+typedef struct DeflateBand {
+  size_t start, end; /*byte range of its filtered scanlines*/
+  ucvector deflated;
+  unsigned adler; /*adler32 of its filtered scanlines*/
+  unsigned error;
+} DeflateBand;
+
+typedef struct DeflateBands {
+  DeflateBand* bands;
+  size_t numbands;
+  const unsigned char* data; /*the filtered scanlines of the whole image*/
+  unsigned restart; /*write restart segments*/
+  const LodePNGCompressSettings* settings;
+} DeflateBands;
+
+static void deflateBand(void* context, size_t index) {
+  DeflateBands* c = (DeflateBands*)context;
+  DeflateBand* band = &c->bands[index];
+  size_t dictsize = c->restart ? 0 : (band->start < 32768 ? band->start : 32768);
+
+  band->adler = adler32(&c->data[band->start], (unsigned)(band->end - band->start));
+  band->error = deflatePart(&band->deflated, &c->data[band->start - dictsize], dictsize,
+                            band->end - band->start + dictsize, c->settings, index + 1 == c->numbands);
+}
+
+/*
+The IDAT chunk with the image data compressed in bands of rows scanlines. For restart segments, the
+prSG chunk with their offsets (see readChunk_prSG) comes before it.
+*/
+static unsigned addChunks_bandedIDAT(ucvector* out, const unsigned char* data, size_t datasize,
+                                     unsigned h, unsigned rows, unsigned restart,
+                                     const LodePNGEncoderSettings* settings) {
+  DeflateBands c;
+  ucvector zlibdata, segments;
+  size_t i;
+  size_t linestride = datasize / h; /*bytes per filtered scanline, including the filter type byte*/
+  unsigned adler = 1;
+  unsigned error = 0;
+
+  c.numbands = (h + rows - 1) / rows;
+  c.data = data;
+  c.restart = restart;
+  c.settings = &settings->zlibsettings;
+  c.bands = (DeflateBand*)lodepng_malloc(c.numbands * sizeof(DeflateBand));
+  if(!c.bands) return 83; /*alloc fail*/
+  for(i = 0; i != c.numbands; ++i) {
+    DeflateBand* band = &c.bands[i];
+    band->start = i * rows * linestride;
+    band->end = (i + 1 == c.numbands) ? datasize : band->start + rows * linestride;
+    ucvector_init(&band->deflated);
+    band->adler = 1;
+    band->error = 0;
+  }
+
+  runParallel(deflateBand, &c, c.numbands, settings->num_threads);
+
+  ucvector_init(&zlibdata);
+  ucvector_init(&segments);
+  addZlibHeader(&zlibdata);
+  if(restart) lodepng_add32bitInt(&segments, (unsigned)c.numbands);
+  for(i = 0; i != c.numbands && !error; ++i) {
+    DeflateBand* band = &c.bands[i];
+    size_t oldsize = zlibdata.size, j;
+    error = band->error;
+    if(error) break;
+    if(restart) {
+      lodepng_add32bitInt(&segments, (unsigned)(i * rows));
+      lodepng_add32bitInt(&segments, (unsigned)oldsize);
+    }
+    if(!ucvector_resize(&zlibdata, oldsize + band->deflated.size)) ERROR_BREAK(83); /*alloc fail*/
+    for(j = 0; j != band->deflated.size; ++j) zlibdata.data[oldsize + j] = band->deflated.data[j];
+    adler = adler32_combine(adler, band->adler, band->end - band->start);
+  }
+
+  if(!error) {
+    lodepng_add32bitInt(&zlibdata, adler);
+    if(restart) error = addChunk(out, "prSG", segments.data, segments.size);
+  }
+  if(!error) error = addChunk(out, "IDAT", zlibdata.data, zlibdata.size);
+
+  for(i = 0; i != c.numbands; ++i) ucvector_cleanup(&c.bands[i].deflated);
+  lodepng_free(c.bands);
+  ucvector_cleanup(&segments);
+  ucvector_cleanup(&zlibdata);
+
+  return error;
+}
+#endif /*LODEPNG_COMPILE_ZLIB*/
+
 static unsigned addChunk_IEND(ucvector* out) {
   unsigned error = 0;
   error = addChunk(out, "IEND", 0, 0);
@@ -4993,12 +6447,13 @@ static float flog2(float f) {
   return result + 1.442695f * (f * f * f / 3 - 3 * f * f / 2 + 3 * f - 1.83333f);
 }
 
-static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
-                       const LodePNGColorMode* info, const LodePNGEncoderSettings* settings) {
+static unsigned filterRows(unsigned char* out, const unsigned char* in, unsigned w, unsigned ybegin, unsigned yend,
+                           const LodePNGColorMode* info, const LodePNGEncoderSettings* settings) {
   /*
   For PNG filter method 0
   out must be a buffer with as size: h + (w * h * bpp + 7) / 8, because there are
   the scanlines with 1 extra byte per scanline
+  only the scanlines ybegin..yend-1 are filtered, in and out are still those of the whole image
   */
 
   unsigned bpp = lodepng_get_bpp(info);
@@ -5006,7 +6461,7 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
   size_t linebytes = (w * bpp + 7) / 8;
   /*bytewidth is used for filtering, is 1 when bpp < 8, number of bytes per pixel otherwise*/
   size_t bytewidth = (bpp + 7) / 8;
-  const unsigned char* prevline = 0;
+  const unsigned char* prevline = ybegin ? &in[(ybegin - 1) * linebytes] : 0;
   unsigned x, y;
   unsigned error = 0;
   LodePNGFilterStrategy strategy = settings->filter_strategy;
@@ -5030,7 +6485,7 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
   if(bpp == 0) return 31; /*error: invalid color type*/
 
   if(strategy == LFS_ZERO) {
-    for(y = 0; y != h; ++y) {
+    for(y = ybegin; y != yend; ++y) {
       size_t outindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
       size_t inindex = linebytes * y;
       out[outindex] = 0; /*filter type byte*/
@@ -5050,7 +6505,7 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
     }
 
     if(!error) {
-      for(y = 0; y != h; ++y) {
+      for(y = ybegin; y != yend; ++y) {
         /*try the 5 filter types*/
         for(type = 0; type != 5; ++type) {
           filterScanline(attempt[type], &in[y * linebytes], prevline, linebytes, bytewidth, type);
@@ -5097,7 +6552,7 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
       if(!attempt[type]) return 83; /*alloc fail*/
     }
 
-    for(y = 0; y != h; ++y) {
+    for(y = ybegin; y != yend; ++y) {
       /*try the 5 filter types*/
       for(type = 0; type != 5; ++type) {
         filterScanline(attempt[type], &in[y * linebytes], prevline, linebytes, bytewidth, type);
@@ -5125,7 +6580,7 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
 
     for(type = 0; type != 5; ++type) lodepng_free(attempt[type]);
   } else if(strategy == LFS_PREDEFINED) {
-    for(y = 0; y != h; ++y) {
+    for(y = ybegin; y != yend; ++y) {
       size_t outindex = (1 + linebytes) * y; /*the extra filterbyte added to each row*/
       size_t inindex = linebytes * y;
       unsigned char type = settings->predefined_filters[y];
@@ -5156,7 +6611,7 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
       attempt[type] = (unsigned char*)lodepng_malloc(linebytes);
       if(!attempt[type]) return 83; /*alloc fail*/
     }
-    for(y = 0; y != h; ++y) /*try the 5 filter types*/ {
+    for(y = ybegin; y != yend; ++y) /*try the 5 filter types*/ {
       for(type = 0; type != 5; ++type) {
         unsigned testsize = (unsigned)linebytes;
         /*if(testsize > 8) testsize /= 8;*/ /*it already works good enough by testing a part of the row*/
@@ -5183,6 +6638,11 @@ static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w,
   return error;
 }
 
+static unsigned filter(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
+                       const LodePNGColorMode* info, const LodePNGEncoderSettings* settings) {
+  return filterRows(out, in, w, 0, h, info, settings);
+}
+
 static void addPaddingBits(unsigned char* out, const unsigned char* in,
                            size_t olinebits, size_t ilinebits, unsigned h) {
   /*The opposite of the removePaddingBits function
@@ -5252,6 +6712,64 @@ static void Adam7_interlace(unsigned char* out, const unsigned char* in, unsigne
   }
 }
 
+typedef struct FilterBands {
+  unsigned char* out;
+  const unsigned char* in;
+  unsigned w, h, rows;
+  const LodePNGColorMode* info;
+  const LodePNGEncoderSettings* settings;
+  unsigned* errors; /*one per band*/
+} FilterBands;
+
+static void filterBand(void* context, size_t index) {
+  FilterBands* c = (FilterBands*)context;
+  unsigned ybegin = (unsigned)index * c->rows;
+  unsigned yend = (c->h - ybegin > c->rows) ? ybegin + c->rows : c->h;
+  c->errors[index] = filterRows(c->out, c->in, c->w, ybegin, yend, c->info, c->settings);
+}
+
+/*the same as filter, but in bands of rows scanlines that are filtered on multiple threads*/
+static unsigned filterBands(unsigned char* out, const unsigned char* in, unsigned w, unsigned h, unsigned rows,
+                            const LodePNGColorMode* info, const LodePNGEncoderSettings* settings) {
+  FilterBands c;
+  size_t i, numbands = (h + rows - 1) / rows;
+  unsigned error = 0;
+
+  c.out = out;
+  c.in = in;
+  c.w = w;
+  c.h = h;
+  c.rows = rows;
+  c.info = info;
+  c.settings = settings;
+  c.errors = (unsigned*)lodepng_malloc(numbands * sizeof(unsigned));
+  if(!c.errors) return 83; /*alloc fail*/
+
+  runParallel(filterBand, &c, numbands, settings->num_threads);
+  for(i = 0; i != numbands && !error; ++i) error = c.errors[i];
+
+  lodepng_free(c.errors);
+  return error;
+}
+
+/*
+Refilters the first scanline of every band of rows scanlines, so it doesn't depend on the last one of the
+previous band: Up becomes None and Paeth becomes Sub (identical without a scanline above), Average becomes Sub.
+in are the padded scanlines, out the filtered ones.
+*/
+static void filterRestartRows(unsigned char* out, const unsigned char* in, unsigned w, unsigned h,
+                              unsigned bpp, unsigned rows) {
+  size_t linebytes = (w * bpp + 7) / 8;
+  size_t bytewidth = (bpp + 7) / 8;
+  unsigned y;
+  for(y = rows; y < h; y += rows) {
+    unsigned char* line = &out[y * (linebytes + 1)];
+    if(line[0] < 2) continue;
+    line[0] = (line[0] == 2) ? 0 : 1;
+    filterScanline(&line[1], &in[y * linebytes], 0, linebytes, bytewidth, line[0]);
+  }
+}
+
 /*out must be buffer big enough to contain uncompressed IDAT chunk data, and in must contain the full image.
 return value is error**/
 static unsigned preProcessScanlines(unsigned char** out, size_t* outsize, const unsigned char* in,
@@ -5263,6 +6781,8 @@ static unsigned preProcessScanlines(unsigned char** out, size_t* outsize, const
   *) if adam7: 1) Adam7_interlace 2) 7x add padding bits 3) 7x filter
   */
   unsigned bpp = lodepng_get_bpp(&info_png->color);
+  unsigned restartrows = getRestartRows(h, info_png, settings);
+  unsigned bandrows = getBandRows(w, h, info_png, settings);
   unsigned error = 0;
 
   if(info_png->interlace_method == 0) {
@@ -5277,12 +6797,16 @@ static unsigned preProcessScanlines(unsigned char** out, size_t* outsize, const
         if(!padded) error = 83; /*alloc fail*/
         if(!error) {
           addPaddingBits(padded, in, ((w * bpp + 7) / 8) * 8, w * bpp, h);
-          error = filter(*out, padded, w, h, &info_png->color, settings);
+          if(bandrows) error = filterBands(*out, padded, w, h, bandrows, &info_png->color, settings);
+          else error = filter(*out, padded, w, h, &info_png->color, settings);
+          if(!error && restartrows) filterRestartRows(*out, padded, w, h, bpp, restartrows);
         }
         lodepng_free(padded);
       } else {
         /*we can immediately filter into the out buffer, no other steps needed*/
-        error = filter(*out, in, w, h, &info_png->color, settings);
+        if(bandrows) error = filterBands(*out, in, w, h, bandrows, &info_png->color, settings);
+        else error = filter(*out, in, w, h, &info_png->color, settings);
+        if(!error && restartrows) filterRestartRows(*out, in, w, h, bpp, restartrows);
       }
     }
   } else /*interlace_method is 1 (Adam7)*/ {
@@ -5387,6 +6911,9 @@ unsigned lodepng_encode(unsigned char** out, size_t* outsize,
                         LodePNGState* state) {
   unsigned char* data = 0; /*uncompressed version of the IDAT chunk data*/
   size_t datasize = 0;
+#ifdef LODEPNG_COMPILE_ZLIB
+  unsigned bandrows; /*scanlines per separately compressed band, 0 if none*/
+#endif /*LODEPNG_COMPILE_ZLIB*/
   ucvector outv;
   LodePNGInfo info;
 
@@ -5546,6 +7073,14 @@ unsigned lodepng_encode(unsigned char** out, size_t* outsize,
     }
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
     /*IDAT (multiple IDAT chunks must be consecutive)*/
+#ifdef LODEPNG_COMPILE_ZLIB
+    bandrows = getBandRows(w, h, &info, &state->encoder);
+    if(bandrows) {
+      state->error = addChunks_bandedIDAT(&outv, data, datasize, h, bandrows,
+                                          getRestartRows(h, &info, &state->encoder) != 0, &state->encoder);
+    }
+    else
+#endif /*LODEPNG_COMPILE_ZLIB*/
     state->error = addChunk_IDAT(&outv, data, datasize, &state->encoder.zlibsettings);
     if(state->error) goto cleanup;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
@@ -5664,6 +7199,8 @@ void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings) {
   settings->filter_strategy = LFS_MINSUM;
   settings->auto_convert = 1;
   settings->force_palette = 0;
+  settings->restart_segments = 0;
+  settings->num_threads = 1;
   settings->predefined_filters = 0;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
   settings->add_id = 0;
@@ -5671,6 +7208,40 @@ void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings) {
 #endif /*LODEPNG_COMPILE_ANCILLARY_CHUNKS*/
 }
 
+void lodepng_encoder_settings_preset(LodePNGEncoderSettings* settings, LodePNGEncoderPreset preset) {
+  /*start from the defaults of lodepng_encoder_settings_init and lodepng_compress_settings_init*/
+  settings->filter_palette_zero = 1;
+  settings->filter_strategy = LFS_MINSUM;
+  settings->num_threads = 1;
+  settings->zlibsettings.btype = 2;
+  settings->zlibsettings.use_lz77 = 1;
+  settings->zlibsettings.windowsize = 2048;
+  settings->zlibsettings.minmatch = 3;
+  settings->zlibsettings.nicematch = 128;
+  settings->zlibsettings.lazymatching = 1;
+  settings->zlibsettings.level = 0;
+  settings->zlibsettings.rle = 0;
+
+  switch(preset) {
+    case LEP_FAST:
+      settings->num_threads = 0;
+      settings->zlibsettings.windowsize = 32768;
+      settings->zlibsettings.level = 1;
+      break;
+    case LEP_SMALL:
+      settings->num_threads = 0;
+      settings->zlibsettings.windowsize = 32768;
+      settings->zlibsettings.level = 9;
+      break;
+    case LEP_REALTIME:
+      settings->num_threads = 0;
+      settings->filter_strategy = LFS_ZERO;
+      settings->zlibsettings.rle = 1;
+      break;
+    default: break; /*LEP_DEFAULT*/
+  }
+}
+
 #endif /*LODEPNG_COMPILE_ENCODER*/
 #endif /*LODEPNG_COMPILE_PNG*/
 
@@ -5786,6 +7357,8 @@ const char* lodepng_error_text(unsigned code) {
     case 102: return "not allowed to set grayscale ICC profile with colored pixels by PNG specification";
     case 103: return "invalid palette index in bKGD chunk. Maybe it came before PLTE chunk?";
     case 104: return "invalid bKGD color while encoding (e.g. palette index out of range)";
+    /*the reduce setting needs output without palette, with 8 or 16 bits per channel*/
+    case 105: return "reduced decoding only supports reduce up to 256 and 8 or 16 bit non-palette output";
   }
   return "unknown error code";
 }
@@ -5919,12 +7492,30 @@ unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h,
 #ifdef LODEPNG_COMPILE_DISK
 unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h, const std::string& filename,
                 LodePNGColorType colortype, unsigned bitdepth) {
-  std::vector<unsigned char> buffer;
+  const unsigned char* buffer;
+  size_t buffersize;
+  unsigned mapped;
+  /* safe output values in case error happens */
+  w = h = 0;
+  unsigned error = lodepng_map_file(&buffer, &buffersize, &mapped, filename.c_str());
+  if(error) return error;
+  error = decode(out, w, h, buffer, buffersize, colortype, bitdepth);
+  lodepng_unmap_file(buffer, buffersize, mapped);
+  return error;
+}
+
+unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h, State& state,
+                const std::string& filename) {
+  const unsigned char* buffer;
+  size_t buffersize;
+  unsigned mapped;
   /* safe output values in case error happens */
   w = h = 0;
-  unsigned error = load_file(buffer, filename);
+  unsigned error = lodepng_map_file(&buffer, &buffersize, &mapped, filename.c_str());
   if(error) return error;
-  return decode(out, w, h, buffer, colortype, bitdepth);
+  error = decode(out, w, h, state, buffer, buffersize);
+  lodepng_unmap_file(buffer, buffersize, mapped);
+  return error;
 }
 #endif /* LODEPNG_COMPILE_DECODER */
 #endif /* LODEPNG_COMPILE_DISK */
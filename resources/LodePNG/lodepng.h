@@ -82,6 +82,26 @@ source files with custom allocators.*/
 #define LODEPNG_COMPILE_ALLOCATORS
 #endif
 
+/*fast paths for the most common color conversions (gray, gray+alpha, RGB and palette to RGBA8,
+16-bit to 8-bit, single channel extraction). Without them every conversion goes through the
+generic per-pixel code, which is what lodepng_convert_test compares them against.*/
+#ifndef LODEPNG_NO_COMPILE_FAST_CONVERT
+#define LODEPNG_COMPILE_FAST_CONVERT
+#endif
+
+/*SIMD versions of the fast color conversions and of Adler-32. They are only used when the
+compiler targets SSE2 (always the case for x86-64), other platforms get the portable code either way.*/
+#ifndef LODEPNG_NO_COMPILE_SIMD
+#define LODEPNG_COMPILE_SIMD
+#endif
+
+/*multithreaded decoding of PNGs written with restart segments (see restart_segments in
+LodePNGEncoderSettings) and multithreaded encoding (see num_threads in LodePNGEncoderSettings).
+Needs C++11 std::thread, when compiled as C this is always serial.*/
+#ifndef LODEPNG_NO_COMPILE_THREADS
+#define LODEPNG_COMPILE_THREADS
+#endif
+
 /*compile the C++ version (you can disable the C++ wrapper here even when compiling for C++)*/
 #ifdef __cplusplus
 #ifndef LODEPNG_NO_COMPILE_CPP
@@ -295,6 +315,14 @@ struct LodePNGCompressSettings /*deflate = compress*/ {
   unsigned minmatch; /*mininum lz77 length. 3 is normally best, 6 can be better for some PNGs. Default: 0*/
   unsigned nicematch; /*stop searching if >= this length found. Set to 258 for best compression. Default: 128*/
   unsigned lazymatching; /*use lazy matching: better compression but a bit slower. Default: true*/
+  /*compression level 1 (fastest) to 9 (smallest), like zlib's. These bound the LZ77 search per level, override
+  nicematch and lazymatching and hash 4 bytes at a time, which suits RGBA data. 0 uses windowsize, nicematch
+  and lazymatching as they are, searching exhaustively for windowsize >= 8192. Use windowsize 32768 with
+  levels to allow the same matches zlib finds. Default: 0*/
+  unsigned level;
+  /*instead of full LZ77, only encode runs that repeat the previous 1 to 4 bytes (up to one pixel). Much faster
+  and much weaker, meant for real-time capture. Needs use_lz77. Default: false*/
+  unsigned rle;
 
   /*use custom zlib encoder instead of built in one (default: null)*/
   unsigned (*custom_zlib)(unsigned char**, size_t*,
@@ -629,6 +657,27 @@ typedef struct LodePNGDecoderSettings {
 
   unsigned color_convert; /*whether to convert the PNG to the color type you want. Default: yes*/
 
+  /*amount of threads used to inflate and unfilter PNGs that contain restart segments (a prSG chunk,
+  see restart_segments in LodePNGEncoderSettings). 0 means one per hardware thread, 1 decodes everything
+  on the calling thread. PNGs without restart segments are always decoded serially. Default: 0*/
+  unsigned num_threads;
+
+  /*decode the image box filtered to 1/reduce of its width and height (rounded up), e.g. 2, 4 or 8 for lower
+  quality tiers. The returned w and h are the reduced size, lodepng_inspect still gives the full one. Rows of
+  non-interlaced PNGs are reduced as they're inflated, so memory use follows the reduced size. Interlaced
+  PNGs, and PNGs decoded with custom zlib or inflate functions, are decoded in full and reduced after. The
+  output color type (info_raw, or the PNG's own without color_convert) must not use a palette and must have
+  8 or 16 bits per channel, and reduce can be at most 256. Default: 1, full size*/
+  unsigned reduce;
+
+  /*called while decoding an Adam7 interlaced PNG, once passes 1, 3 and 5 are inflated, with the image so far
+  at 1/8, 1/4 and 1/2 of the width and height (rounded up), in the color type of info_raw. Previews that are
+  already superseded when a deflate block ends are skipped, and the full image comes from decoding as usual.
+  It isn't called for non-interlaced PNGs or with custom zlib or inflate functions. A returned error code
+  stops decoding with that error. Default: NULL*/
+  unsigned (*adam7_preview)(const unsigned char* image, unsigned w, unsigned h, void* context);
+  void* adam7_preview_context; /*passed to adam7_preview*/
+
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
   unsigned read_text_chunks; /*if false but remember_unknown_chunks is true, they're stored in the unknown chunks*/
   /*store all bytes from unknown chunks in the LodePNGInfo (off by default, useful for a png editor)*/
@@ -713,6 +762,19 @@ typedef struct LodePNGEncoderSettings {
   /*force creating a PLTE chunk if colortype is 2 or 6 (= a suggested palette).
   If colortype is 3, PLTE is _always_ created.*/
   unsigned force_palette;
+
+  /*split the image data in this many independently compressed bands of scanlines, so that the decoder can
+  inflate and unfilter them in parallel. The IDAT data stays a single valid zlib stream (each band ends with
+  an empty stored block and starts without back references), and the band offsets go in a private ancillary
+  prSG chunk that other decoders skip. Costs a little compression ratio. 0 or 1 disables it, ignored for
+  interlaced images. Default: 0*/
+  unsigned restart_segments;
+
+  /*amount of threads to filter and compress non-interlaced images with, 0 means one per hardware thread.
+  If not 1, the image data is compressed in bands of scanlines, each band using the end of the previous one
+  as preset dictionary (like pigz), which keeps it a single zlib stream at nearly the same compression ratio.
+  The output only depends on whether this is 1, not on the actual amount of threads. Default: 1*/
+  unsigned num_threads;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
   /*add LodePNG identifier and version as a text chunk, for debugging*/
   unsigned add_id;
@@ -722,6 +784,21 @@ typedef struct LodePNGEncoderSettings {
 } LodePNGEncoderSettings;
 
 void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings);
+
+/*speed versus compression ratio presets for lodepng_encoder_settings_preset*/
+typedef enum LodePNGEncoderPreset {
+  /*same as lodepng_encoder_settings_init: single threaded, balanced speed and ratio*/
+  LEP_DEFAULT,
+  /*multithreaded, compression level 1*/
+  LEP_FAST,
+  /*multithreaded, compression level 9, for baked assets where size matters*/
+  LEP_SMALL,
+  /*multithreaded, no filtering and run-length encoding only, for capturing video frames*/
+  LEP_REALTIME
+} LodePNGEncoderPreset;
+
+/*sets the filter, zlib and threading settings for the preset, leaves the others (such as auto_convert) alone*/
+void lodepng_encoder_settings_preset(LodePNGEncoderSettings* settings, LodePNGEncoderPreset preset);
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
 
@@ -948,6 +1025,22 @@ return value: error code (0 means ok)
 */
 unsigned lodepng_load_file(unsigned char** out, size_t* outsize, const char* filename);
 
+/*
+Make a file from disk readable in memory without copying it, for decoding straight
+from the page cache. Regular files are memory mapped read-only where the platform
+supports it, anything else (pipes, empty files, other platforms) is read into an
+allocated buffer instead. Release it with lodepng_unmap_file.
+out: output parameter, contains pointer to the file contents.
+outsize: output parameter, size of the file contents
+mapped: output parameter, whether out is mapped (1) or allocated (0), give it to lodepng_unmap_file
+filename: the path to the file to load
+return value: error code (0 means ok)
+*/
+unsigned lodepng_map_file(const unsigned char** out, size_t* outsize, unsigned* mapped, const char* filename);
+
+/*Release file contents from lodepng_map_file, with the same size and mapped values.*/
+void lodepng_unmap_file(const unsigned char* buffer, size_t buffersize, unsigned mapped);
+
 /*
 Save a file from buffer to disk. Warning, if it exists, this function overwrites
 the file without warning!
@@ -979,6 +1072,12 @@ unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h,
 unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h,
                 State& state,
                 const std::vector<unsigned char>& in);
+#ifdef LODEPNG_COMPILE_DISK
+/* Decodes the PNG file straight from its memory mapping where possible, see lodepng_map_file. */
+unsigned decode(std::vector<unsigned char>& out, unsigned& w, unsigned& h,
+                State& state,
+                const std::string& filename);
+#endif /*LODEPNG_COMPILE_DISK*/
 #endif /*LODEPNG_COMPILE_DECODER*/
 
 #ifdef LODEPNG_COMPILE_ENCODER
@@ -1730,6 +1829,9 @@ state.decoder.ignore_end: ignore missing IEND chunk. May fail if this corruption
 state.decoder.color_convert: convert internal PNG color to chosen one
 state.decoder.read_text_chunks: whether to read in text metadata chunks
 state.decoder.remember_unknown_chunks: whether to read in unknown chunks
+state.decoder.num_threads: threads for decoding PNGs with restart segments
+state.decoder.reduce: decode box filtered to a half, quarter, ... of the size
+state.decoder.adam7_preview: callback with low resolution previews of interlaced PNGs while decoding
 state.info_raw.colortype: desired color type for decoded image
 state.info_raw.bitdepth: desired bit depth for decoded image
 state.info_raw....: more color settings, see struct LodePNGColorMode
@@ -1743,11 +1845,15 @@ state.encoder.zlibsettings.windowsize: tweak LZ77 windowsize
 state.encoder.zlibsettings.minmatch: tweak min LZ77 length to match
 state.encoder.zlibsettings.nicematch: tweak LZ77 match where to stop searching
 state.encoder.zlibsettings.lazymatching: try one more LZ77 matching
+state.encoder.zlibsettings.level: LZ77 search effort from 1 (fast) to 9 (small)
+state.encoder.zlibsettings.rle: only encode runs of repeated pixels, for real-time use
 state.encoder.zlibsettings.custom_...: use custom deflate function
 state.encoder.auto_convert: choose optimal PNG color type, if 0 uses info_png
 state.encoder.filter_palette_zero: PNG filter strategy for palette
 state.encoder.filter_strategy: PNG filter strategy to encode with
 state.encoder.force_palette: add palette even if not encoding to one
+state.encoder.restart_segments: split image data in bands that decode in parallel
+state.encoder.num_threads: filter and compress in bands on multiple threads
 state.encoder.add_id: add LodePNG identifier and version as a text chunk
 state.encoder.text_compression: use compressed text chunks for metadata
 state.info_raw.colortype: color type of raw input image you provide
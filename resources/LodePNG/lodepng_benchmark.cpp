@@ -0,0 +1,97 @@
+/*
+LodePNG Benchmark
+
+Encodes PNG images with the default compression settings and with every compression level, and prints
+the speed in MB/s of raw RGBA input and the ratio of compressed to raw size for each. Every result is
+decoded again to check it's lossless.
+
+Build and run from the repository root:
+  make bench
+  ./bench resources/textures/height/<file>.png resources/textures/<file>.png
+with any number of files, e.g. every png in those directories.
+*/
+
+#include "lodepng.h"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+struct Totals {
+  double seconds = 0;
+  size_t raw = 0, compressed = 0;
+};
+
+/*encodes the image with the given settings, returns 0 if it also decodes back to the same pixels*/
+static unsigned encodeTimed(std::vector<unsigned char>& png, double& seconds, const std::vector<unsigned char>& image,
+                            unsigned w, unsigned h, const LodePNGCompressSettings& zlibsettings) {
+  lodepng::State state;
+  state.encoder.zlibsettings = zlibsettings;
+
+  auto start = std::chrono::steady_clock::now();
+  unsigned error = lodepng::encode(png, image, w, h, state);
+  seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  if(error) return error;
+
+  std::vector<unsigned char> decoded;
+  unsigned dw, dh;
+  error = lodepng::decode(decoded, dw, dh, png);
+  if(!error && decoded != image) error = 1000; /*not lossless*/
+  return error;
+}
+
+int main(int argc, char* argv[]) {
+  if(argc < 2) {
+    std::printf("usage: %s image.png [image.png ...]\n", argv[0]);
+    return 1;
+  }
+
+  /*configuration 0 is the current default, 1 to 9 are the compression levels with the full window*/
+  std::vector<std::string> names;
+  std::vector<LodePNGCompressSettings> configs;
+  names.push_back("default");
+  configs.push_back(lodepng_default_compress_settings);
+  for(unsigned level = 1; level <= 9; ++level) {
+    LodePNGCompressSettings settings = lodepng_default_compress_settings;
+    settings.windowsize = 32768;
+    settings.level = level;
+    names.push_back("level " + std::to_string(level));
+    configs.push_back(settings);
+  }
+
+  std::vector<Totals> totals(configs.size());
+  for(int i = 1; i < argc; ++i) {
+    std::vector<unsigned char> image;
+    unsigned w, h;
+    unsigned error = lodepng::decode(image, w, h, argv[i]);
+    if(error) {
+      std::printf("%s: %s\n", argv[i], lodepng_error_text(error));
+      continue;
+    }
+
+    std::printf("%s (%ux%u)\n", argv[i], w, h);
+    for(size_t c = 0; c != configs.size(); ++c) {
+      std::vector<unsigned char> png;
+      double seconds;
+      error = encodeTimed(png, seconds, image, w, h, configs[c]);
+      if(error) {
+        std::printf("  %-8s error %u\n", names[c].c_str(), error);
+        continue;
+      }
+      std::printf("  %-8s %8.2f MB/s  ratio %.4f  %zu bytes\n", names[c].c_str(),
+                  image.size() / seconds / 1e6, (double)png.size() / image.size(), png.size());
+      totals[c].seconds += seconds;
+      totals[c].raw += image.size();
+      totals[c].compressed += png.size();
+    }
+  }
+
+  std::printf("total\n");
+  for(size_t c = 0; c != configs.size(); ++c) {
+    if(totals[c].raw == 0) continue;
+    std::printf("  %-8s %8.2f MB/s  ratio %.4f\n", names[c].c_str(),
+                totals[c].raw / totals[c].seconds / 1e6, (double)totals[c].compressed / totals[c].raw);
+  }
+  return 0;
+}
@@ -0,0 +1,208 @@
+/*
+LodePNG Color Conversion Test
+
+Checks the fast paths of lodepng_convert against the generic per-pixel code they stand in for:
+8-bit gray, gray+alpha, RGB and palette to RGBA8, 16-bit to 8-bit narrowing and extraction of
+the first channel to 8-bit gray. Random images of every width from 1 to 70 pixels and a larger
+one are converted by both, from unaligned addresses, and have to come out byte for byte the same.
+With --bench it also times both on a 2048x2048 image.
+
+Build and run from the repository root:
+  make convert_test
+  ./convert_test
+  ./convert_test --bench
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*Two copies of the library, each in its own namespace: fast as it's normally built and generic
+without the fast conversions. The headers they include are all included before, so only the
+library itself ends up in the namespaces.*/
+#include <string.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#include <atomic>
+#include <thread>
+
+namespace fast {
+#include "lodepng.cpp"
+}
+
+#undef LODEPNG_H
+#undef LODEPNG_COMPILE_FAST_CONVERT
+#define LODEPNG_NO_COMPILE_FAST_CONVERT
+namespace generic {
+#include "lodepng.cpp"
+}
+
+using namespace fast;
+
+struct Conversion {
+  const char* name;
+  LodePNGColorType in_type;
+  unsigned in_depth;
+  LodePNGColorType out_type;
+  unsigned out_depth;
+  bool key; /*a color key on the input, which the fast paths leave to the generic code*/
+};
+
+static const Conversion conversions[] = {
+  {"G8 to RGBA8", LCT_GREY, 8, LCT_RGBA, 8, false},
+  {"G8 with key to RGBA8", LCT_GREY, 8, LCT_RGBA, 8, true},
+  {"GA8 to RGBA8", LCT_GREY_ALPHA, 8, LCT_RGBA, 8, false},
+  {"RGB8 to RGBA8", LCT_RGB, 8, LCT_RGBA, 8, false},
+  {"RGB8 with key to RGBA8", LCT_RGB, 8, LCT_RGBA, 8, true},
+  {"palette8 to RGBA8", LCT_PALETTE, 8, LCT_RGBA, 8, false},
+  {"RGBA16 to RGBA8", LCT_RGBA, 16, LCT_RGBA, 8, false},
+  {"G16 to G8", LCT_GREY, 16, LCT_GREY, 8, false},
+  {"G16 with key to G8", LCT_GREY, 16, LCT_GREY, 8, true},
+  {"GA16 to GA8", LCT_GREY_ALPHA, 16, LCT_GREY_ALPHA, 8, false},
+  {"RGB16 to RGB8", LCT_RGB, 16, LCT_RGB, 8, false},
+  {"GA8 to G8", LCT_GREY_ALPHA, 8, LCT_GREY, 8, false},
+  {"RGB8 to G8", LCT_RGB, 8, LCT_GREY, 8, false},
+  {"RGBA8 to G8", LCT_RGBA, 8, LCT_GREY, 8, false},
+  {"GA16 to G8", LCT_GREY_ALPHA, 16, LCT_GREY, 8, false},
+  {"RGB16 to G8", LCT_RGB, 16, LCT_GREY, 8, false},
+  {"RGBA16 to G8", LCT_RGBA, 16, LCT_GREY, 8, false}
+};
+
+/*the same random numbers every run*/
+static unsigned random32() {
+  static unsigned state = 2463534242u;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+/*The palette has 200 colors, so some of the random indices are out of range and come out black.
+The color key is one of the random values, a byte repeated, so some pixels match it. Mode is
+either library's color mode, their functions are found through it.*/
+template<class Mode>
+static void setModes(Mode& mode_in, Mode& mode_out, const Conversion& c) {
+  lodepng_color_mode_init(&mode_in);
+  lodepng_color_mode_init(&mode_out);
+  mode_in.colortype = (decltype(mode_in.colortype))c.in_type;
+  mode_in.bitdepth = c.in_depth;
+  mode_out.colortype = (decltype(mode_out.colortype))c.out_type;
+  mode_out.bitdepth = c.out_depth;
+  if(c.in_type == LCT_PALETTE) {
+    for(unsigned i = 0; i != 200; ++i) {
+      lodepng_palette_add(&mode_in, (unsigned char)(i * 7), (unsigned char)(i * 13),
+                          (unsigned char)(i * 31), (unsigned char)(255 - i));
+    }
+  }
+  if(c.key) {
+    mode_in.key_defined = 1;
+    mode_in.key_r = mode_in.key_g = mode_in.key_b = c.in_depth == 16 ? 0x5a5a : 0x5a;
+  }
+}
+
+/*Random pixels, with about one in eight bytes the color key's, so keyed pixels show up.
+The copy starts one byte into the buffer, so it isn't aligned.*/
+static std::vector<unsigned char> randomImage(size_t size) {
+  std::vector<unsigned char> image(size + 1);
+  for(size_t i = 1; i != image.size(); ++i) {
+    unsigned r = random32();
+    image[i] = (r & 7) == 0 ? 0x5a : (unsigned char)(r >> 8);
+  }
+  return image;
+}
+
+template<class Mode>
+static unsigned convertWith(std::vector<unsigned char>& out, const std::vector<unsigned char>& in,
+                            const Conversion& c, unsigned w, unsigned h) {
+  Mode mode_in, mode_out;
+  setModes(mode_in, mode_out, c);
+  out.resize(lodepng_get_raw_size(w, h, &mode_out) + 1);
+  unsigned error = lodepng_convert(&out[1], &in[1], &mode_out, &mode_in, w, h);
+  lodepng_color_mode_cleanup(&mode_in);
+  lodepng_color_mode_cleanup(&mode_out);
+  return error;
+}
+
+/*converts a random image with both and returns whether they agree*/
+static bool check(const Conversion& c, unsigned w, unsigned h) {
+  LodePNGColorMode mode_in;
+  lodepng_color_mode_init(&mode_in);
+  mode_in.colortype = c.in_type;
+  mode_in.bitdepth = c.in_depth;
+  std::vector<unsigned char> in = randomImage(lodepng_get_raw_size(w, h, &mode_in));
+
+  std::vector<unsigned char> out, generic_out;
+  unsigned error = convertWith<fast::LodePNGColorMode>(out, in, c, w, h);
+  unsigned generic_error = convertWith<generic::LodePNGColorMode>(generic_out, in, c, w, h);
+  if(error != generic_error) {
+    std::printf("%s at %ux%u: error %u, the generic code gives %u\n", c.name, w, h, error, generic_error);
+    return false;
+  }
+  for(size_t i = 1; i != out.size(); ++i) {
+    if(out[i] != generic_out[i]) {
+      std::printf("%s at %ux%u: byte %zu is %u, the generic code gives %u\n",
+                  c.name, w, h, i - 1, out[i], generic_out[i]);
+      return false;
+    }
+  }
+  return true;
+}
+
+/*the fastest of a few runs, in milliseconds, after the first has sized the output*/
+template<class Mode>
+static double timeWith(const std::vector<unsigned char>& in, const Conversion& c, unsigned w, unsigned h) {
+  double best = 0;
+  std::vector<unsigned char> out;
+  for(int run = 0; run != 5; ++run) {
+    auto start = std::chrono::steady_clock::now();
+    convertWith<Mode>(out, in, c, w, h);
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    if(run == 0 || ms < best) best = ms;
+  }
+  return best;
+}
+
+int main(int argc, char* argv[]) {
+  bool bench = argc > 1 && std::string(argv[1]) == "--bench";
+  const size_t count = sizeof(conversions) / sizeof(*conversions);
+
+  unsigned failed = 0;
+  for(size_t c = 0; c != count; ++c) {
+    bool ok = check(conversions[c], 333, 97);
+    for(unsigned w = 1; ok && w <= 70; ++w) ok = check(conversions[c], w, 1) && check(conversions[c], w, 3);
+    std::printf("  %-24s %s\n", conversions[c].name, ok ? "ok" : "FAILED");
+    if(!ok) ++failed;
+  }
+  if(failed) {
+    std::printf("%u of %zu conversions differ from the generic code\n", failed, count);
+    return 1;
+  }
+  std::printf("all %zu conversions match the generic code\n", count);
+
+  if(bench) {
+    const unsigned w = 2048, h = 2048;
+    std::printf("2048x2048, fastest of 5 runs\n");
+    for(size_t c = 0; c != count; ++c) {
+      LodePNGColorMode mode_in;
+      lodepng_color_mode_init(&mode_in);
+      mode_in.colortype = conversions[c].in_type;
+      mode_in.bitdepth = conversions[c].in_depth;
+      std::vector<unsigned char> in = randomImage(lodepng_get_raw_size(w, h, &mode_in));
+
+      double ms = timeWith<fast::LodePNGColorMode>(in, conversions[c], w, h);
+      double generic_ms = timeWith<generic::LodePNGColorMode>(in, conversions[c], w, h);
+      std::printf("  %-24s %8.2f ms  generic %8.2f ms  %5.1fx\n", conversions[c].name, ms, generic_ms, generic_ms / ms);
+    }
+  }
+  return 0;
+}
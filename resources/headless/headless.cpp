@@ -0,0 +1,108 @@
+//******************************************************************************
+//  File: headless.cpp
+//
+//  Description: The EGL context and frame time statistics of the headless
+//    benchmark, see headless.h.
+//
+//  Date: 19 October 2026
+//******************************************************************************
+#include "headless.h"
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+
+bool headless_create_context(int major, int minor, std::string& error) {
+	// the surfaceless platform, or whatever the default display is without it
+	PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if(get_platform_display)
+		display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if(display == EGL_NO_DISPLAY)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if(display == EGL_NO_DISPLAY || !eglInitialize(display, NULL, NULL)) {
+		error = "couldn't initialize EGL";
+		return false;
+	}
+
+	const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+	if(!extensions || !std::strstr(extensions, "EGL_KHR_surfaceless_context")) {
+		error = "EGL can't make a context current without a surface";
+		return false;
+	}
+	if(!eglBindAPI(EGL_OPENGL_API)) {
+		error = "EGL doesn't do desktop OpenGL";
+		return false;
+	}
+
+	// a config only matters for surfaces, so take none if EGL allows it
+	EGLConfig config = (EGLConfig)0;
+	if(!std::strstr(extensions, "EGL_KHR_no_config_context")) {
+		EGLint config_attributes[] = {EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+		EGLint count = 0;
+		if(!eglChooseConfig(display, config_attributes, &config, 1, &count) || count == 0) {
+			error = "no EGL config renders OpenGL";
+			return false;
+		}
+	}
+
+	EGLint attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, major,
+		EGL_CONTEXT_MINOR_VERSION, minor,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	context = eglCreateContext(display, config, EGL_NO_CONTEXT, attributes);
+	if(context == EGL_NO_CONTEXT) {
+		char version[64];
+		std::snprintf(version, sizeof(version), "couldn't create an OpenGL %d.%d core context", major, minor);
+		error = version;
+		return false;
+	}
+	if(!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+		error = "couldn't make the context current";
+		return false;
+	}
+	return true;
+}
+
+void headless_destroy_context() {
+	if(display == EGL_NO_DISPLAY)
+		return;
+	eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if(context != EGL_NO_CONTEXT)
+		eglDestroyContext(display, context);
+	eglTerminate(display);
+	context = EGL_NO_CONTEXT;
+	display = EGL_NO_DISPLAY;
+}
+
+// the value at fraction p of the sorted times, nearest rank
+static double percentile(const std::vector<double>& sorted, double p) {
+	size_t rank = (size_t)(p * sorted.size() + 0.5);
+	return sorted[std::min(rank == 0 ? 0 : rank - 1, sorted.size() - 1)];
+}
+
+void headless_report(const std::vector<double>& frame_ms) {
+	if(frame_ms.empty())
+		return;
+	std::vector<double> sorted(frame_ms);
+	std::sort(sorted.begin(), sorted.end());
+	double total = 0.0;
+	for(size_t i = 0; i != sorted.size(); ++i)
+		total += sorted[i];
+	double mean = total / sorted.size();
+
+	std::printf("%zu frames, %.3f ms mean, %.1f fps\n", sorted.size(), mean, 1000.0 / mean);
+	std::printf("  median %8.3f ms\n", percentile(sorted, 0.5));
+	std::printf("  p95    %8.3f ms\n", percentile(sorted, 0.95));
+	std::printf("  p99    %8.3f ms\n", percentile(sorted, 0.99));
+	std::printf("  min    %8.3f ms\n", sorted.front());
+	std::printf("  max    %8.3f ms\n", sorted.back());
+}
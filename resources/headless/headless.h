@@ -0,0 +1,42 @@
+//******************************************************************************
+//  File: headless.h
+//
+//  Description: What the --headless benchmark needs besides the scene: a GL
+//    context without a window, and the statistics of its frame times.
+//
+//    The context comes from EGL's surfaceless platform, which needs neither
+//    a display server nor a GPU. Under Mesa it renders with llvmpipe when
+//    there's no hardware, or when LIBGL_ALWAYS_SOFTWARE=1 asks for it, so
+//    machines without GPUs can run the same benchmark. There's no default
+//    framebuffer, so the frames are drawn into a framebuffer object.
+//
+//  Date: 19 October 2026
+//******************************************************************************
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <string>
+#include <vector>
+
+//****************************************************************************
+//  Function: headless_create_context
+//
+//  Purpose:
+//    Makes a core profile context of that version current on this thread,
+//    with no surface. Returns false and says why in error if it can't.
+//****************************************************************************
+bool headless_create_context(int major, int minor, std::string& error);
+
+// releases the context and EGL
+void headless_destroy_context();
+
+//****************************************************************************
+//  Function: headless_report
+//
+//  Purpose:
+//    Prints the mean, median, 95th and 99th percentiles, the fastest and
+//    slowest of the frame times, in milliseconds, and the mean frame rate.
+//****************************************************************************
+void headless_report(const std::vector<double>& frame_ms);
+
+#endif
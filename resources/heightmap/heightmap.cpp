@@ -0,0 +1,659 @@
+//******************************************************************************
+//  File: heightmap.cpp
+//
+//  Description: The heightmap codec, see heightmap.h.
+//
+//    File layout, numbers are little endian:
+//      "VHM2", u32 width, u32 height, u8 bitdepth, u8 channels, u16 tilesize
+//      u32 size and u32 CRC-32 of the file it was encoded from, or 0 and 0
+//      u32 offset of each tile, then of the end of the last one
+//      the tiles, left to right and top to bottom
+//
+//    A tile holds each of its channels in turn, as:
+//      u8 predictor, u8 number of tokens, the token frequencies as varints,
+//      u32 size of the rANS stream, u32 size of the extra bits, then both
+//
+//    With three or four channels, the second and third are coded as their
+//    difference from the first, which is 0 for grey pixels.
+//
+//  Date: 19 October 2026
+//******************************************************************************
+#include "heightmap.h"
+#include "../LodePNG/lodepng.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HEIGHTMAP_SSE2
+#endif
+
+#define HEADER_SIZE 24
+
+enum Predictor {PREDICT_GRADIENT = 0, PREDICT_MEDIAN = 1};
+
+// residuals are zigzagged so small ones of either sign are small numbers, then
+// split in a token for the entropy coder and extra bits stored as they are.
+// Tokens 0 to 15 are the numbers themselves, the rest give the position of
+// the highest bit and the bit below it
+#define NUM_TOKENS 40
+
+// rANS with 12 bit probabilities, 32 bit states and 16 bit renormalization,
+// which reads at most one word for each token
+#define RANS_SCALE_BITS 12
+#define RANS_SCALE (1u << RANS_SCALE_BITS)
+#define RANS_L (1u << 16)
+#define RANS_LANES 4
+
+static inline unsigned token_extra_bits(unsigned token) {
+	return token < 16 ? 0 : (token - 16) / 2 + 3;
+}
+
+static inline unsigned token_base(unsigned token) {
+	if(token < 16)
+		return token;
+	unsigned n = (token - 16) / 2 + 4;
+	return (1u << n) | ((token & 1) << (n - 1));
+}
+
+static inline unsigned token_of(unsigned z) {
+	if(z < 16)
+		return z;
+	unsigned n = 4;
+	while(z >> (n + 1))
+		++n;
+	return 16 + 2 * (n - 4) + ((z >> (n - 1)) & 1);
+}
+
+static inline unsigned read32(const unsigned char* p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned)p[3] << 24);
+}
+
+static inline void write32(std::vector<unsigned char>& out, unsigned value) {
+	for(unsigned i = 0; i != 4; ++i)
+		out.push_back((unsigned char)(value >> (8 * i)));
+}
+
+static inline void set32(unsigned char* p, unsigned value) {
+	for(unsigned i = 0; i != 4; ++i)
+		p[i] = (unsigned char)(value >> (8 * i));
+}
+
+// the median of a, b and a + b - c, which is the gradient clamped between
+// the left and up pixels. Written without branches, as they'd mispredict
+static inline unsigned predict_median(unsigned a, unsigned b, unsigned c) {
+	int lo = std::min(a, b), hi = std::max(a, b);
+	return (unsigned)std::max(lo, std::min(hi, (int)(a + b) - (int)c));
+}
+
+//****************************************************************************
+//  Tiles are worked on as planes of one channel, with a zero row above and a
+//  zero column left of them. Every pixel then has the same neighbours to
+//  predict from, and tiles don't depend on each other.
+//****************************************************************************
+
+// gets the plane of channel c of a tile, as the codec sees it
+static void load_plane(std::vector<unsigned>& plane, const unsigned char* samples, unsigned width,
+                       unsigned channels, unsigned bitdepth, unsigned c,
+                       unsigned x0, unsigned y0, unsigned tw, unsigned th) {
+	unsigned stride = tw + 1, bytes = bitdepth / 8, mask = (1u << bitdepth) - 1;
+	bool difference = channels >= 3 && (c == 1 || c == 2);
+	plane.assign((size_t)stride * (th + 1), 0);
+	for(unsigned y = 0; y != th; ++y) {
+		unsigned* row = &plane[(size_t)(y + 1) * stride + 1];
+		for(unsigned x = 0; x != tw; ++x) {
+			const unsigned char* p = &samples[(((size_t)(y0 + y) * width + x0 + x) * channels) * bytes];
+			unsigned value = bytes == 1 ? p[c] : (p[2 * c] << 8) | p[2 * c + 1];
+			if(difference)
+				value = (value - (bytes == 1 ? p[0] : (p[0] << 8) | p[1])) & mask;
+			row[x] = value;
+		}
+	}
+}
+
+// zigzagged prediction residuals of a plane
+static void plane_residuals(std::vector<unsigned>& z, const std::vector<unsigned>& plane,
+                            unsigned tw, unsigned th, unsigned bitdepth, unsigned predictor) {
+	unsigned stride = tw + 1, mask = (1u << bitdepth) - 1, half = 1u << (bitdepth - 1);
+	z.resize((size_t)tw * th);
+	size_t i = 0;
+	for(unsigned y = 0; y != th; ++y) {
+		const unsigned* row = &plane[(size_t)(y + 1) * stride + 1];
+		const unsigned* up = row - stride;
+		for(unsigned x = 0; x != tw; ++x) {
+			unsigned a = row[(int)x - 1], b = up[x], c = up[(int)x - 1];
+			unsigned prediction = predictor == PREDICT_GRADIENT ? a + b - c : predict_median(a, b, c);
+			unsigned r = (row[x] - prediction) & mask;
+			z[i++] = r < half ? 2 * r : 2 * (mask - r) + 1;
+		}
+	}
+}
+
+// scales token counts to frequencies that add up to RANS_SCALE, keeping every
+// token that occurs at least 1
+static void normalize_frequencies(unsigned freq[NUM_TOKENS], const size_t count[NUM_TOKENS], size_t total) {
+	unsigned sum = 0, largest = 0;
+	for(unsigned t = 0; t != NUM_TOKENS; ++t) {
+		freq[t] = 0;
+		if(count[t] == 0)
+			continue;
+		freq[t] = (unsigned)((uint64_t)count[t] * RANS_SCALE / total);
+		if(freq[t] == 0)
+			freq[t] = 1;
+		sum += freq[t];
+		if(freq[t] > freq[largest])
+			largest = t;
+	}
+	// at most NUM_TOKENS were rounded up, so the largest can always make up
+	// the difference
+	freq[largest] += RANS_SCALE - sum;
+}
+
+// estimated size in bits of residuals with the frequencies they'd get
+static double estimate_bits(const std::vector<unsigned>& z) {
+	size_t count[NUM_TOKENS] = {0};
+	double bits = 0;
+	for(size_t i = 0; i != z.size(); ++i) {
+		unsigned t = token_of(z[i]);
+		++count[t];
+		bits += token_extra_bits(t);
+	}
+	unsigned freq[NUM_TOKENS];
+	normalize_frequencies(freq, count, z.size());
+	for(unsigned t = 0; t != NUM_TOKENS; ++t)
+		if(count[t])
+			bits += count[t] * std::log2((double)RANS_SCALE / freq[t]);
+	return bits;
+}
+
+//****************************************************************************
+//  Function: write_channel
+//
+//  Purpose:
+//    Entropy codes the residuals of one channel of a tile. The rANS coders
+//    take turns, each one gets every fourth token. They're encoded backwards
+//    so the decoder reads the stream front to back.
+//****************************************************************************
+static void write_channel(std::vector<unsigned char>& out, const std::vector<unsigned>& z, unsigned predictor) {
+	size_t n = z.size();
+	std::vector<unsigned char> tokens(n);
+	size_t count[NUM_TOKENS] = {0};
+	for(size_t i = 0; i != n; ++i)
+		++count[tokens[i] = (unsigned char)token_of(z[i])];
+
+	unsigned freq[NUM_TOKENS], start[NUM_TOKENS];
+	normalize_frequencies(freq, count, n);
+	unsigned used = NUM_TOKENS;
+	while(freq[used - 1] == 0)
+		--used;
+
+	out.push_back((unsigned char)predictor);
+	out.push_back((unsigned char)used);
+	for(unsigned t = 0, sum = 0; t != used; ++t) {
+		start[t] = sum;
+		sum += freq[t];
+		unsigned f = freq[t];
+		for(; f >= 128; f >>= 7)
+			out.push_back((unsigned char)(f | 128));
+		out.push_back((unsigned char)f);
+	}
+
+	// a token takes at most one word, and each coder flushes 4 bytes
+	std::vector<unsigned char> rans(2 * n + 4 * RANS_LANES);
+	unsigned char* end = &rans[0] + rans.size();
+	unsigned char* p = end;
+	uint32_t state[RANS_LANES] = {RANS_L, RANS_L, RANS_L, RANS_L};
+	for(size_t i = n; i-- != 0;) {
+		uint32_t& x = state[i % RANS_LANES];
+		unsigned t = tokens[i];
+		if(x >= ((uint64_t)(RANS_L >> RANS_SCALE_BITS) << 16) * freq[t]) {
+			p -= 2;
+			p[0] = (unsigned char)x;
+			p[1] = (unsigned char)(x >> 8);
+			x >>= 16;
+		}
+		x = ((x / freq[t]) << RANS_SCALE_BITS) + x % freq[t] + start[t];
+	}
+	for(unsigned lane = RANS_LANES; lane-- != 0;) {
+		p -= 4;
+		set32(p, state[lane]);
+	}
+
+	std::vector<unsigned char> extra;
+	uint64_t buffer = 0;
+	unsigned buffered = 0;
+	for(size_t i = 0; i != n; ++i) {
+		unsigned bits = token_extra_bits(tokens[i]);
+		if(bits == 0)
+			continue;
+		buffer |= (uint64_t)(z[i] & ((1u << bits) - 1)) << buffered;
+		for(buffered += bits; buffered >= 8; buffered -= 8) {
+			extra.push_back((unsigned char)buffer);
+			buffer >>= 8;
+		}
+	}
+	if(buffered)
+		extra.push_back((unsigned char)buffer);
+
+	write32(out, (unsigned)(end - p));
+	write32(out, (unsigned)extra.size());
+	out.insert(out.end(), p, end);
+	out.insert(out.end(), extra.begin(), extra.end());
+}
+
+unsigned heightmap_encode(std::vector<unsigned char>& out, const unsigned char* samples,
+                          unsigned width, unsigned height, unsigned channels, unsigned bitdepth,
+                          unsigned tilesize, const unsigned char* source, size_t sourcesize) {
+	if((bitdepth != 8 && bitdepth != 16) || channels < 1 || channels > 4
+	   || width == 0 || height == 0 || tilesize == 0 || tilesize > 65535)
+		return 6;
+
+	unsigned tilesx = (width + tilesize - 1) / tilesize, tilesy = (height + tilesize - 1) / tilesize;
+	size_t tiles = (size_t)tilesx * tilesy;
+	out.assign((const unsigned char*)"VHM2", (const unsigned char*)"VHM2" + 4);
+	write32(out, width);
+	write32(out, height);
+	out.push_back((unsigned char)bitdepth);
+	out.push_back((unsigned char)channels);
+	out.push_back((unsigned char)tilesize);
+	out.push_back((unsigned char)(tilesize >> 8));
+	write32(out, source ? (unsigned)sourcesize : 0);
+	write32(out, source ? lodepng_crc32(source, sourcesize) : 0);
+	out.resize(HEADER_SIZE + 4 * (tiles + 1));
+
+	std::vector<unsigned> plane, gradient, median;
+	for(size_t i = 0; i != tiles; ++i) {
+		unsigned x0 = (unsigned)(i % tilesx) * tilesize, y0 = (unsigned)(i / tilesx) * tilesize;
+		unsigned tw = std::min(tilesize, width - x0), th = std::min(tilesize, height - y0);
+		set32(&out[HEADER_SIZE + 4 * i], (unsigned)out.size());
+		for(unsigned c = 0; c != channels; ++c) {
+			load_plane(plane, samples, width, channels, bitdepth, c, x0, y0, tw, th);
+			plane_residuals(gradient, plane, tw, th, bitdepth, PREDICT_GRADIENT);
+			plane_residuals(median, plane, tw, th, bitdepth, PREDICT_MEDIAN);
+			if(estimate_bits(median) < estimate_bits(gradient))
+				write_channel(out, median, PREDICT_MEDIAN);
+			else
+				write_channel(out, gradient, PREDICT_GRADIENT);
+		}
+	}
+	set32(&out[HEADER_SIZE + 4 * tiles], (unsigned)out.size());
+	return 0;
+}
+
+//****************************************************************************
+//  Decoding
+//****************************************************************************
+
+// what the decoder needs to know for each of the RANS_SCALE slots, where
+// offset is the position of the slot in the range of its token
+struct Symbol {
+	uint16_t freq, offset;
+	uint16_t base, bits;
+};
+
+// reads the extra bits, with zeros past the end of the stream
+struct BitReader {
+	const unsigned char* p;
+	const unsigned char* end;
+	uint64_t buffer;
+	unsigned buffered, overrun;
+
+	BitReader(const unsigned char* begin, const unsigned char* e) : p(begin), end(e), buffer(0), buffered(0), overrun(0) {}
+
+	inline unsigned read(unsigned bits) {
+		if(buffered < bits) {
+			for(; buffered <= 56; buffered += 8) {
+				if(p != end)
+					buffer |= (uint64_t)*p++ << buffered;
+				else
+					++overrun;
+			}
+		}
+		unsigned value = (unsigned)buffer & ((1u << bits) - 1);
+		buffer >>= bits;
+		buffered -= bits;
+		return value;
+	}
+
+	// whether it gave out more bits than the stream has
+	bool overran() const {return overrun * 8 > buffered;}
+};
+
+//****************************************************************************
+//  Function: read_channel
+//
+//  Purpose:
+//    Decodes the residuals of one channel of a tile, and moves in past them.
+//    T is as wide as the samples, so storing the unzigzagged residual wraps
+//    it around like the encoder did.
+//****************************************************************************
+template<typename T>
+static unsigned read_channel(T* residuals, size_t n, unsigned& predictor,
+                             const unsigned char*& in, const unsigned char* end) {
+	if(end - in < 2)
+		return 4;
+	predictor = in[0];
+	unsigned used = in[1];
+	in += 2;
+	if(predictor > PREDICT_MEDIAN || used == 0 || used > NUM_TOKENS)
+		return 5;
+
+	Symbol slots[RANS_SCALE];
+	unsigned sum = 0;
+	for(unsigned t = 0; t != used; ++t) {
+		unsigned f = 0;
+		for(unsigned shift = 0;; shift += 7) {
+			if(in == end || shift > 14)
+				return 5;
+			f |= (*in & 127u) << shift;
+			if(!(*in++ & 128))
+				break;
+		}
+		if(f > RANS_SCALE - sum)
+			return 5;
+		for(unsigned i = 0; i != f; ++i) {
+			Symbol& s = slots[sum + i];
+			s.freq = (uint16_t)f;
+			s.offset = (uint16_t)i;
+			s.base = (uint16_t)token_base(t);
+			s.bits = (uint16_t)token_extra_bits(t);
+		}
+		sum += f;
+	}
+	if(sum != RANS_SCALE)
+		return 5;
+
+	if(end - in < 8)
+		return 4;
+	size_t ranssize = read32(in), extrasize = read32(in + 4);
+	in += 8;
+	if(ranssize < 4 * RANS_LANES || (size_t)(end - in) < ranssize || (size_t)(end - in) - ranssize < extrasize)
+		return 4;
+	const unsigned char* p = in;
+	const unsigned char* ransend = in + ranssize;
+	BitReader extra(ransend, ransend + extrasize);
+	in = ransend + extrasize;
+
+	// a channel that's only token 0, like the color of grey tiles, is all
+	// zero residuals and has nothing in its streams
+	if(used == 1) {
+		std::fill(residuals, residuals + n, 0);
+		return 0;
+	}
+
+	uint32_t x0 = read32(p), x1 = read32(p + 4), x2 = read32(p + 8), x3 = read32(p + 12);
+	p += 4 * RANS_LANES;
+
+	// the stream is only checked for its end once for each round of the 4
+	// coders, which read at most a word each
+#define DECODE_TOKEN(x, i, CHECK) { \
+		const Symbol& s = slots[x & (RANS_SCALE - 1)]; \
+		x = s.freq * (x >> RANS_SCALE_BITS) + s.offset; \
+		CHECK \
+		bool renormalize = x < RANS_L; \
+		x = renormalize ? (x << 16) | p[0] | (p[1] << 8) : x; \
+		p += renormalize ? 2 : 0; \
+		unsigned z = s.base; \
+		if(s.bits) \
+			z += extra.read(s.bits); \
+		residuals[i] = (T)((z >> 1) ^ (0u - (z & 1))); \
+	}
+
+	size_t i = 0;
+	for(; i + RANS_LANES <= n && ransend - p >= 2 * RANS_LANES; i += RANS_LANES) {
+		DECODE_TOKEN(x0, i, )
+		DECODE_TOKEN(x1, i + 1, )
+		DECODE_TOKEN(x2, i + 2, )
+		DECODE_TOKEN(x3, i + 3, )
+	}
+	for(; i != n; ++i) {
+		uint32_t& x = i % RANS_LANES == 0 ? x0 : i % RANS_LANES == 1 ? x1 : i % RANS_LANES == 2 ? x2 : x3;
+		DECODE_TOKEN(x, i, if(x < RANS_L && ransend - p < 2) return 4;)
+	}
+#undef DECODE_TOKEN
+	return extra.overran() ? 4 : 0;
+}
+
+//****************************************************************************
+//  Rebuilding a row of a plane from its residuals, with the row above it
+//  already done. The left neighbour of the first pixel is the zero column.
+//****************************************************************************
+template<typename T>
+static void unpredict_median(T* row, const T* up, const T* residuals, unsigned w) {
+	unsigned a = 0;
+	for(unsigned x = 0; x != w; ++x)
+		row[x] = (T)(a = (T)(residuals[x] + predict_median(a, up[x], up[(int)x - 1])));
+}
+
+// the gradient predictor's residual plus up - upleft is the difference
+// from the left pixel, so the row is the running sum of those
+template<typename T>
+static void unpredict_gradient_scalar(T* row, const T* up, const T* residuals, unsigned x, unsigned w) {
+	T a = x ? row[x - 1] : 0;
+	for(; x != w; ++x)
+		row[x] = a = (T)(a + residuals[x] + up[x] - up[(int)x - 1]);
+}
+
+template<typename T>
+static void unpredict_gradient(T* row, const T* up, const T* residuals, unsigned w) {
+	unpredict_gradient_scalar(row, up, residuals, 0, w);
+}
+
+#ifdef HEIGHTMAP_SSE2
+// 16 or 8 at a time, with the running sum done in log2 steps of shifts
+template<>
+void unpredict_gradient<uint8_t>(uint8_t* row, const uint8_t* up, const uint8_t* residuals, unsigned w) {
+	__m128i carry = _mm_setzero_si128();
+	unsigned x = 0;
+	for(; x + 16 <= w; x += 16) {
+		__m128i d = _mm_add_epi8(_mm_loadu_si128((const __m128i*)(residuals + x)),
+		            _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(up + x)), _mm_loadu_si128((const __m128i*)(up + x - 1))));
+		d = _mm_add_epi8(d, _mm_slli_si128(d, 1));
+		d = _mm_add_epi8(d, _mm_slli_si128(d, 2));
+		d = _mm_add_epi8(d, _mm_slli_si128(d, 4));
+		d = _mm_add_epi8(d, _mm_slli_si128(d, 8));
+		d = _mm_add_epi8(d, carry);
+		_mm_storeu_si128((__m128i*)(row + x), d);
+		carry = _mm_srli_si128(d, 15);
+		carry = _mm_unpacklo_epi8(carry, carry);
+		carry = _mm_shuffle_epi32(_mm_unpacklo_epi16(carry, carry), 0);
+	}
+	unpredict_gradient_scalar(row, up, residuals, x, w);
+}
+
+template<>
+void unpredict_gradient<uint16_t>(uint16_t* row, const uint16_t* up, const uint16_t* residuals, unsigned w) {
+	__m128i carry = _mm_setzero_si128();
+	unsigned x = 0;
+	for(; x + 8 <= w; x += 8) {
+		__m128i d = _mm_add_epi16(_mm_loadu_si128((const __m128i*)(residuals + x)),
+		            _mm_sub_epi16(_mm_loadu_si128((const __m128i*)(up + x)), _mm_loadu_si128((const __m128i*)(up + x - 1))));
+		d = _mm_add_epi16(d, _mm_slli_si128(d, 2));
+		d = _mm_add_epi16(d, _mm_slli_si128(d, 4));
+		d = _mm_add_epi16(d, _mm_slli_si128(d, 8));
+		d = _mm_add_epi16(d, carry);
+		_mm_storeu_si128((__m128i*)(row + x), d);
+		carry = _mm_srli_si128(d, 14);
+		carry = _mm_shuffle_epi32(_mm_unpacklo_epi16(carry, carry), 0);
+	}
+	unpredict_gradient_scalar(row, up, residuals, x, w);
+}
+#endif
+
+// stores a plane row as channel c of the image row
+static inline void store_row(unsigned char* out, const uint8_t* row, unsigned w, unsigned channels, unsigned c, bool difference) {
+	if(channels == 1) {
+		memcpy(out, row, w);
+		return;
+	}
+	for(unsigned x = 0; x != w; ++x, out += channels)
+		out[c] = (unsigned char)(row[x] + (difference ? out[0] : 0));
+}
+
+static inline void store_row(unsigned char* out, const uint16_t* row, unsigned w, unsigned channels, unsigned c, bool difference) {
+	for(unsigned x = 0; x != w; ++x, out += 2 * channels) {
+		unsigned value = row[x] + (difference ? (out[0] << 8) | out[1] : 0);
+		out[2 * c] = (unsigned char)(value >> 8);
+		out[2 * c + 1] = (unsigned char)value;
+	}
+}
+
+template<typename T>
+static unsigned decode_tiles(unsigned char* samples, unsigned width, unsigned height, unsigned channels,
+                             unsigned tilesize, const unsigned char* in, size_t insize) {
+	unsigned tilesx = (width + tilesize - 1) / tilesize, tilesy = (height + tilesize - 1) / tilesize;
+	size_t tiles = (size_t)tilesx * tilesy, tableend = HEADER_SIZE + 4 * (tiles + 1);
+	size_t pixelsize = channels * sizeof(T);
+
+	// one spare element in front for the zero column left of the first row
+	std::vector<T> plane((size_t)(tilesize + 1) * (tilesize + 1) + 1, 0);
+	std::vector<T> residuals((size_t)tilesize * tilesize);
+	for(size_t i = 0; i != tiles; ++i) {
+		size_t begin = read32(&in[HEADER_SIZE + 4 * i]), end = read32(&in[HEADER_SIZE + 4 * i + 4]);
+		if(begin < tableend || begin > end || end > insize)
+			return 4;
+		const unsigned char* p = in + begin;
+		unsigned x0 = (unsigned)(i % tilesx) * tilesize, y0 = (unsigned)(i / tilesx) * tilesize;
+		unsigned tw = std::min(tilesize, width - x0), th = std::min(tilesize, height - y0);
+		unsigned stride = tw + 1;
+		// the zero row and column may hold pixels of tiles of another width
+		std::fill(plane.begin(), plane.begin() + stride, 0);
+		for(unsigned c = 0; c != channels; ++c) {
+			unsigned predictor;
+			unsigned error = read_channel(&residuals[0], (size_t)tw * th, predictor, p, in + end);
+			if(error)
+				return error;
+			bool difference = channels >= 3 && (c == 1 || c == 2);
+			for(unsigned y = 0; y != th; ++y) {
+				T* row = &plane[(size_t)(y + 1) * stride + 1];
+				row[-1] = 0;
+				const T* r = &residuals[(size_t)y * tw];
+				if(predictor == PREDICT_GRADIENT)
+					unpredict_gradient(row, row - stride, r, tw);
+				else
+					unpredict_median(row, row - stride, r, tw);
+				store_row(&samples[((size_t)(y0 + y) * width + x0) * pixelsize], row, tw, channels, c, difference);
+			}
+		}
+	}
+	return 0;
+}
+
+unsigned heightmap_decode(std::vector<unsigned char>& samples, unsigned& width, unsigned& height,
+                          unsigned& channels, unsigned& bitdepth, const unsigned char* in, size_t insize) {
+	if(insize < HEADER_SIZE || memcmp(in, "VHM2", 4) != 0)
+		return 2;
+	unsigned w = read32(in + 4), h = read32(in + 8), depth = in[12], n = in[13];
+	unsigned tilesize = in[14] | (in[15] << 8);
+	if(w == 0 || h == 0 || (depth != 8 && depth != 16) || n < 1 || n > 4 || tilesize == 0
+	   || (uint64_t)w * h > (1u << 28))
+		return 3;
+	size_t tiles = (size_t)((w + tilesize - 1) / tilesize) * ((h + tilesize - 1) / tilesize);
+	if((insize - HEADER_SIZE) / 4 < tiles + 1)
+		return 4;
+
+	samples.resize((size_t)w * h * n * (depth / 8));
+	unsigned error;
+	if(depth == 8)
+		error = decode_tiles<uint8_t>(&samples[0], w, h, n, tilesize, in, insize);
+	else
+		error = decode_tiles<uint16_t>(&samples[0], w, h, n, tilesize, in, insize);
+	if(error)
+		return error;
+	width = w;
+	height = h;
+	channels = n;
+	bitdepth = depth;
+	return 0;
+}
+
+// whether the file is the one a heightmap's header says it was encoded from
+static bool same_source(const unsigned char* in, size_t insize, const std::string& source) {
+	const unsigned char* buffer;
+	size_t buffersize;
+	unsigned mapped;
+	if(insize < HEADER_SIZE || lodepng_map_file(&buffer, &buffersize, &mapped, source.c_str()) != 0)
+		return false;
+	unsigned size = read32(in + 16), crc = read32(in + 20);
+	bool same = size != 0 && size == buffersize && crc == lodepng_crc32(buffer, buffersize);
+	lodepng_unmap_file(buffer, buffersize, mapped);
+	return same;
+}
+
+unsigned heightmap_decode_file(std::vector<unsigned char>& samples, unsigned& width, unsigned& height,
+                               unsigned& channels, unsigned& bitdepth, const std::string& filename,
+                               const std::string& source) {
+	const unsigned char* buffer;
+	size_t buffersize;
+	unsigned mapped;
+	if(lodepng_map_file(&buffer, &buffersize, &mapped, filename.c_str()) != 0)
+		return HEIGHTMAP_NO_FILE;
+	unsigned error = heightmap_decode(samples, width, height, channels, bitdepth, buffer, buffersize);
+	if(!error && !source.empty() && !same_source(buffer, buffersize, source))
+		error = HEIGHTMAP_STALE;
+	lodepng_unmap_file(buffer, buffersize, mapped);
+	return error;
+}
+
+void heightmap_to_rgba8(std::vector<unsigned char>& rgba, unsigned& width, unsigned& height,
+                        const std::vector<unsigned char>& samples, unsigned channels, unsigned bitdepth,
+                        unsigned reduce) {
+	// 16 bit samples keep their high byte, like lodepng converts them
+	unsigned bytes = bitdepth / 8;
+	auto pixel = [&](unsigned x, unsigned y, unsigned char* out) {
+		const unsigned char* p = &samples[((size_t)y * width + x) * channels * bytes];
+		switch(channels) {
+			case 1: out[0] = out[1] = out[2] = p[0]; out[3] = 255; break;
+			case 2: out[0] = out[1] = out[2] = p[0]; out[3] = p[bytes]; break;
+			case 3: out[0] = p[0]; out[1] = p[bytes]; out[2] = p[2 * bytes]; out[3] = 255; break;
+			default: out[0] = p[0]; out[1] = p[bytes]; out[2] = p[2 * bytes]; out[3] = p[3 * bytes]; break;
+		}
+	};
+
+	if(reduce <= 1) {
+		rgba.resize((size_t)width * height * 4);
+		for(unsigned y = 0; y != height; ++y)
+			for(unsigned x = 0; x != width; ++x)
+				pixel(x, y, &rgba[((size_t)y * width + x) * 4]);
+		return;
+	}
+
+	// the average of each reduce * reduce block, or of the part of it inside
+	// the image on the right and bottom edges, rounded to nearest
+	unsigned rw = (width + reduce - 1) / reduce, rh = (height + reduce - 1) / reduce;
+	rgba.resize((size_t)rw * rh * 4);
+	for(unsigned by = 0; by != rh; ++by) {
+		for(unsigned bx = 0; bx != rw; ++bx) {
+			unsigned sums[4] = {0, 0, 0, 0}, count = 0;
+			for(unsigned y = by * reduce; y != std::min(height, (by + 1) * reduce); ++y) {
+				for(unsigned x = bx * reduce; x != std::min(width, (bx + 1) * reduce); ++x, ++count) {
+					unsigned char value[4];
+					pixel(x, y, value);
+					for(unsigned c = 0; c != 4; ++c)
+						sums[c] += value[c];
+				}
+			}
+			for(unsigned c = 0; c != 4; ++c)
+				rgba[((size_t)by * rw + bx) * 4 + c] = (unsigned char)((sums[c] + count / 2) / count);
+		}
+	}
+	width = rw;
+	height = rh;
+}
+
+const char* heightmap_error_text(unsigned code) {
+	switch(code) {
+		case 0: return "no error";
+		case HEIGHTMAP_NO_FILE: return "couldn't open the file";
+		case 2: return "not a heightmap file";
+		case 3: return "invalid or unsupported heightmap header";
+		case 4: return "tile data is truncated or corrupt";
+		case 5: return "invalid predictor or token frequencies in a tile";
+		case 6: return "can only encode 8 or 16 bit samples with 1 to 4 channels, in tiles of at most 65535 pixels";
+		case HEIGHTMAP_STALE: return "the file it was encoded from has changed since";
+	}
+	return "unknown error code";
+}
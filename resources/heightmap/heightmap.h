@@ -0,0 +1,84 @@
+//******************************************************************************
+//  File: heightmap.h
+//
+//  Description: A lossless codec for heightmaps, which decodes the terrain
+//    textures several times faster than png does at about the same size.
+//
+//    Samples are 8 or 16 bit with 1 to 4 channels: heights on their own, or
+//    with the alpha, or the color of textures that aren't purely grey. Each
+//    channel is predicted from its neighbours with the gradient (left + up -
+//    upleft) or the median predictor, and the residuals are entropy coded with
+//    four interleaved rANS coders. The image is split in tiles that are coded
+//    on their own, so any tile can be decoded without the rest.
+//
+//    16 bit samples are stored big endian in the sample buffers, like lodepng
+//    does with its raw images.
+//
+//  Date: 19 October 2026
+//******************************************************************************
+#ifndef HEIGHTMAP_H
+#define HEIGHTMAP_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#define HEIGHTMAP_DEFAULT_TILESIZE 256
+
+//****************************************************************************
+//  Function: heightmap_encode
+//
+//  Purpose:
+//    Encodes width * height pixels of interleaved samples to out. Returns 0,
+//    or an error code heightmap_error_text explains. source is the file the
+//    samples were decoded from, if any, whose size and CRC-32 are stored so
+//    heightmap_decode_file can tell when it's changed.
+//****************************************************************************
+unsigned heightmap_encode(std::vector<unsigned char>& out, const unsigned char* samples,
+                          unsigned width, unsigned height, unsigned channels, unsigned bitdepth,
+                          unsigned tilesize = HEIGHTMAP_DEFAULT_TILESIZE,
+                          const unsigned char* source = NULL, size_t sourcesize = 0);
+
+//****************************************************************************
+//  Function: heightmap_decode
+//
+//  Purpose:
+//    Decodes an encoded heightmap to interleaved samples, and gives back its
+//    size and sample format. Returns 0, or an error code.
+//****************************************************************************
+unsigned heightmap_decode(std::vector<unsigned char>& samples, unsigned& width, unsigned& height,
+                          unsigned& channels, unsigned& bitdepth, const unsigned char* in, size_t insize);
+
+//****************************************************************************
+//  Function: heightmap_decode_file
+//
+//  Purpose:
+//    Like heightmap_decode, straight from the memory mapped file. Returns
+//    HEIGHTMAP_NO_FILE if it can't be opened. Given the source file it was
+//    encoded from, returns HEIGHTMAP_STALE unless that has the size and
+//    CRC-32 it had then.
+//****************************************************************************
+unsigned heightmap_decode_file(std::vector<unsigned char>& samples, unsigned& width, unsigned& height,
+                               unsigned& channels, unsigned& bitdepth, const std::string& filename,
+                               const std::string& source = "");
+
+//****************************************************************************
+//  Function: heightmap_to_rgba8
+//
+//  Purpose:
+//    Expands decoded samples to the 8 bit RGBA lodepng decodes pngs to: one
+//    channel is grey, two are grey and alpha, three are opaque color. reduce
+//    box filters the image to that fraction of its width and height, like
+//    LodePNGDecoderSettings::reduce does, and updates width and height.
+//****************************************************************************
+void heightmap_to_rgba8(std::vector<unsigned char>& rgba, unsigned& width, unsigned& height,
+                        const std::vector<unsigned char>& samples, unsigned channels, unsigned bitdepth,
+                        unsigned reduce = 1);
+
+#define HEIGHTMAP_NO_FILE 1
+#define HEIGHTMAP_STALE 7
+
+// returns a description of an error code
+const char* heightmap_error_text(unsigned code);
+
+#endif
@@ -0,0 +1,147 @@
+//******************************************************************************
+//  Program: heightmap_encoder
+//
+//  Description: Encodes png heightmaps to the heightmap codec, as a .vhm file
+//    next to each png, which the terrain loads instead of the png while the
+//    png is unchanged since. It keeps the fewest channels that hold the image losslessly,
+//    checks that the .vhm decodes to exactly the pixels of the png, and
+//    prints the sizes and decoding times of both.
+//
+//    Build and run from the repository root:
+//      make heightmaps
+//    or
+//      make heightmap_encoder
+//      ./heightmap_encoder [-t tilesize] image.png [image.png ...]
+//
+//  Date: 19 October 2026
+//******************************************************************************
+#include "heightmap.h"
+#include "../LodePNG/lodepng.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TIMING_RUNS 5
+
+//****************************************************************************
+//  Function: fewest_channels
+//
+//  Purpose:
+//    Takes RGBA samples down to grey, grey and alpha, or color without alpha
+//    when that loses nothing.
+//****************************************************************************
+static unsigned fewest_channels(std::vector<unsigned char>& samples, const std::vector<unsigned char>& rgba,
+                                unsigned bitdepth) {
+	unsigned bytes = bitdepth / 8;
+	size_t pixels = rgba.size() / (4 * bytes);
+	bool grey = true, opaque = true;
+	for(size_t i = 0; i != pixels; ++i) {
+		const unsigned char* p = &rgba[i * 4 * bytes];
+		for(unsigned b = 0; b != bytes; ++b) {
+			if(p[b] != p[bytes + b] || p[b] != p[2 * bytes + b])
+				grey = false;
+			if(p[3 * bytes + b] != 255)
+				opaque = false;
+		}
+	}
+
+	// which RGBA channels to keep for each count
+	static const unsigned kept[5][4] = {{0}, {0}, {0, 3}, {0, 1, 2}, {0, 1, 2, 3}};
+	unsigned channels = grey ? (opaque ? 1 : 2) : (opaque ? 3 : 4);
+	samples.resize(pixels * channels * bytes);
+	for(size_t i = 0; i != pixels; ++i)
+		for(unsigned c = 0; c != channels; ++c)
+			for(unsigned b = 0; b != bytes; ++b)
+				samples[(i * channels + c) * bytes + b] = rgba[(i * 4 + kept[channels][c]) * bytes + b];
+	return channels;
+}
+
+// the fastest of a few runs, in milliseconds
+template<typename F>
+static double time_best(F run) {
+	double best = 1e30;
+	for(unsigned i = 0; i != TIMING_RUNS; ++i) {
+		auto start = std::chrono::steady_clock::now();
+		run();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if(ms < best)
+			best = ms;
+	}
+	return best;
+}
+
+static unsigned encode_file(const std::string& filename, unsigned tilesize) {
+	std::vector<unsigned char> png;
+	unsigned error = lodepng::load_file(png, filename);
+	lodepng::State state;
+	unsigned w, h;
+	if(!error)
+		error = lodepng_inspect(&w, &h, &state, png.empty() ? 0 : &png[0], png.size());
+	if(error) {
+		std::printf("%s: %s\n", filename.c_str(), lodepng_error_text(error));
+		return error;
+	}
+
+	// 16 bit pngs stay 16 bit, everything else is 8 bit RGBA at most
+	unsigned bitdepth = state.info_png.color.bitdepth == 16 ? 16 : 8;
+	std::vector<unsigned char> rgba;
+	error = lodepng::decode(rgba, w, h, png, LCT_RGBA, bitdepth);
+	if(error) {
+		std::printf("%s: %s\n", filename.c_str(), lodepng_error_text(error));
+		return error;
+	}
+
+	std::vector<unsigned char> samples, vhm;
+	unsigned channels = fewest_channels(samples, rgba, bitdepth);
+	error = heightmap_encode(vhm, &samples[0], w, h, channels, bitdepth, tilesize, &png[0], png.size());
+	if(error) {
+		std::printf("%s: %s\n", filename.c_str(), heightmap_error_text(error));
+		return error;
+	}
+
+	// check it decodes to the same pixels as the png
+	std::vector<unsigned char> decoded;
+	unsigned dw, dh, dchannels, dbitdepth;
+	error = heightmap_decode(decoded, dw, dh, dchannels, dbitdepth, &vhm[0], vhm.size());
+	if(error || decoded != samples) {
+		std::printf("%s: doesn't round trip: %s\n", filename.c_str(), error ? heightmap_error_text(error) : "different pixels");
+		return 1;
+	}
+
+	std::string out = filename.substr(0, filename.rfind('.')) + ".vhm";
+	if(lodepng::save_file(vhm, out) != 0) {
+		std::printf("%s: couldn't write %s\n", filename.c_str(), out.c_str());
+		return 1;
+	}
+
+	double png_ms = time_best([&] {lodepng::decode(rgba, w, h, png, LCT_RGBA, bitdepth);});
+	double vhm_ms = time_best([&] {heightmap_decode(decoded, dw, dh, dchannels, dbitdepth, &vhm[0], vhm.size());});
+	std::printf("%s (%ux%u, %u bit, %u channel%s)\n", filename.c_str(), w, h, bitdepth, channels, channels == 1 ? "" : "s");
+	std::printf("  png %10zu bytes %8.2f ms\n", png.size(), png_ms);
+	std::printf("  vhm %10zu bytes %8.2f ms  %.2fx the size, %.1fx as fast\n", vhm.size(), vhm_ms,
+	            (double)vhm.size() / png.size(), png_ms / vhm_ms);
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+	unsigned tilesize = HEIGHTMAP_DEFAULT_TILESIZE;
+	int first = 1;
+	if(argc > 2 && std::string(argv[1]) == "-t") {
+		tilesize = (unsigned)std::atoi(argv[2]);
+		first = 3;
+	}
+	if(first >= argc) {
+		std::printf("usage: %s [-t tilesize] image.png [image.png ...]\n", argv[0]);
+		return 1;
+	}
+
+	int failed = 0;
+	for(int i = first; i < argc; ++i)
+		if(encode_file(argv[i], tilesize) != 0)
+			++failed;
+	return failed ? 1 : 0;
+}
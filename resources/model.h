@@ -15,7 +15,18 @@
 //******************************************************************************
 #include <random>
 #include <vector>
+#include <cstddef>
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <map>
+#include <chrono>
+#include <fstream>
 #include <iostream>
+#include <cstring>
+#include <sys/stat.h>
 using std::cout;
 using std::endl;
 
@@ -63,6 +74,15 @@ using std::endl;
 #include "../resources/LodePNG/lodepng.h"
 // Good, simple png library
 
+#include "../resources/heightmap/heightmap.h"
+// Faster to decode heightmaps, made from the pngs by make heightmaps
+
+#include "../resources/picking/picking.h"
+// Finds the terrain under the cursor on the CPU
+
+#include "../resources/recording/recording.h"
+// Saves the frames FrameRecorder reads back as pngs, on other threads
+
 //**********************************************
 
 #define GLM_FORCE_SWIZZLE
@@ -70,240 +90,1447 @@ using std::endl;
 #include "glm/gtc/matrix_transform.hpp" // for glm::ortho
 #include "glm/gtc/type_ptr.hpp" //to send matricies gpu-side
 
+//**********************************************
+
+// building with -DTRUSTED_ASSETS skips verifying the CRC and Adler-32
+// checksums of the pngs at startup. Nothing checks them anywhere else, so
+// it's only for builds that ship textures known to be intact, and without
+// it a corrupted texture is reported instead of drawn
+
+// quality tier of the large terrain textures: 1 is full size, 2, 4 or 8 decode
+// them box filtered to that fraction of their width and height, which makes
+// decoding memory, uploads and mipmap generation that much cheaper on weak
+// machines
+#ifndef TEXTURE_REDUCE
+#define TEXTURE_REDUCE 1
+#endif
+
+//****************************************************************************
+//  Function: decode_texture
+//
+//  Purpose:
+//    Decodes a png from disk to 8-bit RGBA, like lodepng::decode does, but
+//    skips checksum verification with TRUSTED_ASSETS. reduce shrinks the
+//    image by that factor while decoding. If given, preview gets low
+//    resolution versions of interlaced pngs while they're being decoded.
+//    When there's a .vhm heightmap next to the png, encoded from the png as
+//    it is now, that's decoded instead.
+//****************************************************************************
+unsigned decode_texture(std::vector<unsigned char>& image, unsigned& width, unsigned& height, const char* filename,
+                        unsigned reduce = 1,
+                        unsigned (*preview)(const unsigned char*, unsigned, unsigned, void*) = NULL, void* context = NULL) {
+	std::string path(filename);
+	if(path.size() > 4 && path.compare(path.size() - 4, 4, ".png") == 0) {
+		std::vector<unsigned char> samples;
+		unsigned channels, bitdepth;
+		std::string heightmap = path.substr(0, path.size() - 4) + ".vhm";
+		unsigned error = heightmap_decode_file(samples, width, height, channels, bitdepth, heightmap, path);
+		if(error == 0) {
+			heightmap_to_rgba8(image, width, height, samples, channels, bitdepth, reduce);
+			return 0;
+		}
+		if(error != HEIGHTMAP_NO_FILE)
+			cout << "error with heightmap " << heightmap << ": " << heightmap_error_text(error) << ", using the png" << endl;
+	}
+
+	lodepng::State state;
+	state.info_raw.colortype = LCT_RGBA;
+	state.info_raw.bitdepth = 8;
+#ifdef TRUSTED_ASSETS
+	state.decoder.ignore_crc = 1;
+	state.decoder.zlibsettings.ignore_adler32 = 1;
+#endif
+	state.decoder.reduce = reduce;
+	state.decoder.adam7_preview = preview;
+	state.decoder.adam7_preview_context = context;
+
+	// decodes straight from the memory mapped file, without copying it first
+	return lodepng::decode(image, width, height, state, path);
+}
+
 //******************************************************************************
-//  Class: GroundModel
+//  Class: GLState
 //
-//  Purpose:  To represent the ground on the GPU, and everything that goes along
-//        with displaying this ball to the user.
+//  Purpose:  Remembers the program, vertex array, textures and blending that
+//        are bound, and skips the GL calls that would bind them again. It
+//        counts what it issued and what it filtered, for report().
 //
 //  Functions:
 //
-//    Constructor:
-//        Takes no arguments, calls generate_points() to create geometry. Then
-//        buffers all this data to the GPU memory.
+//    Use Program, Bind Vertex Array, Bind Texture, Set Blend:
+//        Like the GL calls, when the state is different from what's bound.
 //
-//    Setters:
-//        Used to update the values of the uniform variables.
+//    Edit Texture:
+//        Binds a texture to the active unit 0, for glTexImage2D and the like.
 //
-//    Generate Points:
-//        Creates a square, subdivides the faces several times, and creates
-//        triangles to span the shape. This data is used to populate the
-//        vectors containing point data.
+//    Invalidate:
+//        Forgets what's bound, after GL calls that went around this class.
 //
-//    Display:
-//        Makes sure the correct shader is being used, that the correct buffers
-//        are bound, that the vertex attributes are set up, and that all the
-//        latest values of the uniform variables are sent to the GPU.
+//    Report:
+//        Prints how many binds were filtered since the last report.
 //******************************************************************************
 
-class GroundModel {
+#define GL_STATE_TEXTURE_UNITS 4
+#define GL_STATE_UNKNOWN 0xFFFFFFFFu  //isn't the name of anything, so the next bind happens
+
+class GLState {
 public:
-	GroundModel();
+	static void use_program(GLuint p);
+	static void bind_vertex_array(GLuint v);
+	static void bind_texture(int unit, GLuint texture);
+	static void set_blend(bool on);
+	static void edit_texture(GLuint texture);
 
-	void display(bool select=false);
+	static void invalidate();
+	static void report();
 
-	void set_time(int tin)        {time = tin;}
-	void set_scroll(int sin)      {scroll = sin;}
-	void toggle_normals()         {if(show_normals==0){show_normals=1;}else{show_normals=0;}}
-	void scale_up()               {scale *= 1.618f;}
-	void scale_down()             {scale /= 1.618f;}
-	void set_proj(glm::mat4 pin)  {proj = pin;}
+private:
+	static bool changed(GLuint& current, GLuint wanted);
+
+	static GLuint program, vao, active_unit, blend;
+	static GLuint textures[GL_STATE_TEXTURE_UNITS];
+	static unsigned issued, filtered;
+};
+
+GLuint GLState::program = GL_STATE_UNKNOWN;
+GLuint GLState::vao = GL_STATE_UNKNOWN;
+GLuint GLState::active_unit = GL_STATE_UNKNOWN;
+GLuint GLState::blend = GL_STATE_UNKNOWN;
+GLuint GLState::textures[GL_STATE_TEXTURE_UNITS] = {GL_STATE_UNKNOWN, GL_STATE_UNKNOWN, GL_STATE_UNKNOWN, GL_STATE_UNKNOWN};
+unsigned GLState::issued = 0;
+unsigned GLState::filtered = 0;
+
+// whether wanted needs binding, remembering it if it does
+bool GLState::changed(GLuint& current, GLuint wanted) {
+	if(current == wanted) {
+		filtered++;
+		return false;
+	}
+	current = wanted;
+	issued++;
+	return true;
+}
+
+void GLState::use_program(GLuint p) {
+	if(changed(program, p))
+		glUseProgram(p);
+}
+
+void GLState::bind_vertex_array(GLuint v) {
+	if(changed(vao, v))
+		glBindVertexArray(v);
+}
+
+void GLState::bind_texture(int unit, GLuint texture) {
+	if(textures[unit] == texture) {
+		filtered++;
+		return;
+	}
+	if(changed(active_unit, unit))
+		glActiveTexture(GL_TEXTURE0 + unit);
+	changed(textures[unit], texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void GLState::edit_texture(GLuint texture) {
+	if(changed(active_unit, 0))
+		glActiveTexture(GL_TEXTURE0);
+	if(changed(textures[0], texture))
+		glBindTexture(GL_TEXTURE_2D, texture);
+}
+
+void GLState::set_blend(bool on) {
+	if(changed(blend, on)) {
+		if(on)
+			glEnable(GL_BLEND);
+		else
+			glDisable(GL_BLEND);
+	}
+}
+
+void GLState::invalidate() {
+	program = vao = active_unit = blend = GL_STATE_UNKNOWN;
+	for(int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+		textures[unit] = GL_STATE_UNKNOWN;
+}
+
+void GLState::report() {
+	cout << "gl state: " << filtered << " of " << issued + filtered << " binds filtered" << endl;
+	issued = filtered = 0;
+}
+
+//******************************************************************************
+//  Class: Profiler
+//
+//  Purpose:  Times the passes of each frame on the CPU, and on the GPU with
+//        GL_TIME_ELAPSED queries. The queries are read PROFILER_LATENCY
+//        frames later, when they're done, so timing never waits on the GPU.
+//        The timings go into a ring of the last PROFILER_HISTORY passes.
+//
+//  Functions:
+//
+//    Begin Frame:
+//        Collects the queries of the frame that used this frame's slot, and
+//        starts the frame. Needs the GL context.
+//
+//    Get GPU Frame:
+//        The GPU time of the budgeted passes of the frame Begin Frame
+//        collected last, in milliseconds. Negative if one of their queries
+//        wasn't ready, or it had no passes.
+//
+//    Begin, End:
+//        Around a pass. Passes can't nest, since only one GL_TIME_ELAPSED
+//        query can run at a time. A pass that isn't budgeted, like the
+//        recording's readback, is timed but left out of Get GPU Frame, so
+//        the resolution doesn't drop to make room for it.
+//
+//    Report:
+//        Prints the fastest, mean and 99th percentile times of each pass in
+//        the ring.
+//
+//    Export Trace:
+//        Writes the ring as Chrome trace event JSON, for chrome://tracing or
+//        Perfetto. CPU passes are on one track, GPU passes on another,
+//        starting when the CPU issued them.
+//******************************************************************************
+
+#define PROFILER_LATENCY 4       //frames before a frame's queries are read
+#define PROFILER_MAX_PASSES 16   //in a frame
+#define PROFILER_HISTORY 4096    //passes kept for the report and the trace
+
+typedef struct profile_event_t {
+	const char* pass;
+	unsigned frame;
+	double start;   //microseconds on the CPU, since the first frame
+	double cpu;     //milliseconds
+	double gpu;     //milliseconds, negative if the query was never ready
+	bool budgeted;  //counted in the frame's GPU time
+} profile_event;
+
+class Profiler {
+public:
+	static void begin_frame();
+	static void begin(const char* pass, bool budgeted = true);
+	static void end();
+
+	static void report();
+	static bool export_trace(const char* filename);
+
+	static double get_gpu_frame()     {return gpu_frame;}
 
 private:
+	static double now();
+
+	//a frame's passes, waiting on their queries
+	struct slot {
+		GLuint queries[PROFILER_MAX_PASSES];
+		profile_event events[PROFILER_MAX_PASSES];
+		int count;
+	};
+	static slot slots[PROFILER_LATENCY];
+	static int current;     //slot of this frame, -1 before the first
+	static unsigned frame;
+	static bool timing;     //between begin and end
+	static double gpu_frame;
+
+	static std::vector<profile_event> history;
+	static size_t next_event;
+	static std::chrono::steady_clock::time_point epoch;
+};
+
+Profiler::slot Profiler::slots[PROFILER_LATENCY];
+int Profiler::current = -1;
+unsigned Profiler::frame = 0;
+bool Profiler::timing = false;
+double Profiler::gpu_frame = -1.0;
+std::vector<profile_event> Profiler::history;
+size_t Profiler::next_event = 0;
+std::chrono::steady_clock::time_point Profiler::epoch;
+
+double Profiler::now() {
+	return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Profiler::begin_frame() {
+	if(current < 0) {
+		for(int i = 0; i < PROFILER_LATENCY; i++) {
+			glGenQueries(PROFILER_MAX_PASSES, slots[i].queries);
+			slots[i].count = 0;
+		}
+		history.reserve(PROFILER_HISTORY);
+		epoch = std::chrono::steady_clock::now();
+	}
+	current = (current + 1) % PROFILER_LATENCY;
+	frame++;
+
+	//the frame PROFILER_LATENCY ago. Any query that's still not ready is
+	//dropped rather than waited for
+	slot& old = slots[current];
+	gpu_frame = old.count ? 0.0 : -1.0;
+	for(int i = 0; i < old.count; i++) {
+		profile_event& e = old.events[i];
+		GLuint available = 0;
+		glGetQueryObjectuiv(old.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+		e.gpu = -1.0;
+		if(available) {
+			GLuint64 nanoseconds = 0;
+			glGetQueryObjectui64v(old.queries[i], GL_QUERY_RESULT, &nanoseconds);
+			e.gpu = nanoseconds / 1e6;
+		}
+		if(e.budgeted)
+			gpu_frame = e.gpu < 0.0 || gpu_frame < 0.0 ? -1.0 : gpu_frame + e.gpu;
+		if(history.size() < PROFILER_HISTORY)
+			history.push_back(e);
+		else
+			history[next_event] = e;
+		next_event = (next_event + 1) % PROFILER_HISTORY;
+	}
+	old.count = 0;
+}
+
+void Profiler::begin(const char* pass, bool budgeted) {
+	if(current < 0 || slots[current].count == PROFILER_MAX_PASSES)
+		return;
+	slot& s = slots[current];
+	profile_event& e = s.events[s.count];
+	e.pass = pass;
+	e.frame = frame;
+	e.budgeted = budgeted;
+	glBeginQuery(GL_TIME_ELAPSED, s.queries[s.count]);
+	e.start = now();
+	timing = true;
+}
+
+void Profiler::end() {
+	if(!timing)
+		return;
+	slot& s = slots[current];
+	s.events[s.count].cpu = (now() - s.events[s.count].start) / 1000.0;
+	glEndQuery(GL_TIME_ELAPSED);
+	s.count++;
+	timing = false;
+}
+
+void Profiler::report() {
+	std::map<std::string, std::vector<double> > cpu, gpu;
+	for(auto &e : history) {
+		cpu[e.pass].push_back(e.cpu);
+		if(e.gpu >= 0.0)
+			gpu[e.pass].push_back(e.gpu);
+	}
+
+	// min, mean and p99 of a pass's times, as text
+	auto summary = [](std::vector<double>& times) {
+		if(times.empty())
+			return std::string("             -");
+		std::sort(times.begin(), times.end());
+		double total = 0.0;
+		for(double t : times)
+			total += t;
+		char text[64];
+		snprintf(text, sizeof(text), "%6.3f %6.3f %6.3f", times.front(), total / times.size(),
+		         times[std::min(times.size() - 1, (size_t)(0.99 * times.size()))]);
+		return std::string(text);
+	};
+
+	cout << "pass times over the last " << history.size() << " passes, min avg p99 in ms:" << endl;
+	for(auto &pass : cpu) {
+		char name[24];
+		snprintf(name, sizeof(name), "  %-18s", pass.first.c_str());
+		cout << name << "cpu " << summary(pass.second) << "   gpu " << summary(gpu[pass.first]) << endl;
+	}
+}
+
+bool Profiler::export_trace(const char* filename) {
+	std::ofstream out(filename);
+	if(!out)
+		return false;
+
+	//oldest first
+	std::vector<profile_event> events;
+	size_t first = history.size() < PROFILER_HISTORY ? 0 : next_event;
+	for(size_t i = 0; i < history.size(); i++)
+		events.push_back(history[(first + i) % history.size()]);
+
+	out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [" << endl;
+	out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": 0, \"args\": {\"name\": \"CPU\"}}," << endl;
+	out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": 1, \"args\": {\"name\": \"GPU\"}}";
+	char line[256];
+	for(auto &e : events) {
+		snprintf(line, sizeof(line), ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": 0, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"frame\": %u}}",
+		         e.pass, e.start, e.cpu * 1000.0, e.frame);
+		out << line;
+		if(e.gpu >= 0.0) {
+			snprintf(line, sizeof(line), ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 0, \"tid\": 1, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"frame\": %u}}",
+			         e.pass, e.start, e.gpu * 1000.0, e.frame);
+			out << line;
+		}
+	}
+	out << endl << "]}" << endl;
+	return (bool)out;
+}
+
+//******************************************************************************
+//  Class: DrawQueue
+//
+//  Purpose:  Collects the draws of a frame from every model, then issues them
+//        in the order that changes the least state. Opaque draws are sorted
+//        by program, vertex array and textures. Blended ones, like the water,
+//        come after them in the order they were submitted, so they blend over
+//        what's behind them.
+//
+//  Functions:
+//
+//    Submit:
+//        Queues a packet. Its draw function issues the draw calls, with any
+//        uniforms that change between them, once the packet's state is bound.
+//
+//    Execute:
+//        Binds each packet's state through GLState, calls its draw function,
+//        and empties the queue. Each packet is timed by Profiler, as its pass.
+//******************************************************************************
+typedef struct draw_packet_t {
+	GLuint program;
 	GLuint vao;
-	GLuint buffer;
+	GLuint textures[GL_STATE_TEXTURE_UNITS];  //for units 0 to 3, 0 for none
+	bool blend;
+	std::function<void()> draw;
+	const char* pass;  //what Profiler calls it
+	unsigned order;    //when it was submitted
+} draw_packet;
+
+class DrawQueue {
+public:
+	void submit(const draw_packet& packet);
+	void execute();
 
-	GLuint height_tex;
-	GLuint normal_tex_1;
-	GLuint normal_tex_2;
-	GLuint normal_tex_3;
+private:
+	static bool before(const draw_packet& a, const draw_packet& b);
 
-	GLuint shader_program;
-	GLuint selection_shader_program;
+	std::vector<draw_packet> packets;
+};
 
-	int num_pts; //how many points?
+void DrawQueue::submit(const draw_packet& packet) {
+	packets.push_back(packet);
+	packets.back().order = packets.size();
+}
 
-	//VERTEX ATTRIB LOCATIONS
-	GLuint vPosition;
+// the sort key: opaque first, grouped by program, vertex array and textures,
+// then the blended ones as they came
+bool DrawQueue::before(const draw_packet& a, const draw_packet& b) {
+	if(a.blend != b.blend)
+		return !a.blend;
+	if(a.blend)
+		return a.order < b.order;
+	if(a.program != b.program)
+		return a.program < b.program;
+	if(a.vao != b.vao)
+		return a.vao < b.vao;
+	return std::lexicographical_compare(a.textures, a.textures + GL_STATE_TEXTURE_UNITS, b.textures, b.textures + GL_STATE_TEXTURE_UNITS);
+}
 
-	//UNIFORM LOCATIONS
-	GLuint uTime;   //animation time
-	GLuint uProj;   //projection matrix
-	GLuint uScroll;
-	GLuint uScale;
-	GLuint uNorm;
+void DrawQueue::execute() {
+	std::stable_sort(packets.begin(), packets.end(), before);
+	for(auto &p : packets) {
+		Profiler::begin(p.pass);
+		GLState::set_blend(p.blend);
+		GLState::use_program(p.program);
+		GLState::bind_vertex_array(p.vao);
+		for(int unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+			if(p.textures[unit])
+				GLState::bind_texture(unit, p.textures[unit]);
+		p.draw();
+		Profiler::end();
+	}
+	packets.clear();
+}
+
+//******************************************************************************
+//  Class: ProgressiveTexture
+//
+//  Purpose:  A texture that decodes its png on a worker thread, at the size
+//        TEXTURE_REDUCE asks for, so the scene can render before it's
+//        loaded. Until then it's a single black texel.
+//        Interlaced pngs show up early at 1/8, 1/4 and 1/2 resolution and are
+//        refined in place as more of the file is decoded.
+//
+//  Functions:
+//
+//    Load:
+//        Creates the texture and starts decoding the file. Textures decode
+//        one at a time, which keeps memory use like loading them in turn.
+//        If given, decoded is called on the worker with the final image.
+//
+//    Get:
+//        Returns the texture to bind.
+//
+//    Update:
+//        Uploads whatever the workers decoded since last time, for every
+//        texture, whether it's being drawn or not. Called once a frame and
+//        while paused. Returns whether any texture changed.
+//
+//    Loading:
+//        How many textures aren't fully uploaded yet.
+//******************************************************************************
+class ProgressiveTexture {
+public:
+	ProgressiveTexture() : texture(0), loaded(false), width(0), height(0), fresh(false), done(false), error(0) {}
+	~ProgressiveTexture();
 
-	GLuint uHeightSampler;
-	GLuint uNormal1Sampler;
-	GLuint uNormal2Sampler;
-	GLuint uNormal3Sampler;
+	void load(const char* file, std::function<void(const std::vector<unsigned char>&, unsigned, unsigned)> decoded = nullptr);
+	GLuint get()                  {return texture;}
 
-	//VALUES OF THOSE UNIFORMS
-	int time;
-	int show_normals;
-	int scroll;
-	float scale;
+	static bool update();
+	static int loading()          {return pending_loads;}
 
-	glm::mat4 proj;
+private:
+	static unsigned preview(const unsigned char* image, unsigned w, unsigned h, void* context);
+	bool upload();
 
-	void generate_points();
-	void subd_square(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d);
+	GLuint texture;
+	std::string filename;
+	std::thread worker;
+	bool loaded;    //the final image is uploaded and the worker is done
 
-	std::vector<glm::vec3> points;    //add the 1.0 w value in the shader
+	//shared with the worker thread
+	std::mutex lock;
+	std::vector<unsigned char> pending;
+	unsigned width, height;
+	bool fresh;     //pending holds an image that isn't uploaded yet
+	bool done;
+	unsigned error;
+
+	static int pending_loads;
+	static std::vector<ProgressiveTexture*> textures;  //the ones loaded, for update
 };
 
+int ProgressiveTexture::pending_loads = 0;
+std::vector<ProgressiveTexture*> ProgressiveTexture::textures;
+
+ProgressiveTexture::~ProgressiveTexture() {
+	if(worker.joinable())
+		worker.join();
+	textures.erase(std::remove(textures.begin(), textures.end(), this), textures.end());
+}
+
 //****************************************************************************
-//  Function: GroundModel Constructor
+//  Function: ProgressiveTexture::load
 //
 //  Purpose:
-//    Calls generate_points() and then sets up everything related to the GPU
+//    Sets up the texture with a placeholder and starts the worker thread.
 //****************************************************************************
-GroundModel::GroundModel() {
+void ProgressiveTexture::load(const char* file, std::function<void(const std::vector<unsigned char>&, unsigned, unsigned)> decoded) {
+	filename = file;
+	pending_loads++;
+	textures.push_back(this);
 
-	//initialize all the vectors
-	points.clear();
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	unsigned char black[4] = {0, 0, 0, 255};
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, black);
+
+	worker = std::thread([this, decoded]() {
+		static std::mutex decoding;
+		std::lock_guard<std::mutex> one_at_a_time(decoding);
+
+		std::vector<unsigned char> image;
+		unsigned w, h;
+		unsigned e = decode_texture(image, w, h, filename.c_str(), TEXTURE_REDUCE, preview, this);
+		if(e == 0 && decoded)
+			decoded(image, w, h);
+
+		std::lock_guard<std::mutex> guard(lock);
+		if(e == 0) {
+			pending.swap(image);
+			width = w;
+			height = h;
+			fresh = true;
+		}
+		error = e;
+		done = true;
+	});
+}
 
-	//fill those vectors with geometry
-	generate_points();
+//****************************************************************************
+//  Function: ProgressiveTexture::preview
+//
+//  Purpose:
+//    Called on the worker thread with each lower resolution preview, keeps
+//    the latest one for upload() to upload.
+//****************************************************************************
+unsigned ProgressiveTexture::preview(const unsigned char* image, unsigned w, unsigned h, void* context) {
+	ProgressiveTexture* t = (ProgressiveTexture*)context;
+	std::lock_guard<std::mutex> guard(t->lock);
+	t->pending.assign(image, image + (size_t)w * h * 4);
+	t->width = w;
+	t->height = h;
+	t->fresh = true;
+	return 0;
+}
 
-	//SETTING UP GPU STUFF
-	//VAO
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+//****************************************************************************
+//  Function: ProgressiveTexture::update
+//
+//  Purpose:
+//    Uploads the newer decoded images of all the textures. Returns whether
+//    there were any.
+//****************************************************************************
+bool ProgressiveTexture::update() {
+	bool changed = false;
+	for(size_t i = 0; i < textures.size(); i++)
+		if(textures[i]->upload())
+			changed = true;
+	return changed;
+}
 
-	//BUFFER, SEND DATA
+//****************************************************************************
+//  Function: ProgressiveTexture::upload
+//
+//  Purpose:
+//    Replaces the texture with a newer decoded image if there is one, and
+//    returns whether there was. The texture name stays the same as its size
+//    changes.
+//****************************************************************************
+bool ProgressiveTexture::upload() {
+	if(loaded)
+		return false;
+
+	bool uploaded = false;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if(fresh) {
+			GLState::edit_texture(texture);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pending[0]);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			fresh = false;
+			uploaded = true;
+		}
+		if(!done)
+			return uploaded;
+
+		if(error != 0)
+			std::cout << "error with lodepng texture loading " << filename << " " << error << ": " << lodepng_error_text(error) << std::endl;
+		else
+			cout << " loaded " << filename << endl;
+		std::vector<unsigned char>().swap(pending);
+		loaded = true;
+		pending_loads--;
+	}
+	worker.join();
+	return uploaded;
+}
+
+//******************************************************************************
+//  Class: FrameContext
+//
+//  Purpose:  Holds the uniforms that are the same for every model in a frame,
+//        in one std140 uniform buffer that all the programs read through the
+//        Frame block of frame.glsl. They're uploaded once a frame instead of
+//        once per draw call.
+//
+//  Functions:
+//
+//    Create:
+//        Makes the buffer and binds it to FRAME_UNIFORM_BINDING. Needs the GL
+//        context.
+//
+//    Update:
+//        Works out the view and the light from the time and the projection,
+//        and uploads everything to the buffer.
+//
+//    Attach:
+//        Points a program's Frame block at the buffer's binding point.
+//
+//    Get View:
+//        The projection times the view, as the shaders have it this frame.
+//
+//    Changed:
+//        Whether the time, scroll, scale or resolution differ from the ones
+//        last uploaded, so the frame would look different.
+//******************************************************************************
+
+#define FRAME_UNIFORM_BINDING 0
+
+//the terrain's textures don't scroll, scroll slowly or scroll faster. Each
+//mode is a variant of the programs that read them, see terrain.glsl
+#define SCROLL_MODES 3
+
+// the #defines that compile that variant of a program, and the one that
+// shades the ground with its normal maps or not
+std::string variant_defines(int scroll, int normals = 0) {
+	return "#define SCROLL " + std::to_string(scroll) + "\n#define NORMALS " + std::to_string(normals) + "\n";
+}
+
+// laid out like the Frame block under std140 rules: the mat4 is four vec4
+// columns, then a vec4, then the scalars packed after it
+struct FrameUniforms {
+	glm::mat4 view;   //offset 0
+	glm::vec4 light;  //offset 64
+	GLfloat time;     //offset 80
+	GLfloat scale;    //offset 84
+	glm::vec2 resolution;  //offset 88, rounds the block up to 96 bytes
+};
+static_assert(sizeof(FrameUniforms) == 96, "FrameUniforms has to match the std140 layout of Frame");
+
+class FrameContext {
+public:
+	FrameContext() : time(0.0f), scroll(0), scale(1.0f), resolution(1.0f), proj(1.0f), buffer(0), uploaded_scroll(0) {}
+
+	void create();
+	void update();
+
+	static void attach(GLuint program);
+
+	glm::mat4 get_view() const    {return values.view;}
+
+	bool changed() const          {return time != values.time || scale != values.scale || resolution != values.resolution
+	                                      || scroll != uploaded_scroll;}
+
+	float time;      //animation time, in ANIMATION_RATE units a second
+	int scroll;      //which variant of the programs to draw with, see SCROLL_MODES
+	float scale;     //of the terrain's texture coordinates
+	glm::vec2 resolution;  //of the scene, in its pixels a window pixel, see PostProcess
+	glm::mat4 proj;
+
+private:
+	GLuint buffer;
+	FrameUniforms values;
+	int uploaded_scroll;  //the scroll isn't in the block, programs are picked by it
+};
+
+//****************************************************************************
+//  Function: FrameContext::create
+//
+//  Purpose:
+//    Allocates the uniform buffer and binds it for every program to use.
+//****************************************************************************
+void FrameContext::create() {
 	glGenBuffers(1, &buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, buffer);
-	int num_bytes_points = sizeof(glm::vec3) * points.size();
-	glBufferData(GL_ARRAY_BUFFER, num_bytes_points, NULL, GL_STATIC_DRAW);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, num_bytes_points, &points[0]);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, buffer);
+	update();
+}
 
-	//SHADERS (COMPILE, USE)
-	cout << " compiling ground shaders" << endl;
-	Shader s("resources/shaders/ground_vert.glsl", "resources/shaders/ground_frag.glsl");
-	Shader s2("resources/shaders/ground_sel_vert.glsl", "resources/shaders/ground_sel_frag.glsl");
+//****************************************************************************
+//  Function: FrameContext::update
+//
+//  Purpose:
+//    The projection times the view's rotations, the last of which sways with
+//    time, and the light that turns about the z axis. They're the same for
+//    every vertex and fragment, so they're worked out here once a frame. The
+//    shaders' rotationMatrix() turns the other way from glm::rotate, hence
+//    the negative angles.
+//****************************************************************************
+void FrameContext::update() {
+	float sway = 0.5f * sinf(0.0005f * time) + 0.3f;
+	values.view = glm::rotate(proj, -0.25f, glm::vec3(0.0f, 1.0f, 0.0f));
+	values.view = glm::rotate(values.view, -2.15f, glm::vec3(1.0f, 0.0f, 0.0f));
+	values.view = glm::rotate(values.view, -sway, glm::vec3(0.0f, 0.0f, 1.0f));
 
+	values.light = glm::rotate(glm::mat4(1.0f), -2.2f * sinf(0.01f * time), glm::vec3(0.0f, 0.0f, 1.0f)) * glm::vec4(1.0f);
+
+	values.time = time;
+	values.scale = scale;
+	values.resolution = resolution;
+	uploaded_scroll = scroll;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &values);
+}
+
+//****************************************************************************
+//  Function: FrameContext::attach
+//
+//  Purpose:
+//    Binds the program's Frame block, if it uses one, to the frame's buffer.
+//****************************************************************************
+void FrameContext::attach(GLuint program) {
+	GLuint block = glGetUniformBlockIndex(program, "Frame");
+	if(block != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, block, FRAME_UNIFORM_BINDING);
+}
+
+//******************************************************************************
+//  Class: FramePacer
+//
+//  Purpose:  Keeps time for the render loop with the monotonic clock. The
+//        simulation steps SIM_RATE times a second of running time, however
+//        fast frames come, out of an accumulator of the time since the last
+//        step, and frames are drawn between its last two steps. Animation
+//        follows running time rather than counting frames. A cap on the
+//        frame rate spaces frames out, so the loop doesn't spin.
+//
+//  Functions:
+//
+//    Advance:
+//        Called at the start of a frame. Adds the time since the last frame
+//        if running, and returns how many steps the simulation owes. The
+//        first frame after a pause adds nothing, since it was paused since
+//        the frame before it, however long ago that was.
+//
+//    Get Alpha:
+//        How far the frame is from the last step to the next, 0 to 1.
+//
+//    Get Time:
+//        Seconds of running time, not counting when it was paused.
+//
+//    Set Cap, Until Next Frame:
+//        The most frames a second, 0 for no limit, and how many seconds until
+//        the cap allows the next frame.
+//******************************************************************************
+
+#define SIM_RATE 60.0        //simulation steps a second
+#define SIM_MAX_STEPS 5      //caught up in one frame, the rest is dropped
+#define ANIMATION_RATE 60.0  //units of animation time a second, one a frame at 60 fps
+
+class FramePacer {
+public:
+	FramePacer() : started(false), was_running(false), running_time(0.0), accumulator(0.0), cap(0.0) {}
+
+	int advance(bool running);
+
+	float get_alpha()             {return accumulator * SIM_RATE;}
+	double get_time()             {return running_time;}
+
+	void set_cap(double fps)      {cap = fps;}
+	double until_next_frame();
+
+private:
+	typedef std::chrono::steady_clock clock;
+
+	clock::time_point last_frame;
+	bool started;
+	bool was_running;
+	double running_time;
+	double accumulator;  //seconds since the last step
+	double cap;
+};
+
+int FramePacer::advance(bool running) {
+	clock::time_point now = clock::now();
+	double elapsed = started && was_running ? std::chrono::duration<double>(now - last_frame).count() : 0.0;
+	last_frame = now;
+	started = true;
+	was_running = running;
+	if(!running)
+		return 0;
+
+	running_time += elapsed;
+	accumulator += elapsed;
+	int steps = (int)(accumulator * SIM_RATE);
+	accumulator -= steps / SIM_RATE;
+	if(steps > SIM_MAX_STEPS)
+		steps = SIM_MAX_STEPS;  //after a stall, rather than spiralling to catch up
+	return steps;
+}
+
+double FramePacer::until_next_frame() {
+	if(cap <= 0.0 || !started)
+		return 0.0;
+	double since = std::chrono::duration<double>(clock::now() - last_frame).count();
+	return std::max(0.0, 1.0 / cap - since);
+}
+
+//******************************************************************************
+//  Class: ResolutionScaler
+//
+//  Purpose:  Picks the scale PostProcess draws the scene at, to hold the GPU
+//        time of a frame to a budget. The time Profiler measured is
+//        smoothed, and since it goes roughly as the scene's pixels, the
+//        scale that fits the budget goes as the square root of the ratio.
+//        It only moves in steps, and waits for frames drawn at a new scale
+//        to be measured before moving again.
+//
+//  Functions:
+//
+//    Set Budget:
+//        Milliseconds of GPU time a frame, and the scale to start at. With a
+//        budget of 0 the scale stays there.
+//
+//    Update:
+//        Takes the GPU time of a frame, negative if there isn't one, and
+//        returns the scale to draw the next at.
+//******************************************************************************
+
+#define RES_SCALE_MIN 0.5f    //of the window's width and height
+#define RES_SCALE_STEP 0.05f
+#define RES_SCALE_HEADROOM 0.9  //of the budget to aim for
+#define RES_SCALE_SMOOTHING 0.1 //weight of each new time
+
+class ResolutionScaler {
+public:
+	ResolutionScaler() : budget(0.0), smoothed(-1.0), scale(1.0f), settling(0) {}
+
+	void set_budget(double ms, float s)  {budget = ms; scale = s; smoothed = -1.0;}
+	float update(double gpu_ms);
+
+	float get_scale()             {return scale;}
+
+private:
+	double budget;
+	double smoothed;  //GPU time, negative until there is one
+	float scale;
+	int settling;     //frames until the ones at the new scale are measured
+};
+
+float ResolutionScaler::update(double gpu_ms) {
+	if(budget <= 0.0 || gpu_ms < 0.0)
+		return scale;
+	if(settling > 0) {
+		settling--;
+		return scale;
+	}
+
+	smoothed = smoothed < 0.0 ? gpu_ms : smoothed + RES_SCALE_SMOOTHING * (gpu_ms - smoothed);
+
+	//the step under the scale that would take the headroom. It goes down
+	//once it's over the budget, and up when there's room, and stays put in
+	//between so it doesn't flicker between two steps
+	float wanted = scale * sqrt(RES_SCALE_HEADROOM * budget / smoothed);
+	wanted = std::min(1.0f, std::max(RES_SCALE_MIN, RES_SCALE_STEP * floorf(wanted / RES_SCALE_STEP + 0.001f)));
+	if(wanted > scale || (wanted < scale && smoothed > budget)) {
+		scale = wanted;
+		smoothed = -1.0;
+		settling = PROFILER_LATENCY + 1;
+	}
+	return scale;
+}
+
+//******************************************************************************
+//  Class: OffscreenTarget
+//
+//  Purpose:  A framebuffer object with color textures and a depth buffer, for
+//        drawing without a window, like the --headless benchmark does, or
+//        drawing the scene for PostProcess to read back.
+//
+//  Functions:
+//
+//    Create:
+//        Allocates the buffers at that size, in place of any it had, with
+//        that many color textures for the fragment shaders' outputs 0 on.
+//        Needs the GL context.
+//
+//    Bind:
+//        Draws to it from then on, over all of it. Reads come from its first
+//        color texture.
+//******************************************************************************
+
+#define OFFSCREEN_MAX_COLORS 4
+
+class OffscreenTarget {
+public:
+	OffscreenTarget() : fbo(0), colors(0), depth(0), width(0), height(0) {}
+
+	bool create(int w, int h, int attachments = 1);
+	void bind();
+
+	GLuint get_color(int i)       {return color[i];}
+	int get_width()               {return width;}
+	int get_height()              {return height;}
+
+private:
+	GLuint fbo, color[OFFSCREEN_MAX_COLORS];
+	int colors;
+	GLuint depth;
+	int width, height;
+};
+
+bool OffscreenTarget::create(int w, int h, int attachments) {
+	if(fbo) {
+		glDeleteFramebuffers(1, &fbo);
+		glDeleteTextures(colors, color);
+		glDeleteRenderbuffers(1, &depth);
+		GLState::invalidate();  //the textures may still be bound
+	}
+	width = w;
+	height = h;
+	colors = attachments;
+
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+	//read a texel at a time, so nothing is filtered
+	GLenum buffers[OFFSCREEN_MAX_COLORS];
+	glGenTextures(colors, color);
+	for(int i = 0; i < colors; i++) {
+		GLState::edit_texture(color[i]);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, color[i], 0);
+		buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+	}
+	glDrawBuffers(colors, buffers);
+
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, w, h);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+	return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+void OffscreenTarget::bind() {
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glViewport(0, 0, width, height);
+}
+
+//******************************************************************************
+//  Class: PostProcess
+//
+//  Purpose:  The scene is drawn into its target, and it draws it to the
+//        window with the scanline, dither and tint styles, in one pass over
+//        each pixel. The scene's programs write three outputs, see
+//        scene.glsl: the scene, the style of what's in front, and the scene
+//        again without the water. The water is only shown on some pixels,
+//        and the others show what's under it.
+//        The scene can be drawn at a fraction of the window's resolution, in
+//        the corner of its target, and is upscaled with a Catmull-Rom filter.
+//        The styles stay on the window's pixels.
+//
+//  Functions:
+//
+//    Constructor:
+//        Compiles the program, and makes the empty vertex array that the
+//        fullscreen triangle is drawn with. Its corners come from
+//        gl_VertexID.
+//
+//    Resize:
+//        Makes the scene's target over at the window's size, if it isn't
+//        already. Returns whether it did, and its scene has to be drawn again.
+//
+//    Set Scale, Get Resolution:
+//        The fraction of the window's width and height the scene is drawn at,
+//        and the scene's pixels a window pixel that works out to, in x and y.
+//
+//    Bind Scene:
+//        Draws the scene into the target from then on, at the scale.
+//
+//    Display:
+//        Queues the pass that styles the scene onto whatever's bound when
+//        the queue is executed.
+//******************************************************************************
+
+#define SCENE_OUTPUTS 3  //the scene, the style of what's in front, the scene without water
+
+class PostProcess {
+public:
+	PostProcess();
+
+	bool resize(int w, int h);
+	void bind_scene();
+	void display(DrawQueue& queue);
+
+	void set_scale(float s)       {scale = s;}
+	float get_scale()             {return scale;}
+	glm::vec2 get_resolution();
+
+	int get_width()               {return scene.get_width();}
+	int get_height()              {return scene.get_height();}
+
+private:
+	GLuint vao;
+	GLuint shader_program;
+	OffscreenTarget scene;
+	float scale;
+
+	void setup_uniforms();
+	int scaled(int size)          {return std::max(1, (int)(size * scale + 0.5f));}
+};
+
+PostProcess::PostProcess() : scale(1.0f) {
+	glGenVertexArrays(1, &vao);
+
+	cout << " compiling post process shaders" << endl;
+	Shader s("resources/shaders/post_vert.glsl", "resources/shaders/post_frag.glsl");
 	shader_program = s.Program;
-	selection_shader_program = s2.Program;
+	ShaderReloader::Watch(s, &shader_program, [this]() {setup_uniforms();});
 
+	setup_uniforms();
+}
+
+void PostProcess::setup_uniforms() {
 	glUseProgram(shader_program);
-	glUseProgram(selection_shader_program);
+	FrameContext::attach(shader_program);
+	glUniform1i(glGetUniformLocation(shader_program, "scene_tex"), 0);     //the scene goes in texture unit 0
+	glUniform1i(glGetUniformLocation(shader_program, "style_tex"), 1);     //the styles in unit 1
+	glUniform1i(glGetUniformLocation(shader_program, "dry_tex"), 2);       //the scene without water in unit 2
+}
 
-	//VERTEX ATTRIB AND UNIFORM LOCATIONS
+bool PostProcess::resize(int w, int h) {
+	if(w == scene.get_width() && h == scene.get_height())
+		return false;
+	if(!scene.create(w, h, SCENE_OUTPUTS))
+		cout << "couldn't create the " << w << "x" << h << " scene target" << endl;
+	return true;
+}
 
-	// Initialize the vertex position attribute from the vertex shader
-	vPosition = glGetAttribLocation(shader_program, "vPosition");
-	glEnableVertexAttribArray(vPosition);
-	glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, 0, ((GLvoid*) (0)));
+void PostProcess::bind_scene() {
+	scene.bind();
+	glViewport(0, 0, scaled(scene.get_width()), scaled(scene.get_height()));
+}
 
-	//UNIFORMS
-	uTime = glGetUniformLocation(shader_program, "t");
-	glUniform1i(uTime, time);
+glm::vec2 PostProcess::get_resolution() {
+	return glm::vec2((float)scaled(scene.get_width()) / scene.get_width(),
+	                 (float)scaled(scene.get_height()) / scene.get_height());
+}
 
-	uScroll = glGetUniformLocation(shader_program, "scroll");
-	glUniform1i(uScroll, scroll);
+//****************************************************************************
+//  Function: PostProcess::display()
+//
+//  Purpose:
+//    Queues the fullscreen triangle. It covers every pixel once, without the
+//    depth test, so the window's depth buffer doesn't matter
+//****************************************************************************
+void PostProcess::display(DrawQueue& queue) {
+	draw_packet p;
+	p.program = shader_program;
+	p.vao = vao;
+	p.blend = false;
+	p.pass = "post process";
+
+	for(int i = 0; i < SCENE_OUTPUTS; i++)
+		p.textures[i] = scene.get_color(i);
+	p.textures[3] = 0;
+
+	p.draw = []() {
+		glDisable(GL_DEPTH_TEST);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glEnable(GL_DEPTH_TEST);
+	};
+	queue.submit(p);
+}
 
-	uNorm = glGetUniformLocation(shader_program, "show_normals");
-	glUniform1i(uNorm, show_normals);
+//******************************************************************************
+//  Class: FrameRecorder
+//
+//  Purpose:  Records the frames that are drawn as a png sequence, without
+//        waiting on the GPU or the encoder. Each frame is read into the next
+//        of a ring of pixel pack buffers, with a fence after it, and copied
+//        out once the fence says the GPU is done, a frame or two later. The
+//        pixels go to a FrameEncoder, whose threads encode them.
+//
+//  Functions:
+//
+//    Start:
+//        Starts recording to directory, making it if it isn't there. With
+//        drop, frames the encoder can't keep up with are dropped, otherwise
+//        drawing waits for it.
+//
+//    Stop:
+//        Waits for the frames still being read and encoded, and reports.
+//
+//    Capture:
+//        Reads the frame from the framebuffer bound for reading, which has to
+//        be that size. Needs the GL context.
+//
+//    Report:
+//        Prints what the encoder has done, see FrameEncoder::report.
+//******************************************************************************
 
-	uProj = glGetUniformLocation(shader_program, "proj");
-	proj = glm::ortho(-1.0f, 1.0f, 1.0f, -1.0f, -1.0f, 1.0f);
-	glUniformMatrix4fv(uProj, 1, GL_FALSE, glm::value_ptr(proj));
+#define RECORD_BUFFERS 3  //frames that can be being read back at once
 
-	scale = 1.0;
-	uScale = glGetUniformLocation(shader_program, "scale");
-	glUniform1f(uScale, scale);
+class FrameRecorder {
+public:
+	FrameRecorder() : encoder(NULL), width(0), height(0), next(0), frame(0) {}
 
-	//THE TEXTURE
+	bool start(const std::string& directory, bool drop);
+	void stop();
+	bool recording()              {return encoder != NULL;}
 
-	std::vector<unsigned char> image;
-	std::vector<unsigned char> image2;
-	std::vector<unsigned char> image3;
-	std::vector<unsigned char> image4;
+	void capture(int w, int h);
+	void report()                 {if(encoder) encoder->report();}
 
-	unsigned width, height;
-	unsigned width2, height2;
-	unsigned width3, height3;
-	unsigned width4, height4;
+private:
+	struct readback {
+		GLuint buffer;
+		GLsync fence;     //0 when it isn't being read
+		unsigned frame;
+	};
+
+	void allocate(int w, int h);
+	void collect(readback& r, bool wait);
+
+	FrameEncoder* encoder;
+	readback ring[RECORD_BUFFERS];
+	int width, height;
+	int next;             //the slot the next frame is read into
+	unsigned frame;       //numbers the files
+	std::vector<unsigned char> pixels;  //the next frame's, swapped into the encoder
+};
 
-	unsigned error = lodepng::decode(image, width, height, GROUND_TEXTURE_PATH, LodePNGColorType::LCT_RGBA, 8);
-	unsigned error2 = lodepng::decode(image2, width2, height2, GROUND_NORMAL_PATH, LodePNGColorType::LCT_RGBA, 8);
-	unsigned error3 = lodepng::decode(image3, width3, height3, GROUND_NORMAL2_PATH, LodePNGColorType::LCT_RGBA, 8);
-	unsigned error4 = lodepng::decode(image4, width4, height4, GROUND_NORMAL3_PATH, LodePNGColorType::LCT_RGBA, 8);
+bool FrameRecorder::start(const std::string& directory, bool drop) {
+	if(encoder)
+		return true;
+	mkdir(directory.c_str(), 0755);
+	struct stat info;
+	if(stat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+		cout << "couldn't record to " << directory << endl;
+		return false;
+	}
+	encoder = new FrameEncoder(directory, drop);
+	frame = 0;
+	cout << "recording to " << directory << (drop ? ", dropping frames it can't keep up with" : "") << endl;
+	return true;
+}
 
-	// If there's an error, display it.
-	if(error != 0) {
-		std::cout << "error with lodepng texture loading " << error << ": " << lodepng_error_text(error) << std::endl;
+void FrameRecorder::stop() {
+	if(!encoder)
+		return;
+	for(int i = 0; i < RECORD_BUFFERS; i++)
+		collect(ring[(next + i) % RECORD_BUFFERS], true);
+	encoder->finish();
+	encoder->report();
+	delete encoder;
+	encoder = NULL;
+}
+
+// sizes the ring for frames of w by h, once the frames being read are in
+void FrameRecorder::allocate(int w, int h) {
+	if(width) {
+		for(int i = 0; i < RECORD_BUFFERS; i++)
+			collect(ring[(next + i) % RECORD_BUFFERS], true);
+	} else {
+		for(int i = 0; i < RECORD_BUFFERS; i++) {
+			glGenBuffers(1, &ring[i].buffer);
+			ring[i].fence = 0;
+		}
 	}
+	width = w;
+	height = h;
+	for(int i = 0; i < RECORD_BUFFERS; i++) {
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, ring[i].buffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, (size_t)w * h * 3, NULL, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
 
-	if(error2 != 0) {
-		std::cout << "error2 with lodepng texture loading " << error2 << ": " << lodepng_error_text(error2) << std::endl;
+// hands a slot's frame to the encoder, if the GPU has finished reading it, or
+// once it has with wait. If the wait or the mapping fails, the frame is
+// counted as failed and the slot freed
+void FrameRecorder::collect(readback& r, bool wait) {
+	if(!r.fence)
+		return;
+	GLenum status = glClientWaitSync(r.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GL_TIMEOUT_IGNORED : 0);
+	if(status == GL_TIMEOUT_EXPIRED && !wait)
+		return;
+	glDeleteSync(r.fence);
+	r.fence = 0;
+	if(status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+		encoder->fail(r.frame);
+		return;
 	}
 
-	if(error3 != 0) {
-		std::cout << "error3 with lodepng texture loading " << error3 << ": " << lodepng_error_text(error3) << std::endl;
+	size_t size = (size_t)width * height * 3;
+	pixels.resize(size);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r.buffer);
+	void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+	if(mapped) {
+		memcpy(&pixels[0], mapped, size);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		encoder->submit(pixels, width, height, r.frame);
+	} else {
+		encoder->fail(r.frame);
 	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
 
-	if(error4 != 0) {
-		std::cout << "error4 with lodepng texture loading " << error4 << ": " << lodepng_error_text(error4) << std::endl;
+//****************************************************************************
+//  Function: FrameRecorder::capture()
+//
+//  Purpose:
+//    Passes the frames the GPU has finished reading on to the encoder, oldest
+//    first, then starts reading this one into the next buffer. That buffer
+//    only has to be waited on if the GPU is RECORD_BUFFERS frames behind
+//****************************************************************************
+void FrameRecorder::capture(int w, int h) {
+	if(!encoder)
+		return;
+	if(w != width || h != height)
+		allocate(w, h);
+
+	Profiler::begin("record", false);
+	for(int i = 0; i < RECORD_BUFFERS; i++) {
+		readback& r = ring[(next + i) % RECORD_BUFFERS];
+		collect(r, i == 0);
+		if(r.fence)
+			break;  //the ones after it are newer, so not done either
 	}
 
-	glEnable(GL_TEXTURE_2D);
-	glGenTextures(1, &height_tex);
-	glBindTexture(GL_TEXTURE_2D, height_tex);
+	readback& r = ring[next];
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, r.buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	r.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	r.frame = frame++;
+	next = (next + 1) % RECORD_BUFFERS;
+	Profiler::end();
+}
+
+//******************************************************************************
+//  Class: GroundModel
+//
+//  Purpose:  To represent the ground on the GPU, and everything that goes along
+//        with displaying this ball to the user.
+//
+//  Functions:
+//
+//    Constructor:
+//        Takes no arguments, calls generate_points() to create geometry. Then
+//        buffers all this data to the GPU memory.
+//
+//    Setters:
+//        Used to update the values of the uniform variables.
+//
+//    Generate Points:
+//        Creates a square, subdivides the faces several times, and creates
+//        triangles to span the shape. This data is used to populate the
+//        vectors containing point data.
+//
+//    Display:
+//        Queues a draw packet with the shader variant for the scroll mode,
+//        the vertex array and the textures it's drawn with, and the draw
+//        calls. The draw queue binds them and issues the draws.
+//
+//    Pick:
+//        Finds the ground under a point of the window, in normalized device
+//        coordinates, on the CPU. It's the surface the selection shaders
+//        draw, from a copy of the height texture.
+//******************************************************************************
+
+class GroundModel {
+public:
+	GroundModel();
+
+	void display(DrawQueue& queue, int scroll, bool select=false);
+	bool pick(terrain_hit& hit, const FrameContext& frame, glm::vec2 ndc);
+
+	void toggle_normals()         {if(show_normals==0){show_normals=1;}else{show_normals=0;}}
+
+private:
+	GLuint vao;
+	GLuint buffer;
+
+	ProgressiveTexture height_tex;
+	ProgressiveTexture normal_tex_1;
+	ProgressiveTexture normal_tex_2;
+	ProgressiveTexture normal_tex_3;
+
+	GLuint shader_programs[SCROLL_MODES][2];  //by scroll mode, then without and with the normals
+	GLuint selection_shader_programs[SCROLL_MODES];
+
+	int num_pts; //how many points?
+
+	//VERTEX ATTRIB LOCATIONS
+	GLuint vPosition;
+
+	//WHICH VARIANT TO USE
+	int show_normals;
+
+	//THE HEIGHTS ON THE CPU, built on the texture's worker thread
+	Heightfield heightfield;
+	std::mutex heightfield_lock;
+
+	void setup_uniforms();
+	void generate_points();
+	void subd_square(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d);
+
+	std::vector<glm::vec3> points;    //add the 1.0 w value in the shader
+};
+
+//****************************************************************************
+//  Function: GroundModel Constructor
+//
+//  Purpose:
+//    Calls generate_points() and then sets up everything related to the GPU
+//****************************************************************************
+GroundModel::GroundModel() {
 
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	//initialize all the vectors
+	points.clear();
 
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2048, 2048, 0, GL_RGBA, GL_UNSIGNED_BYTE, &image[0]);
+	show_normals = 0;
 
-	glGenerateMipmap(GL_TEXTURE_2D);
+	//fill those vectors with geometry
+	generate_points();
 
-	cout << " loaded height texture" << endl;
+	//SETTING UP GPU STUFF
+	//VAO
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
 
-	glGenTextures(1, &normal_tex_1);
-	glBindTexture(GL_TEXTURE_2D, normal_tex_1);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2048, 2048, 0, GL_RGBA, GL_UNSIGNED_BYTE, &image2[0]);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	cout << " loaded normal texture" << endl;
+	//BUFFER, SEND DATA
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	int num_bytes_points = sizeof(glm::vec3) * points.size();
+	glBufferData(GL_ARRAY_BUFFER, num_bytes_points, NULL, GL_STATIC_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, num_bytes_points, &points[0]);
 
-	glGenTextures(1, &normal_tex_2);
-	glBindTexture(GL_TEXTURE_2D, normal_tex_2);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2048, 2048, 0, GL_RGBA, GL_UNSIGNED_BYTE, &image3[0]);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	cout << " loaded normal texture2" << endl;
+	//SHADERS (COMPILE), every variant up front so switching never stalls a frame
+	cout << " compiling ground shaders" << endl;
+	for(int scroll = 0; scroll < SCROLL_MODES; scroll++) {
+		for(int normals = 0; normals < 2; normals++) {
+			Shader s("resources/shaders/ground_vert.glsl", "resources/shaders/ground_frag.glsl", variant_defines(scroll, normals));
+			shader_programs[scroll][normals] = s.Program;
+			ShaderReloader::Watch(s, &shader_programs[scroll][normals], [this]() {setup_uniforms();});
+		}
+		Shader s2("resources/shaders/ground_sel_vert.glsl", "resources/shaders/ground_sel_frag.glsl", variant_defines(scroll));
+		selection_shader_programs[scroll] = s2.Program;
+		ShaderReloader::Watch(s2, &selection_shader_programs[scroll], [this]() {setup_uniforms();});
+	}
 
+	//VERTEX ATTRIB AND UNIFORM LOCATIONS
 
+	// Initialize the vertex position attribute from the vertex shader, the
+	// only input of every variant
+	vPosition = glGetAttribLocation(shader_programs[0][0], "vPosition");
+	glEnableVertexAttribArray(vPosition);
+	glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, 0, ((GLvoid*) (0)));
 
-	glGenTextures(1, &normal_tex_3);
-	glBindTexture(GL_TEXTURE_2D, normal_tex_3);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2048, 2048, 0, GL_RGBA, GL_UNSIGNED_BYTE, &image4[0]);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	cout << " loaded normal texture3" << endl;
+	//THE TEXTURES, decoded on worker threads so the first frames don't wait for them
+	height_tex.load(GROUND_TEXTURE_PATH, [this](const std::vector<unsigned char>& image, unsigned w, unsigned h) {
+		Heightfield built;
+		built.build(&image[0], w, h);
+		std::lock_guard<std::mutex> guard(heightfield_lock);
+		heightfield = std::move(built);
+	});
+	normal_tex_1.load(GROUND_NORMAL_PATH);
+	normal_tex_2.load(GROUND_NORMAL2_PATH);
+	normal_tex_3.load(GROUND_NORMAL3_PATH);
 
-	uHeightSampler = glGetUniformLocation(shader_program, "height_tex");
-	uNormal1Sampler = glGetUniformLocation(shader_program, "normal_tex");
-	uNormal2Sampler = glGetUniformLocation(shader_program, "normal_smooth1_tex");
-	uNormal3Sampler = glGetUniformLocation(shader_program, "normal_smooth2_tex");
+	//UNIFORMS
+	setup_uniforms();
+}
 
-	glUniform1i(uHeightSampler, 0);  //height in texture unit 0
-	glUniform1i(uNormal1Sampler, 1);  //normal1 goes in texture unit 1
-	glUniform1i(uNormal2Sampler, 2);  //normal2 goes in texture unit 2
-	glUniform1i(uNormal3Sampler, 3);  //normal3 goes in texture unit 3
+//****************************************************************************
+//  Function: GroundModel::setup_uniforms()
+//
+//  Purpose:
+//    Sets the uniforms that don't change, the same for each variant. Called
+//    again whenever a program is replaced by a reloaded one.
+//****************************************************************************
+void GroundModel::setup_uniforms() {
+	for(int scroll = 0; scroll < SCROLL_MODES; scroll++) {
+		for(int normals = 0; normals < 2; normals++) {
+			GLuint program = shader_programs[scroll][normals];
+			glUseProgram(program);
+			FrameContext::attach(program);
+
+			glUniform1i(glGetUniformLocation(program, "height_tex"), 0);  //height in texture unit 0
+			glUniform1i(glGetUniformLocation(program, "normal_tex"), 1);  //normal1 goes in texture unit 1
+			glUniform1i(glGetUniformLocation(program, "normal_smooth1_tex"), 2);  //normal2 goes in texture unit 2
+			glUniform1i(glGetUniformLocation(program, "normal_smooth2_tex"), 3);  //normal3 goes in texture unit 3
+		}
+		FrameContext::attach(selection_shader_programs[scroll]);
+	}
 }
 
 //****************************************************************************
@@ -358,61 +1585,46 @@ void GroundModel::subd_square(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d
   //  Function: GroundModel::display()
   //
   //  Purpose:
-  //    This function does all the setup for the buffers and uniforms and then
-  //    issues a draw call for the geometry representing this object
+  //    Queues a draw of this object with the program, vertex array and
+  //    textures it needs, for the draw queue to issue with the others
   //****************************************************************************
 
-void GroundModel::display(bool select) {
-	glBindVertexArray(vao);
+void GroundModel::display(DrawQueue& queue, int scroll, bool select) {
+	draw_packet p;
+	p.vao = vao;
+	p.blend = false;
+	p.pass = "ground";
 
 	if(select) {
-		glUseProgram(selection_shader_program);
-
-		glUniform1i(uTime, time);
-		glUniform1i(uScroll, scroll);
-		glUniform1f(uScale, scale);
-		// glUniform1i(uNorm, show_normals);
+		p.program = selection_shader_programs[scroll];
 
-		glActiveTexture(GL_TEXTURE0 + 0); // Texture unit 0
-		glBindTexture(GL_TEXTURE_2D, height_tex);
-
-		glActiveTexture(GL_TEXTURE0 + 1); // Texture unit 1
-		glBindTexture(GL_TEXTURE_2D, normal_tex_1);
-
-		glActiveTexture(GL_TEXTURE0 + 2); // Texture unit 2
-		glBindTexture(GL_TEXTURE_2D, normal_tex_2);
-
-		glActiveTexture(GL_TEXTURE0 + 3); // Texture unit 3
-		glBindTexture(GL_TEXTURE_2D, normal_tex_3);
-
-
-		glUniformMatrix4fv(uProj, 1, GL_FALSE, glm::value_ptr(proj));
-
-		glDrawArrays(GL_TRIANGLES, 0, num_pts);
+		p.textures[0] = height_tex.get(); // Texture unit 0, the only one it reads
+		p.textures[1] = p.textures[2] = p.textures[3] = 0;
 	} else {
-		glUseProgram(shader_program);
-
-		glUniform1i(uTime, time);
-		glUniform1i(uScroll, scroll);
-		glUniform1f(uScale, scale);
-		glUniform1i(uNorm, show_normals);
-
-		glActiveTexture(GL_TEXTURE0 + 0); // Texture unit 0
-		glBindTexture(GL_TEXTURE_2D, height_tex);
+		p.program = shader_programs[scroll][show_normals];
 
-		glActiveTexture(GL_TEXTURE0 + 1); // Texture unit 1
-		glBindTexture(GL_TEXTURE_2D, normal_tex_1);
-
-		glActiveTexture(GL_TEXTURE0 + 2); // Texture unit 2
-		glBindTexture(GL_TEXTURE_2D, normal_tex_2);
-
-		glActiveTexture(GL_TEXTURE0 + 3); // Texture unit 3
-		glBindTexture(GL_TEXTURE_2D, normal_tex_3);
+		p.textures[0] = height_tex.get(); // Texture unit 0
+		p.textures[1] = normal_tex_1.get(); // Texture unit 1
+		p.textures[2] = normal_tex_2.get(); // Texture unit 2
+		p.textures[3] = normal_tex_3.get(); // Texture unit 3
+	}
 
-		glUniformMatrix4fv(uProj, 1, GL_FALSE, glm::value_ptr(proj));
+	int n = num_pts;
+	p.draw = [n]() {glDrawArrays(GL_TRIANGLES, 0, n);};
+	queue.submit(p);
+}
 
-		glDrawArrays(GL_TRIANGLES, 0, num_pts);
-	}
+//****************************************************************************
+//  Function: GroundModel::pick()
+//
+//  Purpose:
+//    Marches the ray under the point through the heights, as they're drawn
+//    this frame. Until the texture is decoded it's all water, like the
+//    black texel it starts as.
+//****************************************************************************
+bool GroundModel::pick(terrain_hit& hit, const FrameContext& frame, glm::vec2 ndc) {
+	std::lock_guard<std::mutex> guard(heightfield_lock);
+	return heightfield.pick(hit, frame.get_view(), ndc, frame.scroll, frame.time, frame.scale);
 }
 
 //******************************************************************************
@@ -436,78 +1648,85 @@ void GroundModel::display(bool select) {
 //        vectors containing point data.
 //
 //    Display:
-//        Makes sure the correct shader is being used, that the correct buffers
-//        are bound, that the vertex attributes are set up, and that all the
-//        latest values of the uniform variables are sent to the GPU.
+//        Uploads the entities if they changed, and queues a draw packet with
+//        the shader, the vertex array and the textures they're drawn with.
+//        The draw queue binds them and issues the instanced draws.
+//
+//    Is Dirty:
+//        Whether the entities or the cursor changed since they were last
+//        uploaded, so the next frame would look different. The cursor only
+//        counts while it's drawn.
 //******************************************************************************
 
 class DudesAndTreesModel {
 	typedef struct entity_t {
 		glm::vec3 location; //really only using x,y
+		glm::vec3 previous; //location before the last step, to draw in between
 		int type; //0 good, 1 bad, 2 tree, 3 box
 		bool dead;
 	} entity;
 
+	//what the vertex shader gets for each entity it draws
+	typedef struct instance_t {
+		glm::vec3 offset;     //location of the entity
+		glm::vec3 color;
+		GLfloat point_size;
+		GLfloat bounce;       //1 bobs up and down, 0 doesn't
+	} instance;
+
 public:
 	DudesAndTreesModel(int num_good_guys, int num_bad_guys, int num_trees, int num_boxes_initial);
 
-	void display();
-	void update_sim();  //called from timer function
+	void display(DrawQueue& queue, float alpha);
+	void update_sim();  //called for every fixed step
 	void handle_click(glm::vec3 pixel_read);  //called from mouse callback
-	void set_time(int tin)        {time = tin;}
-	void set_scroll(int sin)      {scroll = sin;}
-	void scale_up()               {scale *= 1.618f;}
-	void scale_down()             {scale /= 1.618f;}
-	void set_proj(glm::mat4 pin)  {proj = pin;}
 
 	int get_score()               {return score;}
 	int get_status()              {return status;}
 	int get_boxes_left()          {return boxes_left;}
 
-	void toggle_cursor_draw()     {cursor_draw = !cursor_draw;}
+	void toggle_cursor_draw()     {cursor_draw = !cursor_draw; instances_dirty = true;}
+
+	void set_pos(glm::vec3 pin, glm::vec3 cin);
 
-	void set_pos(glm::vec3 pin, glm::vec3 cin)   {point_sprite_position = pin; point_sprite_color = cin;}
+	bool is_dirty()               {return instances_dirty;}
 
 	bool big_radius;
 
 private:
 	GLuint vao;
 	GLuint buffer;
-	GLuint ground_tex;
-	GLuint ground_norm_tex;
+	GLuint instance_buffer;
+	ProgressiveTexture ground_tex;
+	ProgressiveTexture ground_norm_tex;
 	GLuint point_sprite;
 	GLuint shader_program;
 
 	std::vector<entity> entities;
 
+	//the guys, tree trunks, treetops and boxes, one after another, then the cursor
+	std::vector<instance> instances;
+	int num_guys, num_trees, num_boxes;
+	bool instances_dirty;  //the entities changed since they were last uploaded
+	float drawn_alpha;     //how far between steps they were uploaded
+
 	int num_box_pts, num_tree_pts, num_treetop_pts, box_start, boxes_left, score, status; //how many points?
 
 	//VERTEX ATTRIB LOCATIONS
 	GLuint vPosition;
+	GLuint iOffset, iColor, iState;  //per instance
 
 	//UNIFORM LOCATIONS
-	GLuint uTime;   //animation time
-	GLuint uProj;   //projection matrix
-	GLuint uScroll;
-	GLuint uScale;
-	GLuint uColor;
-	GLuint uPosition;
-	GLuint uBounce;
-
 	GLuint uHeightSampler;  //textures
 	GLuint uNormalSampler;
 	GLuint uPointSpriteSampler;
 
-	//VALUES OF THOSE UNIFORMS
-	int time, bounce;
-	int scroll;
-	float scale;
-
 	glm::vec3 point_sprite_color;
 	glm::vec3 point_sprite_position;
 
-	glm::mat4 proj;
-
+	void setup_uniforms();
+	void update_instances(float alpha);
+	void draw();
 	void generate_points();
 	void subd_square(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d);
 
@@ -586,6 +1805,9 @@ DudesAndTreesModel::DudesAndTreesModel(int num_good_guys, int num_bad_guys, int
 		entities.push_back(temp);
 	}
 
+	for(auto &x : entities)
+		x.previous = x.location;
+
 	//SETTING UP GPU STUFF
 	//VAO
 	glGenVertexArrays(1, &vao);
@@ -604,8 +1826,7 @@ DudesAndTreesModel::DudesAndTreesModel(int num_good_guys, int num_bad_guys, int
 	Shader s("resources/shaders/dudesandtrees_vert.glsl", "resources/shaders/dudesandtrees_frag.glsl");
 
 	shader_program = s.Program;
-
-	glUseProgram(shader_program);
+	ShaderReloader::Watch(s, &shader_program, [this]() {setup_uniforms();});
 
 	//VERTEX ATTRIB AND UNIFORM LOCATIONS
 	// Initialize the vertex position attribute from the vertex shader
@@ -613,82 +1834,47 @@ DudesAndTreesModel::DudesAndTreesModel(int num_good_guys, int num_bad_guys, int
 	glEnableVertexAttribArray(vPosition);
 	glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, 0, ((GLvoid*) (0)));
 
-	//UNIFORMS
-	uTime = glGetUniformLocation(shader_program, "t");
-	glUniform1i(uTime, time);
-
-	uBounce = glGetUniformLocation(shader_program, "bounce");
-	glUniform1i(uBounce, bounce);
+	// The per instance attributes step once per entity instead of per vertex,
+	// so each type of entity is one draw call however many there are
+	glGenBuffers(1, &instance_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
 
-	uScroll = glGetUniformLocation(shader_program, "scroll");
-	glUniform1i(uScroll, scroll);
+	iOffset = glGetAttribLocation(shader_program, "iOffset");
+	glEnableVertexAttribArray(iOffset);
+	glVertexAttribPointer(iOffset, 3, GL_FLOAT, GL_FALSE, sizeof(instance), ((GLvoid*) offsetof(instance, offset)));
+	glVertexAttribDivisor(iOffset, 1);
 
-	uProj = glGetUniformLocation(shader_program, "proj");
-	proj = glm::ortho(-1.0f, 1.0f, 1.0f, -1.0f, -1.0f, 1.0f);
-	glUniformMatrix4fv(uProj, 1, GL_FALSE, glm::value_ptr(proj));
-
-	scale = 1.0;
-	uScale = glGetUniformLocation(shader_program, "scale");
-	glUniform1f(uScale, scale);
+	iColor = glGetAttribLocation(shader_program, "iColor");
+	glEnableVertexAttribArray(iColor);
+	glVertexAttribPointer(iColor, 3, GL_FLOAT, GL_FALSE, sizeof(instance), ((GLvoid*) offsetof(instance, color)));
+	glVertexAttribDivisor(iColor, 1);
 
+	iState = glGetAttribLocation(shader_program, "iState");
+	glEnableVertexAttribArray(iState);
+	glVertexAttribPointer(iState, 2, GL_FLOAT, GL_FALSE, sizeof(instance), ((GLvoid*) offsetof(instance, point_size)));
+	glVertexAttribDivisor(iState, 1);
 
 	point_sprite_color = glm::vec3(0.0,0.0,0.0);
-	uColor = glGetUniformLocation(shader_program, "ucolor");
-	glUniform3fv(uColor, 1, glm::value_ptr(point_sprite_color));
-
 	point_sprite_position = glm::vec3(0.0,0.0,0.0);
-	uPosition = glGetUniformLocation(shader_program, "offset");
-	glUniform3fv(uPosition, 1, glm::value_ptr(point_sprite_position));
+	instances_dirty = true;
+	drawn_alpha = 1.0f;
 
 	//THE TEXTURE
 
-	std::vector<unsigned char> image;
-	std::vector<unsigned char> image2;
-	std::vector<unsigned char> image3;
-
-	unsigned width, height;
-	unsigned error = lodepng::decode(image, width, height, GROUND_TEXTURE_PATH, LodePNGColorType::LCT_RGBA, 8);
+	ground_tex.load(GROUND_TEXTURE_PATH);
+	ground_norm_tex.load(GROUND_NORMAL_PATH);
 
-	unsigned width2, height2;
-	unsigned error2 = lodepng::decode(image2, width2, height2, GROUND_NORMAL_PATH, LodePNGColorType::LCT_RGBA, 8);
+	std::vector<unsigned char> image3;
 
 	unsigned width3, height3;
-	unsigned error3 = lodepng::decode(image3, width3, height3, POINT_SPRITE_PATH, LodePNGColorType::LCT_RGBA, 8);
+	unsigned error3 = decode_texture(image3, width3, height3, POINT_SPRITE_PATH);
 
 	// If there's an error, display it.
-	if(error != 0) {
-		std::cout << "  error with lodepng ground height texture loading " << error << ": " << lodepng_error_text(error) << std::endl;
-	}
-
-	if(error2 != 0) {
-		std::cout << "  error with lodepng ground normal texture loading " << error2 << ": " << lodepng_error_text(error2) << std::endl;
-	}
-
 	if(error3 != 0) {
 		std::cout << "  error with lodepng ground normal texture loading " << error3 << ": " << lodepng_error_text(error3) << std::endl;
 	}
 
 	glEnable(GL_TEXTURE_2D);
-	glGenTextures(1, &ground_tex);
-	glBindTexture(GL_TEXTURE_2D, ground_tex);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2048, 2048, 0, GL_RGBA, GL_UNSIGNED_BYTE, &image[0]);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	cout << " loaded ground texture" << endl;
-
-
-	glGenTextures(1, &ground_norm_tex);
-	glBindTexture(GL_TEXTURE_2D, ground_norm_tex);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2048, 2048, 0, GL_RGBA, GL_UNSIGNED_BYTE, &image2[0]);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	cout << " loaded ground normal texture" << endl;
 
 
 	glGenTextures(1, &point_sprite);
@@ -702,6 +1888,21 @@ DudesAndTreesModel::DudesAndTreesModel(int num_good_guys, int num_bad_guys, int
 
 	cout << " loaded point sprite texture" << endl;
 
+	//UNIFORMS
+	setup_uniforms();
+}
+
+//****************************************************************************
+//  Function: DudesAndTreesModel::setup_uniforms()
+//
+//  Purpose:
+//    Points the samplers at their texture units. Called again whenever the
+//    program is replaced by a reloaded one.
+//****************************************************************************
+void DudesAndTreesModel::setup_uniforms() {
+	glUseProgram(shader_program);
+	FrameContext::attach(shader_program);
+
 	uHeightSampler = glGetUniformLocation(shader_program, "rock_height_tex");
 	uNormalSampler = glGetUniformLocation(shader_program, "rock_normal_tex");
 	uPointSpriteSampler = glGetUniformLocation(shader_program, "point_sprite");
@@ -822,90 +2023,128 @@ void DudesAndTreesModel::subd_square(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm:
   //  Function: DudesAndTreesModel::display()
   //
   //  Purpose:
-  //    This function does all the setup for the buffers and uniforms and then
-  //    issues a draw call for the geometry representing this object
+  //    Queues the draws of all the entities with the program, vertex array
+  //    and textures they need, for the draw queue to issue with the others
   //****************************************************************************
 
-void DudesAndTreesModel::display() {
-	glBindVertexArray(vao);
-	glUseProgram(shader_program);
-
-	glActiveTexture(GL_TEXTURE0 + 0); // Texture unit 0
-	glBindTexture(GL_TEXTURE_2D, ground_tex);
-
-	glActiveTexture(GL_TEXTURE0 + 1); // Texture unit 1
-	glBindTexture(GL_TEXTURE_2D, ground_norm_tex);
-
-	glActiveTexture(GL_TEXTURE0 + 2); // Texture unit 2
-	glBindTexture(GL_TEXTURE_2D, point_sprite);
-
-	glUniform1i(uTime, time);
-	glUniform1i(uScroll, scroll);
-	glUniform1f(uScale, scale);
-
-	glUniformMatrix4fv(uProj, 1, GL_FALSE, glm::value_ptr(proj));
-
-	for(auto x: entities) {
-		glUniform3fv(uPosition, 1, glm::value_ptr(x.location));
-		if(x.type == 0 or x.type == 1) { //good guy or bad guy
-			glPointSize(14.0);
-			bounce = 1;
-			glUniform1i(uBounce, bounce);
-
-			//set the color, 0 is good, they are blue, 1 is bad, they are red
-			if(!x.dead) {
-				if(!x.type)
-					glUniform3fv(uColor, 1, glm::value_ptr(glm::vec3(0,0,1)));
-				else
-					glUniform3fv(uColor, 1, glm::value_ptr(glm::vec3(1,0,0)));
-			} else { //black if dead
-				glUniform3fv(uColor, 1, glm::value_ptr(glm::vec3(0,0,0)));
-			}
-
-			glDrawArrays(GL_POINTS, 0, 1);  //draw the point
+void DudesAndTreesModel::display(DrawQueue& queue, float alpha) {
+	if(instances_dirty || alpha != drawn_alpha)
+		update_instances(alpha);
 
-		} else if(x.type == 2) {//drawing a tree
+	draw_packet p;
+	p.program = shader_program;
+	p.vao = vao;
+	p.blend = false;
+	p.pass = "dudes and trees";
 
-			bounce = 0;
-			glUniform1i(uBounce, bounce);
+	p.textures[0] = ground_tex.get(); // Texture unit 0
+	p.textures[1] = ground_norm_tex.get(); // Texture unit 1
+	p.textures[2] = point_sprite; // Texture unit 2
+	p.textures[3] = 0;
 
-			glPointSize(8.0); //small points for the more detailed models
-
-			glUniform3fv(uColor, 1, glm::value_ptr(glm::vec3(0.5,0.2,0)));
-			glDrawArrays(GL_POINTS, 0, num_tree_pts);  //draw the tree
+	p.draw = [this]() {draw();};
+	queue.submit(p);
+}
 
-			glPointSize(16.0);
+//****************************************************************************
+//  Function: DudesAndTreesModel::draw()
+//
+//  Purpose:
+//    Issues the instanced draws, once the queue has bound everything.
+//****************************************************************************
+void DudesAndTreesModel::draw() {
+	//one draw for each part of the population, however many entities there are
+	int first = 0;
+	if(num_guys)
+		glDrawArraysInstancedBaseInstance(GL_POINTS, 0, 1, num_guys, first);  //draw the guys
+	first += num_guys;
+
+	if(num_trees) {
+		glDrawArraysInstancedBaseInstance(GL_POINTS, 0, num_tree_pts, num_trees, first);  //draw the trees
+		glDrawArraysInstancedBaseInstance(GL_POINTS, num_tree_pts, num_treetop_pts, num_trees, first + num_trees);  //draw the treetops
+	}
+	first += 2 * num_trees;
 
-			glUniform3fv(uColor, 1, glm::value_ptr(glm::vec3(0.3,0.4,0)));
-			glDrawArrays(GL_POINTS, num_tree_pts, num_treetop_pts);  //draw the treetops
+	if(num_boxes)
+		glDrawArraysInstancedBaseInstance(GL_POINTS, box_start, num_box_pts, num_boxes, first);  //draw the boxes
+	first += num_boxes;
 
-		} else if(x.type == 3) {//drawing a box
+	if(cursor_draw)
+		glDrawArraysInstancedBaseInstance(GL_POINTS, 0, 1, 1, first);  //draw the point
+}
 
-			bounce = 1;
-			glUniform1i(uBounce, bounce);
+//****************************************************************************
+//  Function: DudesAndTreesModel::update_instances()
+//
+//  Purpose:
+//    Lays out an instance for each guy, tree trunk, treetop and box, in that
+//    order, and one for the cursor, with the colors and sizes they're drawn
+//    with. Then uploads them all at once. They're drawn alpha of the way
+//    from where they were before the last step to where they are.
+//****************************************************************************
+void DudesAndTreesModel::update_instances(float alpha) {
+	instance temp;
+	instances.clear();
 
-			glPointSize(3.0);
+	for(auto &x : entities) {
+		if(x.type == 0 or x.type == 1) { //good guy or bad guy
+			temp.offset = glm::mix(x.previous, x.location, alpha);
+			temp.point_size = 14.0;
+			temp.bounce = 1;
 
+			//set the color, 0 is good, they are blue, 1 is bad, they are red
 			if(!x.dead)
-				glUniform3fv(uColor, 1, glm::value_ptr(glm::vec3(0.9,0.6,0)));
-			else
-				glUniform3fv(uColor, 1, glm::value_ptr(glm::vec3(0.7,0.4,0)));
+				temp.color = x.type ? glm::vec3(1,0,0) : glm::vec3(0,0,1);
+			else //black if dead
+				temp.color = glm::vec3(0,0,0);
 
-			glDrawArrays(GL_POINTS, box_start, num_box_pts);  //draw the tree
+			instances.push_back(temp);
+		}
+	}
+	num_guys = instances.size();
 
+	for(auto &x : entities) {
+		if(x.type == 2) { //small points for the more detailed models
+			temp.offset = x.location;
+			temp.color = glm::vec3(0.5,0.2,0);
+			temp.point_size = 8.0;
+			temp.bounce = 0;
+			instances.push_back(temp);
 		}
 	}
+	num_trees = instances.size() - num_guys;
 
-	if(cursor_draw) {
-		glUniform3fv(uColor, 1, glm::value_ptr(point_sprite_color));
-		glUniform3fv(uPosition, 1, glm::value_ptr(point_sprite_position));
+	for(int i = 0; i < num_trees; i++) { //the treetops of the same trees
+		temp = instances[num_guys + i];
+		temp.color = glm::vec3(0.3,0.4,0);
+		temp.point_size = 16.0;
+		instances.push_back(temp);
+	}
 
-		glPointSize(25.0);
-		glDrawArrays(GL_POINTS, 0, 1);  //draw the point
+	for(auto &x : entities) {
+		if(x.type == 3) { //drawing a box
+			temp.offset = x.location;
+			temp.color = x.dead ? glm::vec3(0.7,0.4,0) : glm::vec3(0.9,0.6,0);
+			temp.point_size = 3.0;
+			temp.bounce = 1;
+			instances.push_back(temp);
+		}
 	}
+	num_boxes = instances.size() - num_guys - 2 * num_trees;
+
+	temp.offset = point_sprite_position;
+	temp.color = point_sprite_color;
+	temp.point_size = 25.0;
+	temp.bounce = 1;
+	instances.push_back(temp);
+
+	glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(instance) * instances.size(), &instances[0], GL_STREAM_DRAW);
+	instances_dirty = false;
+	drawn_alpha = alpha;
 }
 
-void DudesAndTreesModel::update_sim() {  //called from timer function
+void DudesAndTreesModel::update_sim() {  //called for every fixed step
 	std::random_device rd;
 	std::mt19937 mt(rd());
 	std::uniform_real_distribution<float> dist(-0.003f, 0.003f);
@@ -916,9 +2155,13 @@ void DudesAndTreesModel::update_sim() {  //called from timer function
 	float tree_hit_threshold = 0.03;
 
 	status = 0;
+	instances_dirty = true;
 
 	bool captured_this_cycle = false;
 
+	for(auto &x : entities)
+		x.previous = x.location;
+
 	for (auto &x : entities) { //for all the entities
 		if((x.type == 0 || x.type == 1) && !x.dead) { //don't move dead guys
 			for(auto &x2 : entities) { //look for a box
@@ -981,18 +2224,32 @@ void DudesAndTreesModel::update_sim() {  //called from timer function
 			}
 
 			if(x.location.x > 0.8 || x.location.x < -0.8 || x.location.y > 0.8 || x.location.y < -0.8) {
-				//set it back at 0,0
+				//set it back at 0,0, without drawing it on the way
 				x.location = glm::vec3(0,0,0);
+				x.previous = x.location;
 			}
 		}//end good guy/bad guy
 		//trees and boxes don't need to be updated
 	} //end for entities
 }
 
+//the cursor is picked again every frame, but only needs uploading when it moves
+//where it's drawn. Turning it on uploads where it is then
+void DudesAndTreesModel::set_pos(glm::vec3 pin, glm::vec3 cin) {
+	if(pin == point_sprite_position && cin == point_sprite_color)
+		return;
+	point_sprite_position = pin;
+	point_sprite_color = cin;
+	if(cursor_draw)
+		instances_dirty = true;
+}
+
 void DudesAndTreesModel::handle_click(glm::vec3 pixel_read) {  //called from mouse callback
 	bool inthewater = false;
 	bool inatree = false;
 
+	instances_dirty = true;
+
 	// glm::vec3 click_location;
 
 	if(pixel_read == glm::vec3(0,0,0)) {//black pixel, off the board
@@ -1049,6 +2306,7 @@ void DudesAndTreesModel::handle_click(glm::vec3 pixel_read) {  //called from mou
 	for(int i = entities.size()-1; i > 0; i--) {
 		if(entities[i].type == 3 && entities[i].location.x > 0.8) {
 			entities[i].location = glm::vec3(pixel_read.x, pixel_read.y, 0);
+			entities[i].previous = entities[i].location;
 			if(inatree || inthewater){
 				entities[i].dead = true;
 			} else {
@@ -1074,39 +2332,28 @@ void DudesAndTreesModel::handle_click(glm::vec3 pixel_read) {  //called from mou
 //        Takes no arguments, calls generate_points() to create geometry. Then
 //        buffers all this data to the GPU memory.
 //
-//    Setters:
-//        Used to update the values of the uniform variables.
-//
 //    Generate Points:
 //        Creates a square, subdivides the faces several times, and creates
 //        triangles to span the shape. This data is used to populate the
 //        vectors containing point data.
 //
 //    Display:
-//        Makes sure the correct shader is being used, that the correct buffers
-//        are bound, that the vertex attributes are set up, and that all the
-//        latest values of the uniform variables are sent to the GPU.
+//        Queues a draw packet with the shader program, the vertex array and
+//        the textures it's drawn with, and the draw calls. The draw queue
+//        binds them and issues the draws.
 //******************************************************************************
 class WaterModel {
 public:
 
 	WaterModel();
 
-	void display();
-
-	void set_time(int tin)        {time = tin;}
-	void set_proj(glm::mat4 pin)  {proj = pin;}
-
-	void set_scroll(int sin)      {scroll = sin;}
-	void scale_up()               {scale *= 1.618f;}
-	void scale_down()             {scale /= 1.618f;}
+	void display(DrawQueue& queue);
 
 	private:
 	GLuint vao;
 	GLuint buffer;
 
 	//the three textures associated with the water's surface - we don't need the ground anymore, just using depth testing there now
-	GLuint ground_tex, ground_tex_sampler;
 	GLuint displacement_tex, displacement_tex_sampler;
 	GLuint normal_tex, normal_tex_sampler;
 	GLuint color_tex, color_tex_sampler;
@@ -1120,18 +2367,7 @@ public:
 	// GLuint vNormal;
 	// GLuint vColor;
 
-	//UNIFORM LOCATIONS
-	GLuint uTime;   //animation time
-	GLuint uProj;   //projection matrix
-
-	GLuint uScroll;
-	GLuint uScale;
-
-	//VALUES OF THOSE UNIFORMS
-	int time, scroll;
-	float scale;
-	glm::mat4 proj;
-
+	void setup_uniforms();
 	void generate_points();
 	void subd_square(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d);
 
@@ -1164,11 +2400,11 @@ WaterModel::WaterModel() {
 	glBufferData(GL_ARRAY_BUFFER, num_bytes_points, NULL, GL_STATIC_DRAW);
 	glBufferSubData(GL_ARRAY_BUFFER, 0, num_bytes_points, &points[0]);
 
-	//SHADERS (COMPILE, USE)
+	//SHADERS (COMPILE), the water doesn't scroll, so there's just the one
 	cout << " compiling water shaders" << endl;
 	Shader s("resources/shaders/water_vert.glsl", "resources/shaders/water_frag.glsl");
 	shader_program = s.Program;
-	glUseProgram(shader_program);
+	ShaderReloader::Watch(s, &shader_program, [this]() {setup_uniforms();});
 
 	//VERTEX ATTRIB AND UNIFORM LOCATIONS
 
@@ -1177,41 +2413,19 @@ WaterModel::WaterModel() {
 	glEnableVertexAttribArray(vPosition);
 	glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, 0, ((GLvoid*) (0)));
 
-	//UNIFORMS
-	uTime = glGetUniformLocation(shader_program, "t");
-	glUniform1i(uTime, time);
-
-	uProj = glGetUniformLocation(shader_program, "proj");
-	proj = glm::ortho(-1.0f, 1.0f, 1.0f, -1.0f, -1.0f, 1.0f);
-	glUniformMatrix4fv(uProj, 1, GL_FALSE, glm::value_ptr(proj));
-
-	uScroll = glGetUniformLocation(shader_program, "scroll");
-	glUniform1i(uScroll, scroll);
-
-	scale = 1.0;
-	uScale = glGetUniformLocation(shader_program, "scale");
-	glUniform1f(uScale, scale);
-
-	//THE TEXTURE
-	std::vector<unsigned char> image;
+	//THE TEXTURES
 	std::vector<unsigned char> image2;
 	std::vector<unsigned char> image3;
 	std::vector<unsigned char> image4;
-	unsigned width, height;
 	unsigned width2, height2;
 	unsigned width3, height3;
 	unsigned width4, height4;
-	unsigned error = lodepng::decode(image, width, height, GROUND_TEXTURE_PATH, LodePNGColorType::LCT_RGBA, 8);
-	unsigned error2 = lodepng::decode(image2, width2, height2, "resources/textures/height/wave_height.png", LodePNGColorType::LCT_RGBA, 8);
-	unsigned error3 = lodepng::decode(image3, width3, height3, "resources/textures/normals/wave_norm.png", LodePNGColorType::LCT_RGBA, 8);
-	unsigned error4 = lodepng::decode(image4, width4, height4, "resources/textures/water_color.png", LodePNGColorType::LCT_RGBA, 8);
+	unsigned error2 = decode_texture(image2, width2, height2, "resources/textures/height/wave_height.png");
+	unsigned error3 = decode_texture(image3, width3, height3, "resources/textures/normals/wave_norm.png");
+	unsigned error4 = decode_texture(image4, width4, height4, "resources/textures/water_color.png");
 
 
 	// If there's an error, display it.
-	if(error != 0) {
-		std::cout << "error with lodepng texture loading " << error << ": " << lodepng_error_text(error) << std::endl;
-	}
-
 	if(error2 != 0) {
 		std::cout << "error with lodepng texture loading " << error2 << ": " << lodepng_error_text(error2) << std::endl;
 	}
@@ -1224,17 +2438,6 @@ WaterModel::WaterModel() {
 		std::cout << "error with lodepng texture loading " << error4 << ": " << lodepng_error_text(error4) << std::endl;
 	}
 
-	glEnable(GL_TEXTURE_2D);
-	glGenTextures(1, &ground_tex);
-	glBindTexture(GL_TEXTURE_2D, ground_tex);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2048, 2048, 0, GL_RGBA, GL_UNSIGNED_BYTE, &image[0]);
-	glGenerateMipmap(GL_TEXTURE_2D);
-	cout << " loaded ground texture" << endl;
-
 	glEnable(GL_TEXTURE_2D);
 	glGenTextures(1, &displacement_tex);
 	glBindTexture(GL_TEXTURE_2D, displacement_tex);
@@ -1268,12 +2471,25 @@ WaterModel::WaterModel() {
 	glGenerateMipmap(GL_TEXTURE_2D);
 	cout << " loaded wave color texture" << endl;
 
-	ground_tex_sampler = glGetUniformLocation(shader_program, "ground_tex");
+	//UNIFORMS
+	setup_uniforms();
+}
+
+//****************************************************************************
+//  Function: WaterModel::setup_uniforms()
+//
+//  Purpose:
+//    Points the samplers at their texture units. Called again whenever the
+//    program is replaced by a reloaded one.
+//****************************************************************************
+void WaterModel::setup_uniforms() {
+	glUseProgram(shader_program);
+	FrameContext::attach(shader_program);
+
 	displacement_tex_sampler = glGetUniformLocation(shader_program, "height_tex");
 	normal_tex_sampler = glGetUniformLocation(shader_program, "normal_tex");
 	color_tex_sampler = glGetUniformLocation(shader_program, "color_tex");
 
-	glUniform1i(ground_tex_sampler,   0);   //height of the ground goes in texture unit 0
 	glUniform1i(displacement_tex_sampler,   1);   //height goes in texture unit 1
 	glUniform1i(normal_tex_sampler,   2);   //normal goes in texture unit 2
 	glUniform1i(color_tex_sampler,   3);   //color  goes in texture unit 3
@@ -1331,32 +2547,25 @@ void WaterModel::subd_square(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d)
 //  Function: WaterModel::display()
 //
 //  Purpose:
-//    This function does all the setup for the buffers and uniforms and then
-//    issues a draw call for the geometry representing this object
+//    Queues a draw of this object with the program, vertex array and
+//    textures it needs. It's blended, so it's drawn after the opaque objects
 //****************************************************************************
 
-void WaterModel::display() {
-	glBindVertexArray(vao);
-	glUseProgram(shader_program);
-
-	glActiveTexture(GL_TEXTURE0 + 0); // Texture unit 0
-	glBindTexture(GL_TEXTURE_2D, ground_tex);
-
-	glActiveTexture(GL_TEXTURE0 + 1); // Texture unit 0
-	glBindTexture(GL_TEXTURE_2D, displacement_tex);
-
-	glActiveTexture(GL_TEXTURE0 + 2); // Texture unit 1
-	glBindTexture(GL_TEXTURE_2D, normal_tex);
-
-	glActiveTexture(GL_TEXTURE0 + 3); // Texture unit 2
-	glBindTexture(GL_TEXTURE_2D, color_tex);
-
-	glUniform1i(uTime, time);
-	glUniformMatrix4fv(uProj, 1, GL_FALSE, glm::value_ptr(proj));
-	glUniform1f(uScale, scale);
-	glUniform1i(uScroll, scroll);
-
-	glDrawArrays(GL_TRIANGLES, 0, num_pts);
+void WaterModel::display(DrawQueue& queue) {
+	draw_packet p;
+	p.program = shader_program;
+	p.vao = vao;
+	p.blend = true;
+	p.pass = "water";
+
+	p.textures[0] = 0;
+	p.textures[1] = displacement_tex; // Texture unit 1
+	p.textures[2] = normal_tex; // Texture unit 2
+	p.textures[3] = color_tex; // Texture unit 3
+
+	int n = num_pts;
+	p.draw = [n]() {glDrawArrays(GL_TRIANGLES, 0, n);};
+	queue.submit(p);
 }
 
 
@@ -1381,21 +2590,15 @@ void WaterModel::display() {
 //        vectors containing point data.
 //
 //    Display:
-//        Makes sure the correct shader is being used, that the correct buffers
-//        are bound, that the vertex attributes are set up, and that all the
-//        latest values of the uniform variables are sent to the GPU.
+//        Queues a draw packet with the shader variant for the scroll mode,
+//        the vertex array and the textures it's drawn with, and the draw
+//        calls. The draw queue binds them and issues the draws.
 //******************************************************************************
 class SkirtModel {
 public:
 	SkirtModel();
 
-	void display();
-
-	void set_time(int tin)        {time = tin;}
-	void set_scroll(int sin)      {scroll = sin;}
-	void scale_up()               {scale *= 1.618f;}
-	void scale_down()             {scale /= 1.618f;}
-	void set_proj(glm::mat4 pin)  {proj = pin;}
+	void display(DrawQueue& queue, int scroll);
 
 	void increase_thresh()        {thresh += 0.01; cout << thresh << endl;}
 	void decrease_thresh()        {thresh -= 0.01; cout << thresh << endl;}
@@ -1403,11 +2606,12 @@ public:
 private:
 	GLuint vao;
 	GLuint buffer;
-	GLuint ground_tex, water_tex;
+	ProgressiveTexture ground_tex;
+	GLuint water_tex;
 
 	GLuint ground_tex_sampler, water_tex_sampler;
 
-	GLuint shader_program;
+	GLuint shader_programs[SCROLL_MODES];
 
 	int num_pts_front; //how many points?
 	int num_pts_back; //how many points?
@@ -1418,18 +2622,13 @@ private:
 	// GLuint vColor;
 
 	//UNIFORM LOCATIONS
-	GLuint uTime;   //animation time
-	GLuint uProj;   //projection matrix
-	GLuint uThresh;   //cutoff for water
-	GLuint uScale;
-	GLuint uScroll;
+	GLuint uThresh[SCROLL_MODES];   //cutoff for water, in each variant
 
 
 	//VALUES OF THOSE UNIFORMS
-	int time, scroll;
-	float thresh, scale;
-	glm::mat4 proj;
+	float thresh;
 
+	void setup_uniforms();
 	void generate_points();
 	void subd_square(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d);
 
@@ -1463,72 +2662,37 @@ SkirtModel::SkirtModel() {
 	glBufferData(GL_ARRAY_BUFFER, num_bytes_points, NULL, GL_STATIC_DRAW);
 	glBufferSubData(GL_ARRAY_BUFFER, 0, num_bytes_points, &points[0]);
 
-	//SHADERS (COMPILE, USE)
+	//SHADERS (COMPILE), a variant for each way of scrolling
 	cout << " compiling skirt shaders" << endl;
-	Shader s("resources/shaders/skirt_vert.glsl", "resources/shaders/skirt_frag.glsl");
-	shader_program = s.Program;
-	glUseProgram(shader_program);
+	for(int scroll = 0; scroll < SCROLL_MODES; scroll++) {
+		Shader s("resources/shaders/skirt_vert.glsl", "resources/shaders/skirt_frag.glsl", variant_defines(scroll));
+		shader_programs[scroll] = s.Program;
+		ShaderReloader::Watch(s, &shader_programs[scroll], [this]() {setup_uniforms();});
+	}
 
 	//VERTEX ATTRIB AND UNIFORM LOCATIONS
 
 	// Initialize the vertex position attribute from the vertex shader
-	vPosition = glGetAttribLocation(shader_program, "vPosition");
+	vPosition = glGetAttribLocation(shader_programs[0], "vPosition");
 	glEnableVertexAttribArray(vPosition);
 	glVertexAttribPointer(vPosition, 3, GL_FLOAT, GL_FALSE, 0, ((GLvoid*) (0)));
 
-	//UNIFORMS
-	uTime = glGetUniformLocation(shader_program, "t");
-	glUniform1i(uTime, time);
-
-	uProj = glGetUniformLocation(shader_program, "proj");
-	proj = glm::ortho(-1.0f, 1.0f, 1.0f, -1.0f, -1.0f, 1.0f);
-	glUniformMatrix4fv(uProj, 1, GL_FALSE, glm::value_ptr(proj));
-
-	uScroll = glGetUniformLocation(shader_program, "scroll");
-	glUniform1i(uScroll, scroll);
-
 	thresh = 0.56f;
-	uThresh = glGetUniformLocation(shader_program, "thresh");
-	glUniform1f(uThresh, thresh);
-
-	scale = 1.0;
-	uScale = glGetUniformLocation(shader_program, "scale");
-	glUniform1f(uScale, scale);
 
 	//THE TEXTURE
 
-	std::vector<unsigned char> image;
-	unsigned width, height;
-	unsigned error = lodepng::decode(image, width, height, GROUND_TEXTURE_PATH, LodePNGColorType::LCT_RGBA, 8);
+	ground_tex.load(GROUND_TEXTURE_PATH);
 
 	std::vector<unsigned char> image2;
 	unsigned width2, height2;
-	unsigned error2 = lodepng::decode(image2, width2, height2, "resources/textures/height/wave_height.png", LodePNGColorType::LCT_RGBA, 8);
+	unsigned error2 = decode_texture(image2, width2, height2, "resources/textures/height/wave_height.png");
 
 	// If there's an error, display it.
-	if(error != 0) {
-		std::cout << "error with lodepng texture loading " << error << ": " << lodepng_error_text(error) << std::endl;
-	}
-
 	if(error2 != 0) {
 		std::cout << "error2 with lodepng texture loading " << error2 << ": " << lodepng_error_text(error2) << std::endl;
 	}
 
 	glEnable(GL_TEXTURE_2D);
-	glGenTextures(1, &ground_tex);
-	glBindTexture(GL_TEXTURE_2D, ground_tex);
-
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 2048, 2048, 0, GL_RGBA, GL_UNSIGNED_BYTE, &image[0]);
-
-	glGenerateMipmap(GL_TEXTURE_2D);
-
-	cout << " loaded ground texture" << endl;
-
 	glGenTextures(1, &water_tex);
 	glBindTexture(GL_TEXTURE_2D, water_tex);
 
@@ -1543,11 +2707,32 @@ SkirtModel::SkirtModel() {
 
 	cout << " loaded water texture" << endl;
 
-	ground_tex_sampler = glGetUniformLocation(shader_program, "ground_tex");
-	water_tex_sampler = glGetUniformLocation(shader_program, "water_tex");
+	//UNIFORMS
+	setup_uniforms();
+}
+
+//****************************************************************************
+//  Function: SkirtModel::setup_uniforms()
+//
+//  Purpose:
+//    Finds the uniforms of each variant and gives them their first values.
+//    Called again whenever a program is replaced by a reloaded one.
+//****************************************************************************
+void SkirtModel::setup_uniforms() {
+	for(int scroll = 0; scroll < SCROLL_MODES; scroll++) {
+		GLuint program = shader_programs[scroll];
+		glUseProgram(program);
+		FrameContext::attach(program);
+
+		uThresh[scroll] = glGetUniformLocation(program, "thresh");
+		glUniform1f(uThresh[scroll], thresh);
 
-	glUniform1i(ground_tex_sampler,   0);   //height of the ground goes in texture unit 0
-	glUniform1i(water_tex_sampler,   1);   //height of the water goes in texture unit 1
+		ground_tex_sampler = glGetUniformLocation(program, "ground_tex");
+		water_tex_sampler = glGetUniformLocation(program, "water_tex");
+
+		glUniform1i(ground_tex_sampler,   0);   //height of the ground goes in texture unit 0
+		glUniform1i(water_tex_sampler,   1);   //height of the water goes in texture unit 1
+	}
 }
 
 //****************************************************************************
@@ -1624,26 +2809,26 @@ void SkirtModel::subd_square(glm::vec3 a, glm::vec3 b, glm::vec3 c, glm::vec3 d)
 //  Function: SkirtModel::display()
 //
 //  Purpose:
-//    This function does all the setup for the buffers and uniforms and then
-//    issues a draw call for the geometry representing this object
+//    Queues a draw of this object with the program, vertex array and
+//    textures it needs. Its water is blended, so it's drawn after the opaque
+//    objects and the water
 //****************************************************************************
-void SkirtModel::display() {
-	glBindVertexArray(vao);
-	glUseProgram(shader_program);
-
-	glActiveTexture(GL_TEXTURE0 + 0); // Texture unit 0
-	glBindTexture(GL_TEXTURE_2D, ground_tex);
-
-	glActiveTexture(GL_TEXTURE0 + 1); // Texture unit 1
-	glBindTexture(GL_TEXTURE_2D, water_tex);
-
-	glUniform1i(uTime, time);
-	glUniform1f(uScale, scale);
-	glUniform1i(uScroll, scroll);
-
-	glUniformMatrix4fv(uProj, 1, GL_FALSE, glm::value_ptr(proj));
-	glUniform1f(uThresh, thresh);
-
-	glDrawArrays(GL_TRIANGLES, 0, num_pts_back);
-	glDrawArrays(GL_TRIANGLES, num_pts_back, num_pts_front);
+void SkirtModel::display(DrawQueue& queue, int scroll) {
+	draw_packet p;
+	p.program = shader_programs[scroll];
+	p.vao = vao;
+	p.blend = true;
+	p.pass = "skirts";
+
+	p.textures[0] = ground_tex.get(); // Texture unit 0
+	p.textures[1] = water_tex; // Texture unit 1
+	p.textures[2] = p.textures[3] = 0;
+
+	p.draw = [this, scroll]() {
+		glUniform1f(uThresh[scroll], thresh);
+
+		glDrawArrays(GL_TRIANGLES, 0, num_pts_back);
+		glDrawArrays(GL_TRIANGLES, num_pts_back, num_pts_front);
+	};
+	queue.submit(p);
 }
@@ -0,0 +1,296 @@
+//******************************************************************************
+//  File: picking.cpp
+//
+//  Description: Ray marching the terrain's heightfield, see picking.h.
+//
+//    The ray is followed in cells between texel centers, where bilinear
+//    sampling reads four texels, in units of the 8 bit heights. The texture
+//    repeats, so it's walked a tile at a time, and each tile is a quadtree
+//    over the max pyramid: blocks the ray stays above are skipped whole, and
+//    in the cells it dips into, the bilinear patch is solved for exactly.
+//
+//  Date: 19 October 2026
+//******************************************************************************
+#include "picking.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+// the ray in the cells of one tile, and its height in the heights' units, all
+// at t along it
+struct Heightfield::ray {
+	double u0, du;
+	double v0, dv;
+	double h0, dh;
+};
+
+void terrain_coord_mapping(double& a, double& b, int scroll, float time, float scale) {
+	if(scroll == 1) {
+		a = scale * (0.2 + 0.15);
+		b = scale * (time / 1000.0 + time / 7000.0);
+	} else if(scroll == 2) {
+		a = scale * (0.2 + 0.15);
+		b = scale * (time / 7000.0 + time / 7000.0);
+	} else {
+		a = scale * 0.25;
+		b = 0.0;
+	}
+}
+
+// narrows t0 to t1 to where o + t * d is between lo and hi, returns false if
+// it never is
+static bool clip(double o, double d, double lo, double hi, double& t0, double& t1) {
+	if(d == 0.0)
+		return o >= lo && o <= hi;
+	double a = (lo - o) / d, b = (hi - o) / d;
+	if(a > b)
+		std::swap(a, b);
+	t0 = std::max(t0, a);
+	t1 = std::min(t1, b);
+	return t0 <= t1;
+}
+
+//****************************************************************************
+//  Function: Heightfield::build
+//
+//  Purpose:
+//    Keeps the heights and builds the pyramid up to a single block. Each
+//    cell's corners wrap around the edges, like GL_REPEAT.
+//****************************************************************************
+void Heightfield::build(const unsigned char* rgba, unsigned w, unsigned h) {
+	width = w;
+	height = h;
+	heights.resize((size_t)w * h);
+	levels.clear();
+	level_widths.clear();
+	level_heights.clear();
+	if(w == 0 || h == 0) {
+		width = height = 0;
+		return;
+	}
+
+	for(size_t i = 0; i != heights.size(); ++i)
+		heights[i] = rgba[i * 4 + 2];
+
+	std::vector<unsigned char> cells((size_t)w * h);
+	for(unsigned y = 0; y != h; ++y) {
+		unsigned y1 = (y + 1) % h;
+		for(unsigned x = 0; x != w; ++x) {
+			unsigned x1 = (x + 1) % w;
+			cells[(size_t)y * w + x] = std::max(std::max(heights[(size_t)y * w + x], heights[(size_t)y * w + x1]),
+			                                    std::max(heights[(size_t)y1 * w + x], heights[(size_t)y1 * w + x1]));
+		}
+	}
+	levels.push_back(cells);
+	level_widths.push_back(w);
+	level_heights.push_back(h);
+
+	while(level_widths.back() > 1 || level_heights.back() > 1) {
+		const std::vector<unsigned char>& below = levels.back();
+		unsigned bw = level_widths.back(), bh = level_heights.back();
+		unsigned lw = (bw + 1) / 2, lh = (bh + 1) / 2;
+		std::vector<unsigned char> level((size_t)lw * lh, 0);
+		for(unsigned y = 0; y != bh; ++y)
+			for(unsigned x = 0; x != bw; ++x) {
+				unsigned char& m = level[(size_t)(y / 2) * lw + x / 2];
+				m = std::max(m, below[(size_t)y * bw + x]);
+			}
+		levels.push_back(level);
+		level_widths.push_back(lw);
+		level_heights.push_back(lh);
+	}
+}
+
+// bilinear height at u, v in cells, wrapped
+double Heightfield::sample(double u, double v) const {
+	double fu = std::floor(u), fv = std::floor(v);
+	long i = (long)fu % (long)width, j = (long)fv % (long)height;
+	if(i < 0)
+		i += width;
+	if(j < 0)
+		j += height;
+	unsigned i1 = (i + 1) % width, j1 = (j + 1) % height;
+	fu = u - fu;
+	fv = v - fv;
+	double top = heights[(size_t)j * width + i] * (1.0 - fu) + heights[(size_t)j * width + i1] * fu;
+	double bottom = heights[(size_t)j1 * width + i] * (1.0 - fu) + heights[(size_t)j1 * width + i1] * fu;
+	return top * (1.0 - fv) + bottom * fv;
+}
+
+//****************************************************************************
+//  Function: Heightfield::cell
+//
+//  Purpose:
+//    Along the ray, the bilinear patch of a cell is a quadratic in t. Finds
+//    the first t between t0 and t1 where the ray isn't above it.
+//****************************************************************************
+bool Heightfield::cell(double& t, const ray& r, unsigned i, unsigned j, double t0, double t1) const {
+	unsigned i1 = (i + 1) % width, j1 = (j + 1) % height;
+	double h00 = heights[(size_t)j * width + i], h10 = heights[(size_t)j * width + i1];
+	double h01 = heights[(size_t)j1 * width + i], h11 = heights[(size_t)j1 * width + i1];
+	double b = h10 - h00, c = h01 - h00, d = h00 - h10 - h01 + h11;
+
+	// with s = t - t0, the patch is h00 + b fu + c fv + d fu fv at fu, fv
+	double fu = r.u0 + t0 * r.du - i, fv = r.v0 + t0 * r.dv - j;
+	double g0 = r.h0 + t0 * r.dh - (h00 + b * fu + c * fv + d * fu * fv);
+	double g1 = r.dh - (b * r.du + c * r.dv + d * (fu * r.dv + fv * r.du));
+	double g2 = -d * r.du * r.dv;
+
+	if(g0 <= 0.0) {
+		t = t0;
+		return true;
+	}
+
+	// the ray's height above the patch is g0 + g1 s + g2 s^2, the first root
+	double length = t1 - t0, s = std::numeric_limits<double>::infinity();
+	if(std::fabs(g2) < 1e-12) {
+		if(g1 < 0.0)
+			s = -g0 / g1;
+	} else {
+		double discriminant = g1 * g1 - 4.0 * g2 * g0;
+		if(discriminant < 0.0)
+			return false;
+		double q = -0.5 * (g1 + (g1 < 0.0 ? -1.0 : 1.0) * std::sqrt(discriminant));
+		double roots[2] = {q / g2, q != 0.0 ? g0 / q : -1.0};
+		for(int k = 0; k != 2; ++k)
+			if(roots[k] >= 0.0 && roots[k] < s)
+				s = roots[k];
+	}
+	if(s > length)
+		return false;
+	t = t0 + s;
+	return true;
+}
+
+//****************************************************************************
+//  Function: Heightfield::march
+//
+//  Purpose:
+//    Follows the ray through block i, j of a level, skipping it if the ray is
+//    above its highest height, else through its children in the order the
+//    ray enters them.
+//****************************************************************************
+bool Heightfield::march(double& t, const ray& r, unsigned level, unsigned i, unsigned j, double t0, double t1) const {
+	double x0 = (double)(i << level), x1 = (double)std::min((i + 1) << level, width);
+	double y0 = (double)(j << level), y1 = (double)std::min((j + 1) << level, height);
+	if(!clip(r.u0, r.du, x0, x1, t0, t1) || !clip(r.v0, r.dv, y0, y1, t0, t1))
+		return false;
+
+	// the ray is straight, so it's lowest at one end
+	if(std::min(r.h0 + t0 * r.dh, r.h0 + t1 * r.dh) > levels[level][(size_t)j * level_widths[level] + i])
+		return false;
+
+	if(level == 0)
+		return cell(t, r, i, j, t0, t1);
+
+	struct {double t; unsigned i, j;} children[4];
+	int n = 0;
+	for(unsigned cj = 2 * j; cj != 2 * j + 2 && cj < level_heights[level - 1]; ++cj)
+		for(unsigned ci = 2 * i; ci != 2 * i + 2 && ci < level_widths[level - 1]; ++ci) {
+			double c0 = t0, c1 = t1;
+			if(!clip(r.u0, r.du, (double)(ci << (level - 1)), (double)((ci + 1) << (level - 1)), c0, c1) ||
+			   !clip(r.v0, r.dv, (double)(cj << (level - 1)), (double)((cj + 1) << (level - 1)), c0, c1))
+				continue;
+			int k = n++;
+			for(; k > 0 && children[k - 1].t > c0; --k)
+				children[k] = children[k - 1];
+			children[k].t = c0;
+			children[k].i = ci;
+			children[k].j = cj;
+		}
+
+	for(int k = 0; k != n; ++k)
+		if(march(t, r, level - 1, children[k].i, children[k].j, t0, t1))
+			return true;
+	return false;
+}
+
+//****************************************************************************
+//  Function: Heightfield::intersect
+//
+//  Purpose:
+//    Clips the ray to the board, between the water's surface and the highest
+//    the ground goes, and walks it through the tiles of the texture it
+//    crosses there. If it doesn't hit the ground, it hits the water's
+//    surface at the end, unless it left the board through a side.
+//****************************************************************************
+bool Heightfield::intersect(double& t, terrain_hit& hit, glm::dvec3 origin, glm::dvec3 direction,
+                            int scroll, float time, float scale) const {
+	double half = TERRAIN_EXTENT / 2.0;
+	double top = TERRAIN_RELIEF * (1.0 - TERRAIN_WATER_LEVEL);
+	double t0 = 0.0, t1 = 1.0;
+	if(!clip(origin.x, direction.x, -half, half, t0, t1) || !clip(origin.y, direction.y, -half, half, t0, t1) ||
+	   !clip(origin.z, direction.z, 0.0, top, t0, t1))
+		return false;
+
+	// world x, y to the vertex positions is times 2, then a * p + b to texture
+	// coordinates, and cells start half a texel in
+	double a, b;
+	terrain_coord_mapping(a, b, scroll, time, scale);
+	ray r;
+	r.u0 = (a * 2.0 * origin.x + b) * width - 0.5;
+	r.du = a * 2.0 * direction.x * width;
+	r.v0 = (a * 2.0 * origin.y + b) * height - 0.5;
+	r.dv = a * 2.0 * direction.y * height;
+	r.h0 = (origin.z / TERRAIN_RELIEF + TERRAIN_WATER_LEVEL) * 255.0;
+	r.dh = direction.z / TERRAIN_RELIEF * 255.0;
+
+	// coming in through a side, under the ground, it's behind the skirts
+	if(!empty() && r.h0 + t0 * r.dh < sample(r.u0 + t0 * r.du, r.v0 + t0 * r.dv) - 1e-6)
+		return false;
+
+	bool ground = false;
+	if(!empty()) {
+		// a 2D DDA over the tiles, each marched from the top of the pyramid
+		unsigned top_level = levels.size() - 1;
+		double w = width, h = height;
+		double tile_t = t0;
+		double tx = std::floor((r.u0 + tile_t * r.du) / w), ty = std::floor((r.v0 + tile_t * r.dv) / h);
+		double infinity = std::numeric_limits<double>::infinity();
+		while(!ground) {
+			double next_x = r.du > 0.0 ? ((tx + 1.0) * w - r.u0) / r.du : r.du < 0.0 ? (tx * w - r.u0) / r.du : infinity;
+			double next_y = r.dv > 0.0 ? ((ty + 1.0) * h - r.v0) / r.dv : r.dv < 0.0 ? (ty * h - r.v0) / r.dv : infinity;
+			double end = std::min(std::min(next_x, next_y), t1);
+
+			ray local = r;
+			local.u0 -= tx * w;
+			local.v0 -= ty * h;
+			ground = march(t, local, top_level, 0, 0, tile_t, end);
+
+			if(end >= t1)
+				break;
+			if(next_x <= next_y)
+				tx += r.du > 0.0 ? 1.0 : -1.0;
+			else
+				ty += r.dv > 0.0 ? 1.0 : -1.0;
+			tile_t = end;
+		}
+	}
+
+	if(!ground) {
+		if(direction.z >= 0.0 || origin.z + t1 * direction.z > 1e-9)
+			return false;
+		t = t1;
+	}
+
+	hit.position = glm::vec3(origin + t * direction);
+	hit.water = !ground && (empty() || sample(r.u0 + t * r.du, r.v0 + t * r.dv) < TERRAIN_WATER_LEVEL * 255.0);
+	return true;
+}
+
+//****************************************************************************
+//  Function: Heightfield::pick
+//
+//  Purpose:
+//    Unprojects the point to the ray between the near and far planes, which
+//    is the whole depth the view draws.
+//****************************************************************************
+bool Heightfield::pick(terrain_hit& hit, const glm::mat4& view, glm::vec2 ndc, int scroll, float time, float scale) const {
+	glm::dmat4 inverse = glm::inverse(glm::dmat4(view));
+	glm::dvec4 near = inverse * glm::dvec4(ndc.x, ndc.y, -1.0, 1.0);
+	glm::dvec4 far = inverse * glm::dvec4(ndc.x, ndc.y, 1.0, 1.0);
+	glm::dvec3 origin = glm::dvec3(near) / near.w;
+	double t;
+	return intersect(t, hit, origin, glm::dvec3(far) / far.w - origin, scroll, time, scale);
+}
@@ -0,0 +1,94 @@
+//******************************************************************************
+//  File: picking.h
+//
+//  Description: Finds the point of the terrain under the cursor on the CPU,
+//    with no GL context and no round trip to the GPU. The cursor is
+//    unprojected to a ray through the same view the shaders draw with, and
+//    the ray is marched against the heights of the terrain's texture, sampled
+//    bilinearly and wrapped, with the scroll and scale offsets of
+//    terrain.glsl. A pyramid of the highest height in each block of texels
+//    lets it skip the blocks the ray passes over.
+//
+//    The surface is the one ground_sel_vert.glsl draws: the heights in the
+//    texture's blue channel, raised TERRAIN_RELIEF per unit above the water
+//    level, and flat at the water's surface where they're below it.
+//
+//  Date: 19 October 2026
+//******************************************************************************
+#ifndef PICKING_H
+#define PICKING_H
+
+#include "../glm/glm.hpp"
+
+#include <vector>
+
+// the ground's vertices span -TERRAIN_EXTENT to TERRAIN_EXTENT in x and y, see
+// GroundModel::generate_points, and the shaders halve them
+#define TERRAIN_EXTENT 1.618f
+#define TERRAIN_RELIEF 0.2f
+#define TERRAIN_WATER_LEVEL 0.5f
+
+typedef struct terrain_hit_t {
+	glm::vec3 position;   // where the shaders put it, before the view
+	bool water;           // on the water's surface, over ground below it
+} terrain_hit;
+
+//****************************************************************************
+//  Function: terrain_coord_mapping
+//
+//  Purpose:
+//    The texture coordinates terrain.glsl reads at vertex position p are
+//    a * p + b, in both x and y. This gives a and b for a scroll mode, the
+//    animation time and the scale, and has to change along with it.
+//****************************************************************************
+void terrain_coord_mapping(double& a, double& b, int scroll, float time, float scale);
+
+//******************************************************************************
+//  Class: Heightfield
+//
+//  Purpose:  The heights of the terrain's texture and their max pyramid.
+//        It's empty until built, and picks the flat water's surface then,
+//        like the black texel the texture starts out as.
+//
+//  Functions:
+//
+//    Build:
+//        Takes the heights from the blue channel of an 8 bit RGBA image,
+//        like the ones decode_texture gives, and builds the pyramid.
+//
+//    Pick:
+//        Finds the terrain under a point of the window, in normalized device
+//        coordinates, as drawn with view. Returns false if it's off the board.
+//
+//    Intersect:
+//        Like pick, for a ray from origin to origin + direction, in the
+//        world. Gives back how far along it the terrain is, from 0 to 1.
+//******************************************************************************
+class Heightfield {
+public:
+	Heightfield() : width(0), height(0) {}
+
+	void build(const unsigned char* rgba, unsigned w, unsigned h);
+	bool empty() const {return width == 0;}
+
+	bool pick(terrain_hit& hit, const glm::mat4& view, glm::vec2 ndc, int scroll, float time, float scale) const;
+	bool intersect(double& t, terrain_hit& hit, glm::dvec3 origin, glm::dvec3 direction,
+	               int scroll, float time, float scale) const;
+
+private:
+	struct ray;
+
+	bool march(double& t, const ray& r, unsigned level, unsigned i, unsigned j, double t0, double t1) const;
+	bool cell(double& t, const ray& r, unsigned i, unsigned j, double t0, double t1) const;
+	double sample(double u, double v) const;
+
+	unsigned width, height;
+	std::vector<unsigned char> heights;
+
+	// levels[0] holds the highest corner of each cell between four texels,
+	// each level after it the highest of the two by two cells below it
+	std::vector<std::vector<unsigned char> > levels;
+	std::vector<unsigned> level_widths, level_heights;
+};
+
+#endif
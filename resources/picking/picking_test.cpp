@@ -0,0 +1,141 @@
+//******************************************************************************
+//  Program: picking_test
+//
+//  Description: Checks Heightfield::pick against brute force, with no GL
+//    context. For random points of random views, scroll modes, times and
+//    scales, it follows the same ray in small steps, sampling the surface
+//    ground_sel_vert.glsl draws, and the first step at or under it has to be
+//    where pick says, on the water or not alike. It's run with the empty
+//    heightfield, all flat water, and then with the rock heights, and prints
+//    how long a pick takes on average.
+//
+//    Build and run from the repository root:
+//      make picking_test
+//      ./picking_test
+//
+//  Date: 19 October 2026
+//******************************************************************************
+#include "picking.h"
+#include "../LodePNG/lodepng.h"
+#include "../glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#define TEST_HEIGHTS "resources/textures/height/rock_height.png"
+#define TEST_VIEWS 4000
+#define BRUTE_FORCE_STEPS 400000
+
+// how far apart the hits can be, about the brute force step
+#define TOLERANCE 2e-5
+
+// the surface's height at world x, y, and whether it's water there
+static double surface(bool& water, const std::vector<unsigned char>& rgba, unsigned w, unsigned h,
+                      double a, double b, double x, double y) {
+	double u = (a * 2.0 * x + b) * w - 0.5, v = (a * 2.0 * y + b) * h - 0.5;
+	double fu = std::floor(u), fv = std::floor(v);
+	long i = ((long)fu % (long)w + w) % w, j = ((long)fv % (long)h + h) % h;
+	long i1 = (i + 1) % w, j1 = (j + 1) % h;
+	fu = u - fu;
+	fv = v - fv;
+	auto height = [&](long x, long y) {return rgba.empty() ? 0.0 : (double)rgba[(y * w + x) * 4 + 2];};
+	double texel = (height(i, j) * (1.0 - fu) + height(i1, j) * fu) * (1.0 - fv)
+	             + (height(i, j1) * (1.0 - fu) + height(i1, j1) * fu) * fv;
+	water = texel < TERRAIN_WATER_LEVEL * 255.0;
+	return TERRAIN_RELIEF * (std::max(texel / 255.0, (double)TERRAIN_WATER_LEVEL) - TERRAIN_WATER_LEVEL);
+}
+
+//****************************************************************************
+//  Function: brute_force
+//
+//  Purpose:
+//    Steps along the ray from the near plane to the far one. The first step
+//    on the board that's at or under the surface is the hit, unless it's the
+//    first step on the board, which means the ray came in through a side.
+//****************************************************************************
+static bool brute_force(glm::dvec3& hit, bool& water, const std::vector<unsigned char>& rgba, unsigned w, unsigned h,
+                        const glm::mat4& view, glm::vec2 ndc, int scroll, float time, float scale) {
+	glm::dmat4 inverse = glm::inverse(glm::dmat4(view));
+	glm::dvec4 near = inverse * glm::dvec4(ndc.x, ndc.y, -1.0, 1.0);
+	glm::dvec4 far = inverse * glm::dvec4(ndc.x, ndc.y, 1.0, 1.0);
+	glm::dvec3 origin = glm::dvec3(near) / near.w, direction = glm::dvec3(far) / far.w - origin;
+	double a, b;
+	terrain_coord_mapping(a, b, scroll, time, scale);
+
+	double half = TERRAIN_EXTENT / 2.0;
+	bool entered = false;
+	for(int k = 0; k <= BRUTE_FORCE_STEPS; k++) {
+		glm::dvec3 p = origin + direction * ((double)k / BRUTE_FORCE_STEPS);
+		if(std::fabs(p.x) > half || std::fabs(p.y) > half)
+			continue;
+		if(p.z <= surface(water, rgba, w, h, a, b, p.x, p.y)) {
+			hit = p;
+			return entered;
+		}
+		entered = true;
+	}
+	return false;
+}
+
+int main() {
+	std::vector<unsigned char> rgba;
+	unsigned w, h;
+	unsigned error = lodepng::decode(rgba, w, h, TEST_HEIGHTS);
+	if(error) {
+		std::printf("%s: %s\n", TEST_HEIGHTS, lodepng_error_text(error));
+		return 1;
+	}
+
+	// the projection main.cc starts with, and FrameContext's view
+	glm::mat4 proj = glm::ortho(-1.366f, 1.366f, -0.768f, 0.768f, 1.2f, -1.0f);
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	int failed = 0;
+	for(int pass = 0; pass != 2; pass++) {
+		Heightfield field;
+		std::vector<unsigned char> heights;
+		if(pass == 1) {
+			field.build(&rgba[0], w, h);
+			heights = rgba;
+		}
+
+		int mismatches = 0, hits = 0;
+		double microseconds = 0.0;
+		for(int i = 0; i != TEST_VIEWS; i++) {
+			float time = (float)(rng() % 100000);
+			int scroll = rng() % 3;
+			float scale = rng() % 4 == 0 ? 4.236f : 1.0f;
+			float sway = 0.5f * sinf(0.0005f * time) + 0.3f;
+			glm::mat4 view = glm::rotate(proj, -0.25f, glm::vec3(0.0f, 1.0f, 0.0f));
+			view = glm::rotate(view, -2.15f, glm::vec3(1.0f, 0.0f, 0.0f));
+			view = glm::rotate(view, -sway, glm::vec3(0.0f, 0.0f, 1.0f));
+			glm::vec2 ndc(unit(rng), unit(rng));
+
+			terrain_hit hit;
+			auto start = std::chrono::steady_clock::now();
+			bool picked = field.pick(hit, view, ndc, scroll, time, scale);
+			microseconds += std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+			hits += picked;
+
+			// on the water's edge the side it's on is down to the step
+			glm::dvec3 expected(0.0);
+			bool water = false;
+			bool found = brute_force(expected, water, heights, w, h, view, ndc, scroll, time, scale);
+			if(found != picked || (picked && (glm::length(glm::dvec3(hit.position) - expected) > TOLERANCE
+			                                  || (water != hit.water && std::fabs(expected.z) > 1e-4)))) {
+				if(++mismatches <= 10)
+					std::printf("  view %d: picked %d at %f %f %f water %d, brute force %d at %f %f %f water %d\n",
+					            i, picked, hit.position.x, hit.position.y, hit.position.z, hit.water,
+					            found, expected.x, expected.y, expected.z, water);
+			}
+		}
+		std::printf("%s: %d of %d views differ, %d hits, %.3f us a pick\n", pass == 0 ? "flat water" : TEST_HEIGHTS,
+		            mismatches, TEST_VIEWS, hits, microseconds / TEST_VIEWS);
+		failed += mismatches;
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,130 @@
+//******************************************************************************
+//  File: recording.cpp
+//
+//  Description: The encoder threads of the png recorder, see recording.h.
+//
+//  Date: 19 October 2026
+//******************************************************************************
+#include "recording.h"
+
+#include "../LodePNG/lodepng.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+FrameEncoder::FrameEncoder(const std::string& directory, bool drop)
+	: directory(directory), drop(drop), stopping(false), submitted(0), encoded(0), dropped(0), failed(0), deepest(0) {
+	unsigned cores = std::thread::hardware_concurrency();
+	unsigned count = std::min(std::max(cores, 2u) - 1, (unsigned)RECORD_MAX_THREADS);
+	for(unsigned i = 0; i < count; i++)
+		threads.push_back(std::thread(&FrameEncoder::work, this));
+}
+
+void FrameEncoder::finish() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping = true;
+	}
+	queued.notify_all();
+	for(auto &t : threads)
+		t.join();
+	threads.clear();
+}
+
+bool FrameEncoder::submit(std::vector<unsigned char>& rgb, unsigned width, unsigned height, unsigned frame) {
+	std::unique_lock<std::mutex> guard(lock);
+	if(submitted++ == 0)
+		first = std::chrono::steady_clock::now();
+
+	if(jobs.size() >= RECORD_QUEUE) {
+		if(drop) {
+			dropped++;
+			return false;
+		}
+		room.wait(guard, [this]() {return jobs.size() < RECORD_QUEUE;});
+	}
+
+	jobs.push_back(job());
+	job& j = jobs.back();
+	j.rgb.swap(rgb);
+	j.width = width;
+	j.height = height;
+	j.frame = frame;
+	deepest = std::max(deepest, jobs.size());
+
+	if(!spare.empty()) {
+		rgb.swap(spare.back());
+		spare.pop_back();
+	}
+	guard.unlock();
+	queued.notify_one();
+	return true;
+}
+
+void FrameEncoder::fail(unsigned frame) {
+	std::printf("couldn't read frame %u back\n", frame);
+	std::lock_guard<std::mutex> guard(lock);
+	failed++;
+}
+
+void FrameEncoder::work() {
+	//the realtime preset, RGB in and out as it is. The pool already encodes
+	//a frame per thread, so each frame is encoded on one
+	lodepng::State state;
+	lodepng_encoder_settings_preset(&state.encoder, LEP_REALTIME);
+	state.encoder.num_threads = 1;
+	state.encoder.auto_convert = 0;
+	state.info_raw.colortype = LCT_RGB;
+	state.info_raw.bitdepth = 8;
+	state.info_png.color.colortype = LCT_RGB;
+	state.info_png.color.bitdepth = 8;
+
+	std::vector<unsigned char> flipped, png;
+	for(;;) {
+		job j;
+		{
+			std::unique_lock<std::mutex> guard(lock);
+			queued.wait(guard, [this]() {return stopping || !jobs.empty();});
+			if(jobs.empty())
+				return;  //stopping, with nothing left to encode
+			j = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		room.notify_one();
+
+		//png's first row is the top one
+		size_t row = (size_t)j.width * 3;
+		flipped.resize(row * j.height);
+		for(unsigned y = 0; y < j.height; y++)
+			std::memcpy(&flipped[row * y], &j.rgb[row * (j.height - 1 - y)], row);
+
+		char name[32];
+		std::snprintf(name, sizeof(name), "/frame_%05u.png", j.frame);
+		png.clear();
+		unsigned error = lodepng::encode(png, flipped, j.width, j.height, state);
+		if(!error)
+			error = lodepng::save_file(png, directory + name);
+		if(error)
+			std::printf("couldn't save frame %u: %s\n", j.frame, lodepng_error_text(error));
+
+		std::lock_guard<std::mutex> guard(lock);
+		if(error) {
+			failed++;
+		} else {
+			encoded++;
+			last = std::chrono::steady_clock::now();
+		}
+		spare.push_back(std::vector<unsigned char>());
+		spare.back().swap(j.rgb);
+	}
+}
+
+void FrameEncoder::report() {
+	std::lock_guard<std::mutex> guard(lock);
+	double seconds = encoded ? std::chrono::duration<double>(last - first).count() : 0.0;
+	std::printf("recorded %u frames to %s, %.1f fps sustained\n", encoded, directory.c_str(),
+	            seconds > 0.0 ? encoded / seconds : 0.0);
+	std::printf("  %u dropped, %u failed, %zu waiting, queue %zu deep at most of %d\n",
+	            dropped, failed, jobs.size(), deepest, RECORD_QUEUE);
+}
@@ -0,0 +1,94 @@
+//******************************************************************************
+//  File: recording.h
+//
+//  Description: Saves frames as a numbered png sequence on a pool of encoder
+//    threads, so recording doesn't hold up the frames being drawn. Frames
+//    wait in a bounded queue. When it's full, a new frame is either dropped
+//    or waits for room, which slows drawing down to the rate the pool can
+//    encode at.
+//
+//    It takes 8 bit RGB rows bottom first, the way glReadPixels gives them,
+//    and encodes them with lodepng's LEP_REALTIME preset, which trades size
+//    for speed. It has no GL in it. FrameRecorder in model.h reads the frames back.
+//
+//  Date: 19 October 2026
+//******************************************************************************
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define RECORD_QUEUE 8         //frames waiting to be encoded, at most
+#define RECORD_MAX_THREADS 4
+
+//******************************************************************************
+//  Class: FrameEncoder
+//
+//  Purpose:  The queue of frames and the threads that encode them to
+//        directory/frame_00000.png on.
+//
+//  Functions:
+//
+//    Constructor:
+//        Starts the threads, one fewer than the cores, from 1 to
+//        RECORD_MAX_THREADS. With drop, frames that find the queue full are
+//        dropped, otherwise they wait.
+//
+//    Finish:
+//        Encodes what's left in the queue and joins the threads. The
+//        destructor does too, if it hasn't been.
+//
+//    Submit:
+//        Queues a frame's pixels, swapping them for a buffer an encoded frame
+//        is done with, to fill next time. Returns false if it was dropped.
+//
+//    Fail:
+//        Counts a frame that couldn't be read back, so it never got here, with
+//        the frames that couldn't be saved.
+//
+//    Report:
+//        Prints how many frames were encoded and dropped, the frames a second
+//        it kept up from the first frame to the last encoded, and how deep
+//        the queue got.
+//******************************************************************************
+class FrameEncoder {
+public:
+	FrameEncoder(const std::string& directory, bool drop);
+	~FrameEncoder()               {finish();}
+
+	void finish();
+	bool submit(std::vector<unsigned char>& rgb, unsigned width, unsigned height, unsigned frame);
+	void fail(unsigned frame);
+	void report();
+
+private:
+	struct job {
+		std::vector<unsigned char> rgb;
+		unsigned width, height, frame;
+	};
+
+	void work();
+
+	std::string directory;
+	bool drop;
+
+	std::mutex lock;
+	std::condition_variable queued;   //a job came in, or it's stopping
+	std::condition_variable room;     //a job was taken off the queue
+	std::deque<job> jobs;
+	std::vector<std::vector<unsigned char> > spare;  //buffers of encoded frames
+	std::vector<std::thread> threads;
+	bool stopping;
+
+	unsigned submitted, encoded, dropped, failed;
+	size_t deepest;
+	std::chrono::steady_clock::time_point first, last;  //submitted, encoded
+};
+
+#endif
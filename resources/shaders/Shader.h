@@ -2,23 +2,102 @@
 #define SHADER_H
 
 #include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 
+#include <map>
+#include <functional>
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
 #include <GL/glew.h>
 
+// where linked programs are kept between runs, as driver specific binaries
+#ifndef SHADER_CACHE_DIR
+#define SHADER_CACHE_DIR "resources/shaders/cache/"
+#endif
+
+// without parallel shader compiling, how many frames a rebuilt program is
+// given before asking whether it linked, which waits if it hasn't yet
+#ifndef SHADER_RELOAD_FRAMES
+#define SHADER_RELOAD_FRAMES 3
+#endif
+
+// both extensions use the same token
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
 class Shader
 {
 public:
     GLuint Program;
-    // Constructor generates the shader on the fly
-    Shader( const GLchar *vertexPath, const GLchar *fragmentPath )
+    // How many programs were loaded from the cache, and how many had to be
+    // compiled because they weren't there, were stale or were corrupt
+    static unsigned CacheHits;
+    static unsigned CacheMisses;
+    // Where the program came from, so it can be built again when one of
+    // these files changes, Files being both stages and what they #include
+    std::string VertexPath;
+    std::string FragmentPath;
+    std::string Defines;
+    std::vector<std::string> Files;
+    // Constructor generates the shader on the fly. defines, if any, are
+    // #define lines for both stages, to compile a variant of the program
+    // with features switched on or off ahead of time instead of branching
+    // on uniforms. Each variant is cached on its own
+    Shader( const GLchar *vertexPath, const GLchar *fragmentPath, const std::string &defines = "" )
+        : VertexPath( vertexPath ), FragmentPath( fragmentPath ), Defines( defines )
     {
-
         // 1. Retrieve the vertex/fragment source code from filePath
         std::string vertexCode;
         std::string fragmentCode;
+        ReadSources( vertexPath, fragmentPath, defines, vertexCode, fragmentCode, this->Files );
+
+        // 2. Load the program from the cache if it was built before from the
+        // same sources by the same driver
+        uint64_t key = CacheKey( vertexCode, fragmentCode );
+        this->Program = glCreateProgram( );
+        if ( LoadBinary( this->Program, key ) )
+        {
+            CacheHits++;
+            return;
+        }
+        CacheMisses++;
+        // a rejected binary can leave the program in any state, so start over
+        glDeleteProgram( this->Program );
+
+        // 3. Compile shaders and link them, waiting for the driver to finish
+        GLuint vertex, fragment;
+        this->Program = StartBuild( vertexCode, fragmentCode, vertex, fragment );
+        if ( FinishBuild( this->Program, vertex, fragment ) )
+            SaveBinary( this->Program, key );
+    }
+    // Uses the current shader
+    void Use( )
+    {
+        glUseProgram( this->Program );
+    }
+
+private:
+    // ShaderReloader builds programs again in the same steps, just without
+    // waiting for them
+    friend class ShaderReloader;
+
+    // Reads both stages, with the files they #include and the defines of
+    // the variant. files gets the paths of everything that was read.
+    // Returns whether both files could be read
+    static bool ReadSources( const std::string &vertexPath, const std::string &fragmentPath, const std::string &defines,
+                             std::string &vertexCode, std::string &fragmentCode, std::vector<std::string> &files )
+    {
         std::ifstream vShaderFile;
         std::ifstream fShaderFile;
         // ensures ifstream objects can throw exceptions:
@@ -27,8 +106,8 @@ public:
         try
         {
             // Open files
-            vShaderFile.open( vertexPath );
-            fShaderFile.open( fragmentPath );
+            vShaderFile.open( vertexPath.c_str( ) );
+            fShaderFile.open( fragmentPath.c_str( ) );
             std::stringstream vShaderStream, fShaderStream;
             // Read file's buffer contents into streams
             vShaderStream << vShaderFile.rdbuf( );
@@ -43,26 +122,49 @@ public:
         catch ( std::ifstream::failure e )
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+            return false;
         }
+        // Pull in the files they #include
+        std::vector<std::string> vertexFiles( 1, vertexPath ), fragmentFiles( 1, fragmentPath );
+        vertexCode = Define( Preprocess( vertexCode, vertexPath, 0, vertexFiles ), defines );
+        fragmentCode = Define( Preprocess( fragmentCode, fragmentPath, 0, fragmentFiles ), defines );
+        files = vertexFiles;
+        files.insert( files.end( ), fragmentFiles.begin( ), fragmentFiles.end( ) );
+        return true;
+    }
 
-
+    // Hands both stages to the driver to compile and link, and returns the
+    // program without waiting for either. With parallel shader compiling
+    // the driver does the work on its own threads
+    static GLuint StartBuild( const std::string &vertexCode, const std::string &fragmentCode,
+                              GLuint &vertex, GLuint &fragment )
+    {
         const GLchar *vShaderCode = vertexCode.c_str( );
         const GLchar *fShaderCode = fragmentCode.c_str( );
-        // 2. Compile shaders
-        GLuint vertex, fragment;
-        GLint success;
-        GLchar infoLog[512];
-
-
         // Vertex Shader
         vertex = glCreateShader( GL_VERTEX_SHADER );
-
         glShaderSource( vertex, 1, &vShaderCode, NULL );
-
         glCompileShader( vertex );
+        // Fragment Shader
+        fragment = glCreateShader( GL_FRAGMENT_SHADER );
+        glShaderSource( fragment, 1, &fShaderCode, NULL );
+        glCompileShader( fragment );
+        // Shader Program
+        GLuint program = glCreateProgram( );
+        glAttachShader( program, vertex );
+        glAttachShader( program, fragment );
+        glProgramParameteri( program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE );
+        glLinkProgram( program );
+        return program;
+    }
 
-
-
+    // Prints the compile and link errors of a program StartBuild made, if
+    // there are any, and returns whether it linked. Waits for the driver
+    // unless it has already finished
+    static bool FinishBuild( GLuint program, GLuint vertex, GLuint fragment )
+    {
+        GLint success;
+        GLchar infoLog[512];
         // Print compile errors if any
         glGetShaderiv( vertex, GL_COMPILE_STATUS, &success );
         if ( !success )
@@ -70,41 +172,410 @@ public:
             glGetShaderInfoLog( vertex, 512, NULL, infoLog );
             std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
         }
-        // Fragment Shader
-        fragment = glCreateShader( GL_FRAGMENT_SHADER );
-        glShaderSource( fragment, 1, &fShaderCode, NULL );
-        glCompileShader( fragment );
-
-
-        // Print compile errors if any
         glGetShaderiv( fragment, GL_COMPILE_STATUS, &success );
         if ( !success )
         {
             glGetShaderInfoLog( fragment, 512, NULL, infoLog );
             std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
         }
-        // Shader Program
-        this->Program = glCreateProgram( );
-        glAttachShader( this->Program, vertex );
-        glAttachShader( this->Program, fragment );
-        glLinkProgram( this->Program );
         // Print linking errors if any
-        glGetProgramiv( this->Program, GL_LINK_STATUS, &success );
-        if (!success)
+        glGetProgramiv( program, GL_LINK_STATUS, &success );
+        if ( !success )
         {
-            glGetProgramInfoLog( this->Program, 512, NULL, infoLog );
+            glGetProgramInfoLog( program, 512, NULL, infoLog );
             std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
         }
         // Delete the shaders as they're linked into our program now and no longer necessery
         glDeleteShader( vertex );
         glDeleteShader( fragment );
+        return success == GL_TRUE;
+    }
+
+    // Replaces each #include "file" line with the contents of that file,
+    // found relative to the one including it. A file is only included once
+    // per shader. #line directives keep compile errors pointing at the right
+    // line, with included files numbered from 1 in the order they're
+    // included. included starts out as the file itself, and ends up with
+    // every file that was read
+    static std::string Preprocess( const std::string &source, const std::string &path, size_t number,
+                                   std::vector<std::string> &included )
+    {
+        std::string directory = path.substr( 0, path.find_last_of( '/' ) + 1 );
+        std::istringstream lines( source );
+        std::ostringstream out;
+        std::string line;
+        for ( int lineNumber = 1; std::getline( lines, line ); lineNumber++ )
+        {
+            size_t start = line.find_first_not_of( " \t" );
+            if ( start == std::string::npos || line.compare( start, 8, "#include" ) != 0 )
+            {
+                out << line << '\n';
+                continue;
+            }
+
+            size_t open = line.find( '"', start + 8 );
+            size_t close = open == std::string::npos ? open : line.find( '"', open + 1 );
+            if ( close == std::string::npos )
+            {
+                std::cout << "ERROR::SHADER::BAD_INCLUDE " << path << ":" << lineNumber << std::endl;
+                out << '\n';
+                continue;
+            }
+            // Blank lines in place of the #include keep the line count right
+            std::string name = directory + line.substr( open + 1, close - open - 1 );
+            if ( std::find( included.begin( ), included.end( ), name ) != included.end( ) )
+            {
+                out << '\n';
+                continue;
+            }
+            std::ifstream file( name.c_str( ) );
+            if ( !file.is_open( ) )
+            {
+                std::cout << "ERROR::SHADER::INCLUDE_NOT_SUCCESFULLY_READ " << name << std::endl;
+                out << '\n';
+                continue;
+            }
 
+            std::stringstream contents;
+            contents << file.rdbuf( );
+            included.push_back( name );
+            size_t includedNumber = included.size( ) - 1;
+            out << "#line 1 " << includedNumber << '\n'
+                << Preprocess( contents.str( ), name, includedNumber, included )
+                << "#line " << lineNumber + 1 << ' ' << number << '\n';
+        }
+        return out.str( );
     }
-    // Uses the current shader
-    void Use( )
+
+    // Puts the defines after the first line, which has to be the #version
+    // directive, then goes back to numbering the lines from 2
+    static std::string Define( const std::string &source, const std::string &defines )
     {
-        glUseProgram( this->Program );
+        size_t end = source.find( '\n' );
+        if ( defines.empty( ) || end == std::string::npos )
+            return source;
+        return source.substr( 0, end + 1 ) + defines + "#line 2 0\n" + source.substr( end + 1 );
+    }
+
+    // Cache files start with this, then the key, the binary format, the
+    // binary's length and a checksum of it, then the binary itself
+    static const char *CacheMagic( ) { return "VTXPROG1"; }
+
+    // 64-bit FNV-1a, to key and checksum cache entries
+    static uint64_t Hash( const void *data, size_t length, uint64_t hash = 14695981039346656037ull )
+    {
+        const unsigned char *bytes = ( const unsigned char * )data;
+        for ( size_t i = 0; i < length; i++ )
+        {
+            hash = ( hash ^ bytes[i] ) * 1099511628211ull;
+        }
+        return hash;
+    }
+
+    // Binaries only work with the driver that made them, so the key covers
+    // that as well as the sources
+    static uint64_t CacheKey( const std::string &vertexCode, const std::string &fragmentCode )
+    {
+        std::string key = vertexCode + '\0' + fragmentCode;
+        const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for ( GLenum name : strings )
+        {
+            const GLubyte *value = glGetString( name );
+            key += '\0';
+            if ( value )
+                key += ( const char * )value;
+        }
+        return Hash( key.data( ), key.size( ) );
+    }
+
+    static std::string CacheFile( uint64_t key )
+    {
+        char name[32];
+        snprintf( name, sizeof( name ), "%016llx.bin", ( unsigned long long )key );
+        return std::string( SHADER_CACHE_DIR ) + name;
+    }
+
+    // Returns whether the cached binary was there and the driver took it
+    static bool LoadBinary( GLuint program, uint64_t key )
+    {
+        GLint formats = 0;
+        glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &formats );
+        if ( formats == 0 )
+            return false;
+
+        std::ifstream file( CacheFile( key ).c_str( ), std::ios::binary );
+        char magic[8];
+        uint64_t fileKey, checksum;
+        GLenum format;
+        uint32_t length;
+        if ( !file.read( magic, 8 ) || memcmp( magic, CacheMagic( ), 8 ) != 0
+             || !file.read( ( char * )&fileKey, sizeof( fileKey ) ) || fileKey != key
+             || !file.read( ( char * )&format, sizeof( format ) )
+             || !file.read( ( char * )&length, sizeof( length ) )
+             || !file.read( ( char * )&checksum, sizeof( checksum ) ) || length == 0 )
+            return false;
+
+        std::vector<char> binary( length );
+        if ( !file.read( &binary[0], length ) || Hash( &binary[0], length ) != checksum )
+            return false;
+
+        glProgramBinary( program, format, &binary[0], length );
+        GLint success;
+        glGetProgramiv( program, GL_LINK_STATUS, &success );
+        return success == GL_TRUE;
+    }
+
+    // Writes the linked program to the cache, through a temporary file so
+    // an interrupted write never leaves a truncated entry behind
+    static void SaveBinary( GLuint program, uint64_t key )
+    {
+        GLint formats = 0, length = 0;
+        glGetIntegerv( GL_NUM_PROGRAM_BINARY_FORMATS, &formats );
+        glGetProgramiv( program, GL_PROGRAM_BINARY_LENGTH, &length );
+        if ( formats == 0 || length <= 0 )
+            return;
+
+        std::vector<char> binary( length );
+        GLenum format;
+        glGetProgramBinary( program, length, &length, &format, &binary[0] );
+        if ( length <= 0 )
+            return;
+
+        mkdir( SHADER_CACHE_DIR, 0755 );
+        std::string path = CacheFile( key );
+        std::string temporary = path + ".tmp";
+        std::ofstream file( temporary.c_str( ), std::ios::binary );
+        uint32_t size = ( uint32_t )length;
+        uint64_t checksum = Hash( &binary[0], size );
+        file.write( CacheMagic( ), 8 );
+        file.write( ( const char * )&key, sizeof( key ) );
+        file.write( ( const char * )&format, sizeof( format ) );
+        file.write( ( const char * )&size, sizeof( size ) );
+        file.write( ( const char * )&checksum, sizeof( checksum ) );
+        file.write( &binary[0], size );
+        file.close( );
+        if ( file )
+            std::rename( temporary.c_str( ), path.c_str( ) );
+        else
+            std::remove( temporary.c_str( ) );
     }
 };
 
+unsigned Shader::CacheHits = 0;
+unsigned Shader::CacheMisses = 0;
+
+// Builds programs again when their files are saved, while the old ones keep
+// drawing, so shaders can be edited without restarting. The directories of
+// the files are watched with inotify, and a new program replaces the old one
+// only once it has linked; if it doesn't, the errors are printed and the old
+// one stays. Nothing here waits for the compiler: with parallel shader
+// compiling the driver says when it's done, and otherwise the link status is
+// only asked for after SHADER_RELOAD_FRAMES frames
+class ShaderReloader
+{
+public:
+    // Rebuilds shader's program when any of its files change, keeping the
+    // current one in *program. setup is called after a new program replaces
+    // it, to set its uniforms up again
+    static void Watch( const Shader &shader, GLuint *program, std::function<void( )> setup )
+    {
+        if ( Inotify == -1 )
+            Open( );
+        if ( Inotify < 0 )
+            return;
+
+        Entry entry;
+        entry.vertexPath = shader.VertexPath;
+        entry.fragmentPath = shader.FragmentPath;
+        entry.defines = shader.Defines;
+        entry.files = shader.Files;
+        entry.program = program;
+        entry.setup = setup;
+        entry.dirty = false;
+        entry.pending = 0;
+        Entries.push_back( entry );
+        WatchDirectories( shader.Files );
+    }
+
+    // Called once a frame, before drawing: starts rebuilding the programs
+    // whose files were saved, and swaps in the ones that have linked.
+    // Returns whether it swapped any, which binds programs along the way
+    static bool Poll( )
+    {
+        if ( Inotify < 0 )
+            return false;
+
+        // 1. Mark the programs that use a file that was written
+        alignas( inotify_event ) char events[4096];
+        ssize_t length;
+        while ( ( length = read( Inotify, events, sizeof( events ) ) ) > 0 )
+        {
+            for ( char *p = events; p < events + length; p += sizeof( inotify_event ) + ( ( inotify_event * )p )->len )
+            {
+                const inotify_event *event = ( const inotify_event * )p;
+                if ( event->len == 0 || Directories.count( event->wd ) == 0 )
+                    continue;
+                std::string name = Directories[event->wd] + event->name;
+                for ( Entry &entry : Entries )
+                {
+                    if ( std::find( entry.files.begin( ), entry.files.end( ), name ) != entry.files.end( ) )
+                        entry.dirty = true;
+                }
+            }
+        }
+
+        bool swapped = false;
+        for ( Entry &entry : Entries )
+        {
+            // 2. Start building the marked ones, over any build that's
+            // already underway since that has the old sources
+            if ( entry.dirty )
+            {
+                entry.dirty = false;
+                swapped |= Rebuild( entry );
+            }
+
+            // 3. Swap in the builds the driver is done with
+            if ( entry.pending != 0 && Finished( entry ) )
+                swapped |= Finish( entry );
+        }
+        return swapped;
+    }
+
+private:
+    struct Entry
+    {
+        std::string vertexPath;
+        std::string fragmentPath;
+        std::string defines;
+        std::vector<std::string> files;
+        GLuint *program;
+        std::function<void( )> setup;
+        bool dirty;
+        // the build underway, if pending isn't 0
+        GLuint pending, vertex, fragment;
+        uint64_t key;
+        int frames;
+    };
+
+    static std::vector<Entry> Entries;
+    static std::map<int, std::string> Directories;  // by inotify watch descriptor
+    static int Inotify;     // -1 before the first Watch, -2 if inotify failed
+    static bool Parallel;   // whether the driver compiles on its own threads
+
+    static void Open( )
+    {
+        Inotify = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+        if ( Inotify < 0 )
+        {
+            std::cout << "ERROR::SHADER::RELOAD::INOTIFY_FAILED" << std::endl;
+            Inotify = -2;
+            return;
+        }
+
+        Parallel = false;
+#ifdef GL_KHR_parallel_shader_compile
+        if ( !Parallel && glewIsSupported( "GL_KHR_parallel_shader_compile" ) )
+        {
+            glMaxShaderCompilerThreadsKHR( 0xFFFFFFFF );
+            Parallel = true;
+        }
+#endif
+#ifdef GL_ARB_parallel_shader_compile
+        if ( !Parallel && glewIsSupported( "GL_ARB_parallel_shader_compile" ) )
+        {
+            glMaxShaderCompilerThreadsARB( 0xFFFFFFFF );
+            Parallel = true;
+        }
+#endif
+    }
+
+    // Watches the directory of each file, once. Editors that save by writing
+    // a new file and renaming it over the old one still show up, as a file
+    // moved into the directory
+    static void WatchDirectories( const std::vector<std::string> &files )
+    {
+        for ( const std::string &file : files )
+        {
+            std::string directory = file.substr( 0, file.find_last_of( '/' ) + 1 );
+            int wd = inotify_add_watch( Inotify, directory.empty( ) ? "." : directory.c_str( ), IN_CLOSE_WRITE | IN_MOVED_TO );
+            if ( wd >= 0 )
+                Directories[wd] = directory;
+        }
+    }
+
+    // Returns whether the program was swapped straight away, from the cache
+    static bool Rebuild( Entry &entry )
+    {
+        if ( entry.pending != 0 )
+        {
+            glDeleteProgram( entry.pending );
+            glDeleteShader( entry.vertex );
+            glDeleteShader( entry.fragment );
+            entry.pending = 0;
+        }
+
+        std::string vertexCode, fragmentCode;
+        std::vector<std::string> files;
+        if ( !Shader::ReadSources( entry.vertexPath, entry.fragmentPath, entry.defines, vertexCode, fragmentCode, files ) )
+            return false;
+        // what it includes may have changed
+        entry.files = files;
+        WatchDirectories( files );
+
+        // going back to an earlier version finds it in the cache
+        entry.key = Shader::CacheKey( vertexCode, fragmentCode );
+        GLuint program = glCreateProgram( );
+        if ( Shader::LoadBinary( program, entry.key ) )
+        {
+            Swap( entry, program );
+            return true;
+        }
+        glDeleteProgram( program );
+
+        entry.pending = Shader::StartBuild( vertexCode, fragmentCode, entry.vertex, entry.fragment );
+        entry.frames = 0;
+        return false;
+    }
+
+    static bool Finished( Entry &entry )
+    {
+        if ( !Parallel )
+            return ++entry.frames > SHADER_RELOAD_FRAMES;
+        GLint done = GL_FALSE;
+        glGetProgramiv( entry.pending, GL_COMPLETION_STATUS_KHR, &done );
+        return done == GL_TRUE;
+    }
+
+    // Returns whether the new program linked and was swapped in
+    static bool Finish( Entry &entry )
+    {
+        GLuint program = entry.pending;
+        entry.pending = 0;
+        if ( !Shader::FinishBuild( program, entry.vertex, entry.fragment ) )
+        {
+            std::cout << "keeping the last program of " << entry.vertexPath << " and " << entry.fragmentPath << std::endl;
+            glDeleteProgram( program );
+            return false;
+        }
+        Shader::SaveBinary( program, entry.key );
+        Swap( entry, program );
+        return true;
+    }
+
+    // Happens between frames, so no draw ever sees a half set up program
+    static void Swap( Entry &entry, GLuint program )
+    {
+        glDeleteProgram( *entry.program );
+        *entry.program = program;
+        entry.setup( );
+        std::cout << "reloaded " << entry.vertexPath << " and " << entry.fragmentPath << std::endl;
+    }
+};
+
+std::vector<ShaderReloader::Entry> ShaderReloader::Entries;
+std::map<int, std::string> ShaderReloader::Directories;
+int ShaderReloader::Inotify = -1;
+bool ShaderReloader::Parallel = false;
+
 #endif
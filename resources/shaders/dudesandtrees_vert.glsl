@@ -1,52 +1,41 @@
 #version 330
-in  vec3 vPosition;
+// the locations are fixed so a reloaded program matches the vertex array
+layout(location = 0) in vec3 vPosition;
 in  vec3 vNormal;
 in  vec3 vColor;
-out vec4 color;
-out vec4 norm;
 
-uniform int t;
-uniform int scroll;
-uniform float scale;
-uniform mat4 proj;
+// one of each per entity, see DudesAndTreesModel::update_instances
+layout(location = 1) in vec3 iOffset;
+layout(location = 2) in vec3 iColor;
+layout(location = 3) in vec2 iState;  // point size, and 1 if it bobs up and down
 
-uniform int bounce;
+out vec4 color;
+out vec4 norm;
 
-uniform vec3 ucolor;
-uniform vec3 offset;
+#include "frame.glsl"
 
 uniform sampler2D rock_height_tex;
 uniform sampler2D rock_normal_tex;
 
-//thanks to Neil Mendoza via http://www.neilmendoza.com/glsl-rotation-about-an-arbitrary-axis/
-mat4 rotationMatrix(vec3 axis, float angle) {
-    axis = normalize(axis);
-    float s = sin(angle);
-    float c = cos(angle);
-    float oc = 1.0 - c;
-
-    return mat4(oc * axis.x * axis.x + c,           oc * axis.x * axis.y - axis.z * s,  oc * axis.z * axis.x + axis.y * s,  0.0,
-                oc * axis.x * axis.y + axis.z * s,  oc * axis.y * axis.y + c,           oc * axis.y * axis.z - axis.x * s,  0.0,
-                oc * axis.z * axis.x - axis.y * s,  oc * axis.y * axis.z + axis.x * s,  oc * axis.z * axis.z + c,           0.0,
-                0.0,                                0.0,                                0.0,                                1.0);
-}
+#include "common.glsl"
 
 void main() {
-	vec4 trefh = texture(rock_height_tex,  (0.5 * offset.xy));// + timeoffset);
-	vec4 trefn = texture(rock_normal_tex, (0.5 * offset.xy));
+	vec4 trefh = texture(rock_height_tex,  (0.5 * iOffset.xy));// + timeoffset);
+	vec4 trefn = texture(rock_normal_tex, (0.5 * iOffset.xy));
 
 	norm = trefn;
-	color = vec4(ucolor,1.0);
+	color = vec4(iColor,1.0);
+	gl_PointSize = iState.x * resolution.y;  //the same size in the window, at any resolution
 
 	float height_scale = 1.5*clamp(0.3 * (trefh.z - 0.5),0,1) + 0.05;
 	vec4 texture_height_offset;
 
-	if(bounce == 1)
+	if(iState.y > 0.5)
 		texture_height_offset = 0.6 * vec4(0,0,height_scale,0) + vec4(0,0,trefn.x * 0.005 * (sin(0.05 * t) - 0.7),0.0) + vec4(0,0,trefh.x * 0.005 * (sin(0.05 * t) - 0.7),0.0);
 	else
 		texture_height_offset = 0.6 * vec4(0,0,height_scale,0);
 
-	vec4 vPosition_rotated = rotationMatrix(vec3(0.0,0.0,1.0), 10 * offset.x * offset.y) * vec4(vPosition,1.0);
-	vec4 vPosition_local = vec4(0.5*vPosition_rotated.xy, vPosition_rotated.z, 1.0f) + texture_height_offset + vec4(offset.xy,0,0);
-	gl_Position = proj * rotationMatrix(vec3(0.0f, 1.0f, 0.0f), 0.25) * rotationMatrix(vec3(1.0f, 0.0f, 0.0f), 2.15) * rotationMatrix(vec3(0.0f, 0.0f, 1.0f), 0.5 * sin(0.0005 * t) + 0.3) * vPosition_local;
+	vec4 vPosition_rotated = rotationMatrix(vec3(0.0,0.0,1.0), 10 * iOffset.x * iOffset.y) * vec4(vPosition,1.0);
+	vec4 vPosition_local = vec4(0.5*vPosition_rotated.xy, vPosition_rotated.z, 1.0f) + texture_height_offset + vec4(iOffset.xy,0,0);
+	gl_Position = view * vPosition_local;
 }
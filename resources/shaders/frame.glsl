@@ -0,0 +1,10 @@
+// Values that change at most once a frame, shared by every program through
+// the uniform buffer of FrameContext in model.h. The layout has to match
+// FrameUniforms there
+layout(std140) uniform Frame {
+	mat4 view;        // projection times the view rotation
+	vec4 light;       // direction of the light on the ground
+	float t;          // animation time, 60 units a second
+	float scale;      // of the terrain's texture coordinates
+	vec2 resolution;  // of the scene, in its pixels a window pixel
+};
@@ -1,5 +1,8 @@
 #version 330
 varying  vec4 color;
+
+#include "scene.glsl"
+
 void main() {
-	gl_FragColor = color;
+	write_scene(color, STYLE_NONE);
 }
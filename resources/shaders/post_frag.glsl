@@ -0,0 +1,86 @@
+#version 330
+
+#include "frame.glsl"
+#include "styles.glsl"
+
+uniform sampler2D scene_tex;
+uniform sampler2D style_tex;
+uniform sampler2D dry_tex;
+
+// the weights of the four texels around a point f of the way from the second
+// to the third, for a Catmull-Rom spline through them
+vec4 catmull_rom(float f) {
+	float f2 = f * f;
+	float f3 = f2 * f;
+	return vec4(-0.5 * f3 + f2 - 0.5 * f,
+	             1.5 * f3 - 2.5 * f2 + 1.0,
+	            -1.5 * f3 + 2.0 * f2 + 0.5 * f,
+	             0.5 * f3 - 0.5 * f2);
+}
+
+// the scene at a point of the window. At full resolution that's its texel,
+// and below it the 4x4 texels around the point, filtered. The filter goes
+// through the texels, so it stays sharp, and the scanlines hide its ringing
+vec3 upscale(sampler2D tex, vec2 window, ivec2 last) {
+	if(resolution == vec2(1.0))
+		return texelFetch(tex, ivec2(window), 0).rgb;
+
+	vec2 p = window * resolution - 0.5;  // from the first texel's center
+	ivec2 base = ivec2(floor(p));
+	vec2 f = p - vec2(base);
+	vec4 wx = catmull_rom(f.x);
+	vec4 wy = catmull_rom(f.y);
+
+	vec3 sum = vec3(0.0);
+	for(int j = 0; j < 4; j++)
+		for(int i = 0; i < 4; i++)
+			sum += wx[i] * wy[j] * texelFetch(tex, clamp(base + ivec2(i - 1, j - 1), ivec2(0), last), 0).rgb;
+	return sum;
+}
+
+void main() {
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	bool gap = water_gap(pixel);
+
+	// the last of the scene's texels, in the corner of its target, and the
+	// one nearest this pixel for what can't be filtered
+	ivec2 last = ivec2(vec2(textureSize(scene_tex, 0)) * resolution + 0.5) - 1;
+	ivec2 nearest = min(ivec2(gl_FragCoord.xy * resolution), last);
+
+	// the scene with the water, or what's under it in the water's gaps
+	vec4 dry = texelFetch(dry_tex, nearest, 0);
+	vec3 color = gap ? upscale(dry_tex, gl_FragCoord.xy, last) : upscale(scene_tex, gl_FragCoord.xy, last);
+	int style = int(texelFetch(style_tex, nearest, 0).r * STYLE_SCALE + 0.5);
+
+	// behind the skirts' water, 1 - a + a * a where it's blended once. Take
+	// it back out, to style what's behind it first
+	bool skirt_water = dry.a < 1.0 - 0.5 * SKIRT_WATER.a * (1.0 - SKIRT_WATER.a);
+	if(skirt_water)
+		color = (color - SKIRT_WATER.rgb * SKIRT_WATER.a) / (1.0 - SKIRT_WATER.a);
+
+	//these are used to draw something along the lines of scanlines
+	int fcxmod2 = pixel.x % 2;
+	int fcymod2 = pixel.y % 2;
+
+	if(style == STYLE_GROUND) {
+		if(gap)
+			color.r *= 1.618;
+	} else if(style == STYLE_DUDES) {
+		if((fcymod2 == 1) || (fcxmod2 == 1))
+			color.r = 0;
+	} else if(style == STYLE_SKIRT_GROUND) {
+		if((fcymod2 == 0) || (fcxmod2 == 0)) {
+			color.r *= 2*1.618;
+			color.g *= 1.618;
+		}
+	}
+
+	if(skirt_water) {
+		vec4 water = SKIRT_WATER;
+		if((fcymod2 == 1) || (fcxmod2 == 1))
+			water /= 1.618;
+		color = mix(clamp(color, 0.0, 1.0), water.rgb, water.a);
+	}
+
+	gl_FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,31 @@
+// The outputs of the scene's programs, attachments of the scene target of
+// PostProcess in model.h, and how each kind of surface writes them
+#include "styles.glsl"
+
+layout(location = 0) out vec4 scene_color;  // the scene, water and all
+layout(location = 1) out vec4 scene_style;  // the style of what's in front
+layout(location = 2) out vec4 scene_dry;    // the scene without the water
+
+// anything opaque. Its style replaces what was there
+void write_scene(vec4 color, int style) {
+	scene_color = color;
+	scene_dry = vec4(color.rgb, 1.0);
+	scene_style = vec4(float(style) / STYLE_SCALE, 0.0, 0.0, 1.0);
+}
+
+// the water blends into the scene, and leaves the copy without it and the
+// style alone, since its alpha there is 0
+void write_water(vec4 color) {
+	scene_color = color;
+	scene_dry = vec4(0.0);
+	scene_style = vec4(0.0);
+}
+
+// the skirts' water blends into both copies of the scene, and leaves the
+// style of what's behind it. Blending takes the alpha of the copy without
+// water below 1, which is how the post process finds it
+void write_skirt_water() {
+	scene_color = SKIRT_WATER;
+	scene_dry = SKIRT_WATER;
+	scene_style = vec4(0.0);
+}
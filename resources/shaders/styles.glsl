@@ -0,0 +1,21 @@
+// The styles the post process gives what's in front of each pixel, written
+// by the scene's programs through scene.glsl and read by post_frag.glsl.
+// Each is a tint on a pattern of pixels, which used to be done in the
+// programs themselves, with discard for the water
+#define STYLE_NONE         0
+#define STYLE_GROUND       1  // red brightened in the water's gaps
+#define STYLE_DUDES        2  // red taken out on odd rows and columns
+#define STYLE_SKIRT_GROUND 3  // red and green brightened on even rows and columns
+
+// the styles are stored in 8 bit unsigned normalized texels
+#define STYLE_SCALE 255.0
+
+// the skirts' water, blended over what's behind them. On odd rows and
+// columns it's divided by 1.618 before blending, alpha and all
+#define SKIRT_WATER vec4(0.1, 0.2, 0.4, 0.3)
+
+// the water is drawn on odd columns, and two rows of three. The rest are
+// gaps where what's under it shows through
+bool water_gap(ivec2 pixel) {
+	return pixel.y % 3 == 0 || pixel.x % 2 == 0;
+}
@@ -0,0 +1,18 @@
+// Where the terrain's textures are read for a vertex. There's a variant of
+// each program for every scrolling mode, with SCROLL defined by the model
+// that compiles it, so this has no branch and the offsets fold into the
+// arithmetic. Include after frame.glsl, for t and scale
+
+#ifndef SCROLL
+#define SCROLL 0
+#endif
+
+vec2 terrain_coord(vec2 p) {
+#if SCROLL == 1
+	return scale * (0.2 * p + vec2(t/1000.0) + 0.15 * p + vec2(t/7000.0));
+#elif SCROLL == 2
+	return scale * (0.2 * p + vec2(t/7000.0) + 0.15 * p + vec2(t/7000.0));
+#else
+	return scale * (0.25 * p);
+#endif
+}